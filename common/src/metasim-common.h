@@ -1,30 +1,127 @@
 #ifndef __METASIM_COMMON_H
 #define __METASIM_COMMON_H
 
+#include <stdlib.h>
 #include <margo.h>
 
+#include "metasim-peer.h"
+
 #define METASIM_LISTENER_ADDR_FILE "/tmp/metasim-listener-addr"
 
+/* maximum number of seeds in a single sum_batch request */
+#define METASIM_SUM_BATCH_MAX 4096
+
+/* maximum bytes that a server sends in an alltoall request (size * nservers) */
+#define METASIM_ALLTOALL_BYTES_MAX (1ULL << 30)
+
+/* maximum bytes gathered in a gather request (size * nservers) */
+#define METASIM_GATHER_BYTES_MAX (1ULL << 30)
+
+/* maximum bytes of the vector in a reduce-scatter request
+ * (count * nservers * sizeof(int64_t)) */
+#define METASIM_REDUCE_SCATTER_BYTES_MAX (1ULL << 30)
+
+/* maximum bytes and tree degree of a bcast request */
+#define METASIM_BCAST_BYTES_MAX (1ULL << 30)
+#define METASIM_BCAST_DEGREE_MAX 64
+
 /* local rpc with metasim listener */
 
 struct metasim_rpcset {
     hg_id_t init;
     hg_id_t terminate;
+    hg_id_t peers;
     hg_id_t echo;
     hg_id_t ping;
     hg_id_t sum;
     hg_id_t sumrepeat;
+    hg_id_t sum_batch;
+    hg_id_t exscan;
+    hg_id_t alltoall;
+    hg_id_t reduce_scatter;
+    hg_id_t gather;
+    hg_id_t bcast;
 };
 
 typedef struct metasim_rpcset metasim_rpcset_t;
 
+/* variable-length int32_t array, carried inline in rpc, of at most
+ * METASIM_SUM_BATCH_MAX elements */
+typedef struct {
+    int32_t count;
+    int32_t *v;
+} metasim_int32_vec_t;
+
+static inline hg_return_t hg_proc_metasim_int32_vec_t(hg_proc_t proc,
+                                                      void *data)
+{
+    hg_return_t hret = HG_SUCCESS;
+    metasim_int32_vec_t *vec = (metasim_int32_vec_t *) data;
+    size_t len = 0;
+
+    hret = hg_proc_int32_t(proc, &vec->count);
+    if (hret != HG_SUCCESS)
+        return hret;
+
+    /* the count comes from the wire when decoding */
+    if (vec->count < 0 || vec->count > METASIM_SUM_BATCH_MAX)
+        return HG_INVALID_ARG;
+
+    len = vec->count * sizeof(int32_t);
+
+    switch (hg_proc_get_op(proc)) {
+    case HG_ENCODE:
+        if (len > 0)
+            hret = hg_proc_memcpy(proc, vec->v, len);
+        break;
+
+    case HG_DECODE:
+        vec->v = NULL;
+        if (len > 0) {
+            vec->v = malloc(len);
+            if (!vec->v)
+                return HG_NOMEM;
+            hret = hg_proc_memcpy(proc, vec->v, len);
+        }
+        break;
+
+    case HG_FREE:
+        if (vec->v) {
+            free(vec->v);
+            vec->v = NULL;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return hret;
+}
+
 MERCURY_GEN_PROC(metasim_init_in_t,
                  ((int32_t)(rank))
                  ((int32_t)(pid)));
 MERCURY_GEN_PROC(metasim_init_out_t,
                  ((int32_t)(ret))
                  ((int32_t)(rank))
-                 ((int32_t)(nranks)));
+                 ((int32_t)(nranks))
+                 ((hg_const_string_t)(transport))
+                 ((hg_const_string_t)(inject)));
+
+/* the fabric addresses of servers, newline-separated in @addrs, starting
+ * from rank @offset. the listener returns as many as fit in
+ * METASIM_PEERS_MAX_LEN bytes, and clients repeat until they have all. */
+#define METASIM_PEERS_MAX_LEN 2048
+
+MERCURY_GEN_PROC(metasim_peers_in_t,
+                 ((int32_t)(offset)));
+MERCURY_GEN_PROC(metasim_peers_out_t,
+                 ((int32_t)(ret))
+                 ((int32_t)(nranks))
+                 ((int32_t)(count))
+                 ((hg_const_string_t)(transport))
+                 ((hg_const_string_t)(addrs)));
 
 MERCURY_GEN_PROC(metasim_terminate_in_t,
                  ((int32_t)(rank))
@@ -44,11 +141,15 @@ MERCURY_GEN_PROC(metasim_ping_out_t,
                  ((int32_t)(ret))
                  ((int32_t)(pong)));
 
+/* with a non-zero timeout, the sum may be partial, and contributors is the
+ * number of servers in the sum */
 MERCURY_GEN_PROC(metasim_sum_in_t,
-                 ((int32_t)(seed)));
+                 ((int32_t)(seed))
+                 ((uint64_t)(timeout_usec)));
 MERCURY_GEN_PROC(metasim_sum_out_t,
                  ((int32_t)(ret))
                  ((int32_t)(sum))
+                 ((int32_t)(contributors))
                  ((uint64_t)(elapsed_usec)));
 
 MERCURY_GEN_PROC(metasim_sumrepeat_in_t,
@@ -59,5 +160,58 @@ MERCURY_GEN_PROC(metasim_sumrepeat_out_t,
                  ((int32_t)(sum))
                  ((uint64_t)(elapsed_usec)));
 
+MERCURY_GEN_PROC(metasim_sum_batch_in_t,
+                 ((metasim_int32_vec_t)(seeds)));
+MERCURY_GEN_PROC(metasim_sum_batch_out_t,
+                 ((int32_t)(ret))
+                 ((metasim_int32_vec_t)(sums))
+                 ((uint64_t)(elapsed_usec)));
+
+MERCURY_GEN_PROC(metasim_exscan_in_t,
+                 ((uint64_t)(value)));
+MERCURY_GEN_PROC(metasim_exscan_out_t,
+                 ((int32_t)(ret))
+                 ((uint64_t)(offset))
+                 ((uint64_t)(elapsed_usec)));
+
+MERCURY_GEN_PROC(metasim_alltoall_in_t,
+                 ((uint64_t)(size))
+                 ((int32_t)(aggregate))
+                 ((int32_t)(window)));
+MERCURY_GEN_PROC(metasim_alltoall_out_t,
+                 ((int32_t)(ret))
+                 ((uint64_t)(msgs))
+                 ((uint64_t)(len))
+                 ((uint64_t)(elapsed_usec)));
+
+MERCURY_GEN_PROC(metasim_reduce_scatter_in_t,
+                 ((uint64_t)(count))
+                 ((int32_t)(op))
+                 ((int32_t)(algo)));
+MERCURY_GEN_PROC(metasim_reduce_scatter_out_t,
+                 ((int32_t)(ret))
+                 ((uint64_t)(bytes))
+                 ((uint64_t)(msgs))
+                 ((uint64_t)(elapsed_usec)));
+
+MERCURY_GEN_PROC(metasim_gather_in_t,
+                 ((int32_t)(size))
+                 ((int32_t)(all)));
+MERCURY_GEN_PROC(metasim_gather_out_t,
+                 ((int32_t)(ret))
+                 ((int32_t)(count))
+                 ((uint64_t)(len))
+                 ((uint64_t)(mem_peak))
+                 ((uint64_t)(elapsed_usec)));
+
+MERCURY_GEN_PROC(metasim_bcast_in_t,
+                 ((uint64_t)(size))
+                 ((uint64_t)(segsize))
+                 ((int32_t)(degree))
+                 ((int32_t)(tree)));
+MERCURY_GEN_PROC(metasim_bcast_out_t,
+                 ((int32_t)(ret))
+                 ((uint64_t)(elapsed_usec)));
+
 #endif /* __METASIM_COMMON_H */
 
@@ -0,0 +1,23 @@
+#ifndef __METASIM_PEER_H
+#define __METASIM_PEER_H
+
+#include <margo.h>
+
+/* server-to-server rpcs that clients may also send directly to a remote
+ * server, bypassing the local listener (see metasim_init). this is included
+ * by both the server rpcs and the client library, so only the names defined
+ * here should be shared. */
+
+#define METASIM_RPC_PING "metasim_rpc_ping"
+
+/* the responding server reports its clock (CLOCK_REALTIME in usec) when the
+ * request was received and when the response was sent, for clock offset
+ * estimation. */
+MERCURY_GEN_PROC(metasim_rpc_ping_in_t,
+                 ((int32_t)(ping)));
+MERCURY_GEN_PROC(metasim_rpc_ping_out_t,
+                 ((int32_t)(pong))
+                 ((uint64_t)(recv_usec))
+                 ((uint64_t)(send_usec)));
+
+#endif /* __METASIM_PEER_H */
@@ -0,0 +1,75 @@
+#ifndef __METASIM_PROGRESS_H
+#define __METASIM_PROGRESS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <margo.h>
+
+/* how margo progress waits for network events:
+ *  block:  HG_Progress blocks up to margo's default timeout (100 ms)
+ *  spin:   zero progress timeout, i.e., busy-polling the network
+ *  hybrid: spins while there is work in flight, and for spin_usec after the
+ *          last of it, then blocks again */
+enum {
+    METASIM_PROGRESS_BLOCK = 0,
+    METASIM_PROGRESS_SPIN,
+    METASIM_PROGRESS_HYBRID,
+};
+
+#define METASIM_PROGRESS_TIMEOUT_DEFAULT    100     /* msec */
+#define METASIM_PROGRESS_SPIN_USEC_DEFAULT  1000
+
+typedef struct {
+    int mode;
+    unsigned int spin_usec;     /* spin budget in hybrid mode */
+} metasim_progress_conf_t;
+
+static inline const char *metasim_progress_name(int mode)
+{
+    switch (mode) {
+    case METASIM_PROGRESS_SPIN:
+        return "spin";
+    case METASIM_PROGRESS_HYBRID:
+        return "hybrid";
+    default:
+        return "block";
+    }
+}
+
+/* parses "block", "spin" or "hybrid[:<usec>]". returns 0 on success. */
+static inline int metasim_progress_parse(const char *str,
+                                         metasim_progress_conf_t *conf)
+{
+    conf->mode = METASIM_PROGRESS_BLOCK;
+    conf->spin_usec = METASIM_PROGRESS_SPIN_USEC_DEFAULT;
+
+    if (!str || !strcmp(str, "block"))
+        return 0;
+
+    if (!strcmp(str, "spin")) {
+        conf->mode = METASIM_PROGRESS_SPIN;
+        return 0;
+    }
+
+    if (!strncmp(str, "hybrid", strlen("hybrid"))) {
+        str += strlen("hybrid");
+        if (str[0] == ':')
+            conf->spin_usec = strtoul(&str[1], NULL, 0);
+        else if (str[0] != '\0')
+            return -1;
+
+        conf->mode = METASIM_PROGRESS_HYBRID;
+        return 0;
+    }
+
+    return -1;
+}
+
+/* sets the upper bound of the blocking time in HG_Progress of @mid */
+static inline void metasim_progress_set_timeout(margo_instance_id mid,
+                                                unsigned int msec)
+{
+    margo_set_param(mid, MARGO_PARAM_PROGRESS_TIMEOUT_UB, &msec);
+}
+
+#endif /* __METASIM_PROGRESS_H */
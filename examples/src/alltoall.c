@@ -0,0 +1,261 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static metasim_t metasim;
+
+/* one client on each node (server) participates in the all-to-all */
+static MPI_Comm leader_comm = MPI_COMM_NULL;
+static int leader_rank;
+
+static int init_leaders(void)
+{
+    int local_rank = 0;
+    int leader_nranks = 0;
+    MPI_Comm local_comm;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &local_comm);
+    MPI_Comm_rank(local_comm, &local_rank);
+    MPI_Comm_free(&local_comm);
+
+    MPI_Comm_split(MPI_COMM_WORLD, local_rank == 0 ? 0 : MPI_UNDEFINED,
+                   server_rank, &leader_comm);
+
+    if (leader_comm == MPI_COMM_NULL)
+        return 0;
+
+    MPI_Comm_rank(leader_comm, &leader_rank);
+    MPI_Comm_size(leader_comm, &leader_nranks);
+
+    if (leader_nranks != server_nranks) {
+        __error("[%d] expected one client per server (%d clients, "
+                "%d servers)", rank, leader_nranks, server_nranks);
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint64_t parse_size(const char *str)
+{
+    char *pos = NULL;
+    uint64_t size = strtoull(str, &pos, 0);
+
+    switch (toupper(*pos)) {
+    case 'G':
+        size <<= 10;
+        /* fall through */
+    case 'M':
+        size <<= 10;
+        /* fall through */
+    case 'K':
+        size <<= 10;
+        break;
+    default:
+        break;
+    }
+
+    return size;
+}
+
+static void do_alltoall(uint64_t size, int aggregate, int window, int repeat)
+{
+    int i = 0;
+    int ret = 0;
+    int failed = 0;
+    int all_failed = 0;
+    uint64_t msgs = 0;
+    uint64_t total_msgs = 0;
+    uint64_t all_msgs = 0;
+    uint64_t len = 0;
+    uint64_t usec = 0;
+    double start = .0f;
+    double elapsed = .0f;
+
+    for (i = 0; i < repeat; i++) {
+        MPI_Barrier(leader_comm);
+        start = MPI_Wtime();
+
+        ret = metasim_invoke_alltoall(metasim, size, aggregate, window,
+                                      &msgs, &len, &usec);
+
+        MPI_Barrier(leader_comm);
+        elapsed += MPI_Wtime() - start;
+
+        __debug("[%d] RPC ALLTOALL (size=%llu) => (ret=%d, msgs=%llu, "
+                "len=%llu), %.6f seconds", rank, (unsigned long long) size,
+                ret, (unsigned long long) msgs, (unsigned long long) len,
+                usec*1e-6);
+
+        if (ret)
+            failed++;
+        total_msgs += msgs;
+    }
+
+    MPI_Reduce(&failed, &all_failed, 1, MPI_INT, MPI_SUM, 0, leader_comm);
+    MPI_Reduce(&total_msgs, &all_msgs, 1, MPI_UINT64_T, MPI_SUM, 0,
+               leader_comm);
+
+    if (leader_rank == 0) {
+        /* nservers,size,aggregate,window,repeat,failed,avg,msgs per run,
+         * transport */
+        printf("## alltoall,%d,%llu,%d,%d,%d,%d,%.6lf,%llu,%s,%s\n",
+               server_nranks, (unsigned long long) size, aggregate, window,
+               repeat, all_failed, elapsed / repeat,
+               (unsigned long long) (all_msgs / repeat),
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
+        fflush(stdout);
+    }
+}
+
+static struct option l_opts[] = {
+    { "aggregate", 0, 0, 'a' },
+    { "help", 0, 0, 'h' },
+    { "max-size", 1, 0, 'm' },
+    { "repeat", 1, 0, 'r' },
+    { "size", 1, 0, 's' },
+    { "verbose", 0, 0, 'v' },
+    { "window", 1, 0, 'w' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "ahm:r:s:vw:";
+
+static char *usage_str =
+"\n"
+"Usage: alltoall [options...]\n"
+"\n"
+"-a, --aggregate        route records through node leaders\n"
+"-h, --help             print this help message\n"
+"-m, --max-size=<SIZE>  repeat with sizes doubling up to <SIZE>\n"
+"-r, --repeat=<N>       repeat <N> times (default=1)\n"
+"-s, --size=<SIZE>      bytes sent to each server (default=1K)\n"
+"-v, --verbose          print debugging messages\n"
+"-w, --window=<N>       at most <N> transfers in flight from each server\n"
+"                       (default: 16)\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+    int aggregate = 0;
+    int window = 0;
+    uint64_t size = 1024;
+    uint64_t max_size = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'a':
+            aggregate = 1;
+            break;
+
+        case 'm':
+            max_size = parse_size(optarg);
+            break;
+
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 's':
+            size = parse_size(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'w':
+            window = atoi(optarg);
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (size == 0 || repeat <= 0)
+        print_usage(1);
+
+    if (max_size < size)
+        max_size = size;
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    ret = init_leaders();
+    if (ret)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (leader_comm != MPI_COMM_NULL) {
+        for ( ; size <= max_size; size *= 2)
+            do_alltoall(size, aggregate, window, repeat);
+
+        MPI_Comm_free(&leader_comm);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
@@ -0,0 +1,240 @@
+/* Copyright (C) 2020, 2021 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static int warmup;
+
+static metasim_t metasim;
+
+static uint64_t parse_size(const char *str)
+{
+    char *pos = NULL;
+    uint64_t size = strtoull(str, &pos, 0);
+
+    switch (toupper(*pos)) {
+    case 'G':
+        size <<= 10;
+        /* fall through */
+    case 'M':
+        size <<= 10;
+        /* fall through */
+    case 'K':
+        size <<= 10;
+        break;
+    default:
+        break;
+    }
+
+    return size;
+}
+
+static const char *tree_str[] = { "kary", "double" };
+
+static double do_bcast(uint64_t size, uint64_t segsize, int32_t degree,
+                       int32_t tree)
+{
+    int ret = 0;
+    uint64_t usec = 0;
+    double elapsed = .0f;
+
+    ret = metasim_invoke_bcast(metasim, size, segsize, degree, tree, &usec);
+
+    elapsed = usec*1e-6;
+
+    __debug("[%d] RPC BCAST (size=%llu, segsize=%llu, degree=%d, tree=%s) "
+            "=> (ret=%d), %.6f seconds",
+            rank, (unsigned long long) size, (unsigned long long) segsize,
+            degree, tree_str[tree], ret, elapsed);
+
+    return elapsed;
+}
+
+static int do_bcast_serial(uint64_t size, uint64_t segsize, int32_t degree,
+                           int32_t tree, int repeat)
+{
+    int i = 0;
+    double server_elapsed = .0f;
+    double elapsed = .0f;
+    double avg = .0f;
+
+    if (rank > 0)
+        goto wait;
+
+    /* warm up run (the 1st run takes significantly longer than the rest) */
+    if (warmup)
+        elapsed = do_bcast(size, segsize, degree, tree);
+
+    for (i = 0; i < repeat; i++) {
+        elapsed = do_bcast(size, segsize, degree, tree);
+        server_elapsed += elapsed;
+    }
+
+    avg = server_elapsed / repeat;
+
+    /* size,segsize,degree,nservers,avg,bandwidth(MB/s),tree,transport */
+    printf("## %llu,%llu,%d,%d,%.6lf,%.3lf,%s,%s,%s\n",
+           (unsigned long long) size, (unsigned long long) segsize, degree,
+           server_nranks, avg, avg > 0 ? (size / avg) / (1<<20) : .0f,
+           tree_str[tree], metasim_get_transport(metasim),
+           metasim_get_inject(metasim));
+
+wait:
+    MPI_Barrier(MPI_COMM_WORLD);
+    return 0;
+}
+
+static struct option l_opts[] = {
+    { "degree", 1, 0, 'd' },
+    { "double-tree", 0, 0, 'D' },
+    { "help", 0, 0, 'h' },
+    { "max-size", 1, 0, 'm' },
+    { "repeat", 1, 0, 'r' },
+    { "segment", 1, 0, 'S' },
+    { "size", 1, 0, 's' },
+    { "verbose", 0, 0, 'v' },
+    { "warmup", 0, 0, 'w' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "Dd:hm:r:S:s:vw";
+
+static char *usage_str =
+"\n"
+"Usage: bcast [options...]\n"
+"\n"
+"-d, --degree=<K>   broadcast over a <K>-ary tree (default=2)\n"
+"-D, --double-tree  also broadcast over the double binary tree, for\n"
+"                   comparison with the <K>-ary tree\n"
+"-h, --help         print this help message\n"
+"-m, --max-size=<N> repeat with doubling size until <N> bytes\n"
+"-r, --repeat=<N>   repeat <N> times for each size (default=1)\n"
+"-S, --segment=<N>  pipeline segment size (default: server default)\n"
+"-s, --size=<N>     bytes to broadcast (default=1K)\n"
+"-v, --verbose      print debugging messages\n"
+"-w, --warmup       perform an extra warmup operation before measuring\n"
+"\n"
+"sizes can be suffixed with K, M or G.\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+    int32_t degree = 2;
+    int double_tree = 0;
+    uint64_t size = 1<<10;
+    uint64_t max_size = 0;
+    uint64_t segsize = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'd':
+            degree = atoi(optarg);
+            break;
+
+        case 'D':
+            double_tree = 1;
+            break;
+
+        case 'm':
+            max_size = parse_size(optarg);
+            break;
+
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 'S':
+            segsize = parse_size(optarg);
+            break;
+
+        case 's':
+            size = parse_size(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'w':
+            warmup = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (max_size < size)
+        max_size = size;
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    for ( ; size <= max_size; size <<= 1) {
+        do_bcast_serial(size, segsize, degree, 0, repeat);
+        if (double_tree)
+            do_bcast_serial(size, segsize, 2, 1, repeat);
+    }
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
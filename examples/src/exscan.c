@@ -0,0 +1,214 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static metasim_t metasim;
+
+/* one client on each node (server) participates in the scan, ordered by the
+ * server rank */
+static MPI_Comm leader_comm = MPI_COMM_NULL;
+static int leader_rank;
+static int leader_nranks;
+
+static int init_leaders(void)
+{
+    int local_rank = 0;
+    MPI_Comm local_comm;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &local_comm);
+    MPI_Comm_rank(local_comm, &local_rank);
+    MPI_Comm_free(&local_comm);
+
+    MPI_Comm_split(MPI_COMM_WORLD, local_rank == 0 ? 0 : MPI_UNDEFINED,
+                   server_rank, &leader_comm);
+
+    if (leader_comm == MPI_COMM_NULL)
+        return 0;
+
+    MPI_Comm_rank(leader_comm, &leader_rank);
+    MPI_Comm_size(leader_comm, &leader_nranks);
+
+    if (leader_nranks != server_nranks || leader_rank != server_rank) {
+        __error("[%d] expected one client per server "
+                "(leader %d/%d, server %d/%d)", rank,
+                leader_rank, leader_nranks, server_rank, server_nranks);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void do_exscan(int repeat)
+{
+    int i = 0;
+    int ret = 0;
+    int failed = 0;
+    int all_failed = 0;
+    uint64_t value = 0;
+    uint64_t offset = 0;
+    uint64_t expected = 0;
+    uint64_t usec = 0;
+    double start = .0f;
+    double metasim_elapsed = .0f;
+    double mpi_elapsed = .0f;
+    double max_elapsed = .0f;
+
+    for (i = 0; i < repeat; i++) {
+        value = (uint64_t) (leader_rank + 1) * 4096 + i;
+
+        /* metasim */
+        MPI_Barrier(leader_comm);
+        start = MPI_Wtime();
+
+        ret = metasim_invoke_exscan(metasim, value, &offset, &usec);
+
+        MPI_Barrier(leader_comm);
+        metasim_elapsed += MPI_Wtime() - start;
+
+        /* mpi */
+        MPI_Barrier(leader_comm);
+        start = MPI_Wtime();
+
+        MPI_Exscan(&value, &expected, 1, MPI_UINT64_T, MPI_SUM, leader_comm);
+
+        MPI_Barrier(leader_comm);
+        mpi_elapsed += MPI_Wtime() - start;
+
+        if (leader_rank == 0)
+            expected = 0;   /* undefined at rank 0 */
+
+        if (ret || offset != expected) {
+            __error("[%d] RPC EXSCAN (value=%llu) => (ret=%d, offset=%llu), "
+                    "expected=%llu", rank, (unsigned long long) value, ret,
+                    (unsigned long long) offset,
+                    (unsigned long long) expected);
+            failed++;
+        }
+    }
+
+    MPI_Reduce(&failed, &all_failed, 1, MPI_INT, MPI_SUM, 0, leader_comm);
+    MPI_Reduce(&metasim_elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0,
+               leader_comm);
+
+    if (leader_rank == 0) {
+        /* nservers,repeat,failed,metasim avg,mpi avg,transport */
+        printf("## exscan,%d,%d,%d,%.6lf,%.6lf,%s,%s\n",
+               leader_nranks, repeat, all_failed,
+               max_elapsed / repeat, mpi_elapsed / repeat,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
+    }
+}
+
+static struct option l_opts[] = {
+    { "help", 0, 0, 'h' },
+    { "repeat", 1, 0, 'r' },
+    { "verbose", 0, 0, 'v' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "hr:v";
+
+static char *usage_str =
+"\n"
+"Usage: exscan [options...]\n"
+"\n"
+"-h, --help         print this help message\n"
+"-r, --repeat=<N>   repeat <N> times (default=1)\n"
+"-v, --verbose      print debugging messages\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    ret = init_leaders();
+    if (ret)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (leader_comm != MPI_COMM_NULL) {
+        do_exscan(repeat);
+        MPI_Comm_free(&leader_comm);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
@@ -0,0 +1,199 @@
+/* Copyright (C) 2020, 2021 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static int warmup;
+
+static metasim_t metasim;
+
+static double do_gather(int32_t size, int32_t all, uint64_t *mem_peak)
+{
+    int ret = 0;
+    int32_t count = 0;
+    uint64_t len = 0;
+    uint64_t usec = 0;
+    uint64_t expected = 0;
+    double elapsed = .0f;
+
+    ret = metasim_invoke_gather(metasim, size, all,
+                                &count, &len, mem_peak, &usec);
+
+    elapsed = usec*1e-6;
+    expected = server_nranks * (size + 2*sizeof(int32_t));
+
+    __debug("[%d] RPC %sGATHER (size=%d) => (ret=%d, count=%d, len=%llu), "
+            "expected len=%llu (%s), %.6f seconds",
+            rank, all ? "ALL" : "", size, ret, count,
+            (unsigned long long) len, (unsigned long long) expected,
+            count == server_nranks && len == expected ? "success" : "fail",
+            elapsed);
+
+    return elapsed;
+}
+
+static int do_gather_serial(int32_t size, int32_t all, int repeat)
+{
+    int i = 0;
+    uint64_t mem_peak = 0;
+    double server_elapsed = .0f;
+    double elapsed = .0f;
+    double start = .0f;
+    double stop = .0f;
+
+    if (rank > 0)
+        goto wait;
+
+    /* warm up run (the 1st run takes significantly longer than the rest) */
+    if (warmup)
+        elapsed = do_gather(size, all, &mem_peak);
+
+    start = MPI_Wtime();
+
+    for (i = 0; i < repeat; i++) {
+        elapsed = do_gather(size, all, &mem_peak);
+        printf("%.6lf\n", elapsed);
+
+        server_elapsed += elapsed;
+    }
+
+    stop = MPI_Wtime();
+
+    if (rank == 0) {
+        double total_runtime = stop - start;
+        double avg = total_runtime / repeat;
+
+        /* repeat,size,nservers,total,avg,server_avg,mem_peak,transport */
+        printf("## %d,%d,%d,%.6lf,%.6lf,%.6lf,%llu,%s,%s\n",
+               repeat, size, server_nranks, total_runtime, avg,
+               server_elapsed/repeat, (unsigned long long) mem_peak,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
+    }
+
+wait:
+    MPI_Barrier(MPI_COMM_WORLD);
+    return 0;
+}
+
+static struct option l_opts[] = {
+    { "all", 0, 0, 'a' },
+    { "help", 0, 0, 'h' },
+    { "repeat", 1, 0, 'r' },
+    { "size", 1, 0, 's' },
+    { "verbose", 0, 0, 'v' },
+    { "warmup", 0, 0, 'w' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "ahr:s:vw";
+
+static char *usage_str =
+"\n"
+"Usage: gather [options...]\n"
+"\n"
+"-a, --all          perform allgather instead of gather\n"
+"-h, --help         print this help message\n"
+"-r, --repeat=<N>   repeat <N> times (default=1)\n"
+"-s, --size=<N>     size of the record from each server (default=8)\n"
+"-v, --verbose      print debugging messages\n"
+"-w, --warmup       perform an extra warmup operation before measuring\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+    int32_t size = 8;
+    int32_t all = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'a':
+            all = 1;
+            break;
+
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 's':
+            size = atoi(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'w':
+            warmup = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    do_gather_serial(size, all, repeat);
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
@@ -8,15 +8,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <getopt.h>
 #include <mpi.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <metasim.h>
 
 #include "log.h"
 
 int log_error = 1;
-int log_debug = 1;
+int log_debug = 0;
 
 static int rank;
 static int nranks;
@@ -27,18 +30,82 @@ static int server_nranks;
 
 static metasim_t metasim;
 
+static double cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static struct option l_opts[] = {
+    { "direct", 0, 0, 'd' },
+    { "help", 0, 0, 'h' },
+    { "verbose", 0, 0, 'v' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "dhv";
+
+static char *usage_str =
+"\n"
+"Usage: ping [options...] [count]\n"
+"\n"
+"sends [count] pings (default: number of servers) to servers in turn.\n"
+"\n"
+"-d, --direct       send pings directly to the servers, instead of relaying\n"
+"                   them through the local listener (METASIM_DIRECT=1)\n"
+"-h, --help         print this help message\n"
+"-v, --verbose      print debugging messages\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
 int main(int argc, char **argv)
 {
     int ret = 0;
+    int ch = 0;
+    int ix = 0;
     int i = 0;
     int ping_count = 0;
+    int failed = 0;
+    int all_failed = 0;
+    double start = .0f;
+    double elapsed = .0f;
+    double sum_elapsed = .0f;
+    double max_elapsed = .0f;
+    double cpu = .0f;
+    double sum_cpu = .0f;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &nranks);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    if (argc == 2) {
-        ping_count = atoi(argv[1]);
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'd':
+            setenv("METASIM_DIRECT", "1", 1);
+            break;
+
+        case 'v':
+            log_debug = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (optind < argc) {
+        ping_count = atoi(argv[optind]);
         assert(ping_count > 0);
     }
 
@@ -64,18 +131,48 @@ int main(int argc, char **argv)
     if (ping_count == 0)
         ping_count = server_nranks;
 
+    start = MPI_Wtime();
+    cpu = cpu_time();
+
     for (i = 0; i < ping_count; i++) {
         int32_t ping = i;
         int32_t pong = 0;
         int32_t target = i % server_nranks;
 
         ret = metasim_invoke_ping(metasim, target, ping, &pong);
+        if (ret || pong != ping)
+            failed++;
 
         __debug("[%d] (%3d/%3d) RPC PING (target=%d,ping=%d) => "
                 "(ret=%d, pong=%d)",
                 rank, i, ping_count, i, ping, ret, pong);
     }
 
+    elapsed = MPI_Wtime() - start;
+    cpu = cpu_time() - cpu;
+
+    /* cpu utilization of this client while pinging */
+    cpu = elapsed > 0 ? 100.0 * cpu / elapsed : .0f;
+
+    MPI_Reduce(&failed, &all_failed, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&elapsed, &sum_elapsed, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0,
+               MPI_COMM_WORLD);
+    MPI_Reduce(&cpu, &sum_cpu, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        /* path,nclients,nservers,count,failed,avg latency (per client),
+         * max elapsed,transport,client progress,avg client cpu(%),injection */
+        printf("## ping,%s,%d,%d,%d,%d,%.9lf,%.6lf,%s,%s,%.1lf,%s\n",
+               metasim_is_direct(metasim) ? "direct" : "relayed",
+               nranks, server_nranks, ping_count, all_failed,
+               sum_elapsed / nranks / ping_count, max_elapsed,
+               metasim_get_transport(metasim),
+               metasim_get_progress(metasim), sum_cpu / nranks,
+               metasim_get_inject(metasim));
+    }
+
 out:
     metasim_exit(metasim);
 
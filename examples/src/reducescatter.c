@@ -0,0 +1,258 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static metasim_t metasim;
+
+/* one client on each node (server) participates in the reduce-scatter */
+static MPI_Comm leader_comm = MPI_COMM_NULL;
+static int leader_rank;
+
+static int init_leaders(void)
+{
+    int local_rank = 0;
+    int leader_nranks = 0;
+    MPI_Comm local_comm;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &local_comm);
+    MPI_Comm_rank(local_comm, &local_rank);
+    MPI_Comm_free(&local_comm);
+
+    MPI_Comm_split(MPI_COMM_WORLD, local_rank == 0 ? 0 : MPI_UNDEFINED,
+                   server_rank, &leader_comm);
+
+    if (leader_comm == MPI_COMM_NULL)
+        return 0;
+
+    MPI_Comm_rank(leader_comm, &leader_rank);
+    MPI_Comm_size(leader_comm, &leader_nranks);
+
+    if (leader_nranks != server_nranks) {
+        __error("[%d] expected one client per server (%d clients, "
+                "%d servers)", rank, leader_nranks, server_nranks);
+        return -1;
+    }
+
+    return 0;
+}
+
+static const char *algo_str[] = { "auto", "halving", "ring", "tree" };
+
+static void do_reduce_scatter(uint64_t count, int op, int algo, int repeat)
+{
+    int i = 0;
+    int ret = 0;
+    int failed = 0;
+    int all_failed = 0;
+    uint64_t bytes = 0;
+    uint64_t msgs = 0;
+    uint64_t total[2] = { 0, };
+    uint64_t all_total[2] = { 0, };
+    uint64_t usec = 0;
+    double start = .0f;
+    double elapsed = .0f;
+
+    for (i = 0; i < repeat; i++) {
+        MPI_Barrier(leader_comm);
+        start = MPI_Wtime();
+
+        ret = metasim_invoke_reduce_scatter(metasim, count, op, algo,
+                                            &bytes, &msgs, &usec);
+
+        MPI_Barrier(leader_comm);
+        elapsed += MPI_Wtime() - start;
+
+        __debug("[%d] RPC REDUCE_SCATTER (count=%llu, algo=%s) => (ret=%d, "
+                "bytes=%llu, msgs=%llu), %.6f seconds", rank,
+                (unsigned long long) count, algo_str[algo], ret,
+                (unsigned long long) bytes, (unsigned long long) msgs,
+                usec*1e-6);
+
+        if (ret)
+            failed++;
+        total[0] += bytes;
+        total[1] += msgs;
+    }
+
+    MPI_Reduce(&failed, &all_failed, 1, MPI_INT, MPI_SUM, 0, leader_comm);
+    MPI_Reduce(total, all_total, 2, MPI_UINT64_T, MPI_SUM, 0, leader_comm);
+
+    if (leader_rank == 0) {
+        /* nservers,count,algo,repeat,failed,avg,bytes per run,msgs per run,
+         * transport */
+        printf("## reduce_scatter,%d,%llu,%s,%d,%d,%.6lf,%llu,%llu,%s,%s\n",
+               server_nranks, (unsigned long long) count, algo_str[algo],
+               repeat, all_failed, elapsed / repeat,
+               (unsigned long long) (all_total[0] / repeat),
+               (unsigned long long) (all_total[1] / repeat),
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
+        fflush(stdout);
+    }
+}
+
+static struct option l_opts[] = {
+    { "algorithm", 1, 0, 'a' },
+    { "count", 1, 0, 'c' },
+    { "help", 0, 0, 'h' },
+    { "max-count", 1, 0, 'm' },
+    { "op", 1, 0, 'o' },
+    { "repeat", 1, 0, 'r' },
+    { "verbose", 0, 0, 'v' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "a:c:hm:o:r:v";
+
+static char *usage_str =
+"\n"
+"Usage: reducescatter [options...]\n"
+"\n"
+"-a, --algorithm=<A>  auto, halving, ring or tree (default=auto). unless\n"
+"                     tree is given, tree is also run for comparison\n"
+"-c, --count=<N>      elements (int64_t) in each block (default=1024)\n"
+"-h, --help           print this help message\n"
+"-m, --max-count=<N>  repeat with counts doubling up to <N>\n"
+"-o, --op=<OP>        sum, min or max (default=sum)\n"
+"-r, --repeat=<N>     repeat <N> times (default=1)\n"
+"-v, --verbose        print debugging messages\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+static int parse_index(const char *str, const char **list, int n)
+{
+    int i = 0;
+
+    for (i = 0; i < n; i++)
+        if (!strcmp(str, list[i]))
+            return i;
+
+    print_usage(1);
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+    int op = 0;
+    int algo = 0;
+    uint64_t count = 1024;
+    uint64_t max_count = 0;
+    const char *op_str[] = { "sum", "min", "max" };
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'a':
+            algo = parse_index(optarg, algo_str, 4);
+            break;
+
+        case 'c':
+            count = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'm':
+            max_count = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'o':
+            op = parse_index(optarg, op_str, 3);
+            break;
+
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (count == 0 || repeat <= 0)
+        print_usage(1);
+
+    if (max_count < count)
+        max_count = count;
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    ret = init_leaders();
+    if (ret)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (leader_comm != MPI_COMM_NULL) {
+        for ( ; count <= max_count; count *= 2) {
+            do_reduce_scatter(count, op, algo, repeat);
+            if (algo != 3)
+                do_reduce_scatter(count, op, 3, repeat);
+        }
+
+        MPI_Comm_free(&leader_comm);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
@@ -6,6 +6,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <getopt.h>
@@ -27,6 +28,12 @@ static int server_rank;
 static int server_nranks;
 
 static int warmup;
+static int failed;
+
+/* with a timeout, sums may leave out slow servers */
+static uint64_t timeout;
+static int partial;
+static int32_t min_contributors = INT32_MAX;
 
 static metasim_t metasim;
 
@@ -34,10 +41,26 @@ static double do_sum(int32_t seed, int32_t expected)
 {
     int ret = 0;
     int32_t sum = 0;
+    int32_t contributors = server_nranks;
     uint64_t usec = 0;
     double elapsed = .0f;
 
-    ret = metasim_invoke_sum(metasim, seed, &sum, &usec);
+    if (timeout)
+        ret = metasim_invoke_sum_timed(metasim, seed, timeout, &sum,
+                                       &contributors, &usec);
+    else
+        ret = metasim_invoke_sum(metasim, seed, &sum, &usec);
+
+    if (ret == 0 && contributors < server_nranks) {
+        partial++;
+        expected = sum;     /* cannot be checked */
+    }
+
+    if (ret == 0 && contributors < min_contributors)
+        min_contributors = contributors;
+
+    if (ret || sum != expected)
+        failed++;
 
     elapsed = usec*1e-6;
 
@@ -95,8 +118,9 @@ static int do_sum_serial(int repeat)
         double total_runtime = stop - start;
         double avg = total_runtime / repeat;
 
-        printf("## %d,%.6lf,%.6lf,%.6lf\n",
-               repeat, total_runtime, avg, server_elapsed/repeat);
+        printf("## %d,%.6lf,%.6lf,%.6lf,%s,%s\n",
+               repeat, total_runtime, avg, server_elapsed/repeat,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
     }
 
 wait:
@@ -161,13 +185,74 @@ static int do_sum_limited(int repeat, int limited)
         double total_runtime = stop - start;
         double avg = total_runtime / repeat;
 
-        printf("## %d,%.6lf,%.6lf (%d rounds)\n",
-                repeat, total_runtime, avg, rounds);
+        /* repeat,total,avg,rounds,transport,inject */
+        printf("## %d,%.6lf,%.6lf,%d,%s,%s\n",
+                repeat, total_runtime, avg, rounds,
+                metasim_get_transport(metasim), metasim_get_inject(metasim));
     }
 
     return 0;
 }
 
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static inline double percentile(double *sorted, int count, int p)
+{
+    int pos = (count * p) / 100;
+
+    return sorted[pos < count ? pos : count - 1];
+}
+
+/* prints the tail latency of the client-side (including any retries while
+ * the listener is busy) latencies and the completion rate. */
+static void print_tail(double *latency, int repeat)
+{
+    int total = repeat * nranks;
+    int all_failed = 0;
+    int all_partial = 0;
+    int32_t all_min = 0;
+    double *all_latency = NULL;
+
+    if (rank == 0) {
+        all_latency = calloc(total, sizeof(*all_latency));
+        assert(all_latency);
+    }
+
+    MPI_Gather(latency, repeat, MPI_DOUBLE,
+               all_latency, repeat, MPI_DOUBLE,
+               0, MPI_COMM_WORLD);
+    MPI_Reduce(&failed, &all_failed, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&partial, &all_partial, 1, MPI_INT, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    MPI_Reduce(&min_contributors, &all_min, 1, MPI_INT32_T, MPI_MIN, 0,
+               MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        qsort(all_latency, total, sizeof(*all_latency), compare_double);
+
+        printf("## tail,%d,%d,%.6lf,%.6lf,%.6lf,%.6lf,%s,%s\n",
+               total - all_failed, total,
+               percentile(all_latency, total, 50),
+               percentile(all_latency, total, 90),
+               percentile(all_latency, total, 99),
+               all_latency[total - 1], metasim_get_transport(metasim),
+               metasim_get_inject(metasim));
+
+        if (timeout)
+            printf("## partial,%llu,%d,%d,%d,%d,%s\n",
+                   (unsigned long long) timeout, all_partial, total,
+                   all_min == INT32_MAX ? 0 : all_min, server_nranks,
+                   metasim_get_inject(metasim));
+
+        free(all_latency);
+    }
+}
 
 static int do_sum_parallel(int repeat)
 {
@@ -175,26 +260,36 @@ static int do_sum_parallel(int repeat)
     int32_t expected = 0;
     double elapsed = .0f;
     double *all_elapsed = NULL;
+    double *latency = NULL;
     double start = .0f;
     double stop = .0f;
+    double ts = .0f;
 
     if (rank == 0) {
         all_elapsed = calloc(nranks, sizeof(*all_elapsed));
         assert(all_elapsed);
     }
 
+    latency = calloc(repeat, sizeof(*latency));
+    assert(latency);
+
     expected = calculate_expected_sum(rank);
 
     /* warm up run (the 1st run takes significantly longer than the rest) */
     if (warmup)
         elapsed = do_sum(rank, expected);
 
+    failed = 0;
+    partial = 0;
+    min_contributors = INT32_MAX;
     start = MPI_Wtime();
 
     for (i = 0; i < repeat; i++) {
         MPI_Barrier(MPI_COMM_WORLD);
 
+        ts = MPI_Wtime();
         elapsed = do_sum(rank, expected);
+        latency[i] = MPI_Wtime() - ts;
 
         MPI_Barrier(MPI_COMM_WORLD);
 
@@ -216,9 +311,16 @@ static int do_sum_parallel(int repeat)
         double total_runtime = stop - start;
         double avg = total_runtime / repeat;
 
-        printf("## %d,%.6lf,%.6lf\n", repeat, total_runtime, avg);
+        printf("## %d,%.6lf,%.6lf,%s,%s\n", repeat, total_runtime, avg,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
     }
 
+    print_tail(latency, repeat);
+
+    free(latency);
+    if (all_elapsed)
+        free(all_elapsed);
+
     return 0;
 }
 
@@ -227,12 +329,13 @@ static struct option l_opts[] = {
     { "limited", 1, 0, 'l' },
     { "repeat", 1, 0, 'r' },
     { "serial", 0, 0, 's' },
+    { "timeout", 1, 0, 't' },
     { "verbose", 0, 0, 'v' },
     { "warmup", 0, 0, 'w' },
     { 0, 0, 0, 0 },
 };
 
-static char *s_opts = "hl:r:svw";
+static char *s_opts = "hl:r:st:vw";
 
 static char *usage_str =
 "\n"
@@ -240,9 +343,13 @@ static char *usage_str =
 "\n"
 "-h, --help         print this help message\n"
 "-l, --limited=<N>  at most <N> sum operations are executed in parallel\n"
+"                   (0: all ranks at once, reporting the tail latency)\n"
 "-r, --repeat=<N>   repeat <N> times (default=1)\n"
 "-s, --serial       execute sum only from rank 0\n"
 "                   (default: running in parallel from all ranks)\n"
+"-t, --timeout=<usec>\n"
+"                   let servers respond within <usec> with partial sums,\n"
+"                   reported with the tail latency\n"
 "-v, --verbose      print debugging messages\n"
 "-w, --warmup       perform an extra warmup operation before measuring\n"
 "\n";
@@ -280,6 +387,10 @@ int main(int argc, char **argv)
             serial = 1;
             break;
 
+        case 't':
+            timeout = strtoull(optarg, NULL, 0);
+            break;
+
         case 'v':
             log_error = 1;
             log_debug = 1;
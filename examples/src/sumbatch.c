@@ -0,0 +1,217 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mpi.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <metasim.h>
+
+#include "log.h"
+
+int log_error;
+int log_debug;
+
+static int rank;
+static int nranks;
+static pid_t pid;
+
+static int server_rank;
+static int server_nranks;
+
+static metasim_t metasim;
+
+static int32_t calculate_expected_sum(int32_t seed)
+{
+    int32_t expected;
+
+    expected = (server_nranks * (server_nranks - 1)) / 2;
+    expected += server_nranks * seed;
+
+    return expected;
+}
+
+static double do_sum_batch(int32_t count, int32_t *seeds, int32_t *sums,
+                           int *failed)
+{
+    int ret = 0;
+    int32_t i = 0;
+    uint64_t usec = 0;
+
+    ret = metasim_invoke_sum_batch(metasim, count, seeds, sums, &usec);
+    if (ret) {
+        __error("[%d] RPC SUMBATCH (count=%d) failed (ret=%d)",
+                rank, count, ret);
+        *failed += count;
+        return usec*1e-6;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (sums[i] != calculate_expected_sum(seeds[i]))
+            *failed += 1;
+    }
+
+    __debug("[%d] RPC SUMBATCH (count=%d) => (sum[0]=%d, expected=%d), "
+            "%.6f seconds",
+            rank, count, sums[0], calculate_expected_sum(seeds[0]),
+            usec*1e-6);
+
+    return usec*1e-6;
+}
+
+/* runs @repeat batches of @count sums from rank 0, and prints the amortized
+ * latency per sum operation. */
+static int do_sum_serial(int32_t count, int repeat)
+{
+    int i = 0;
+    int failed = 0;
+    int32_t *seeds = NULL;
+    int32_t *sums = NULL;
+    double server_elapsed = .0f;
+    double start = .0f;
+    double stop = .0f;
+
+    if (rank > 0)
+        goto wait;
+
+    seeds = calloc(count, sizeof(*seeds));
+    sums = calloc(count, sizeof(*sums));
+    assert(seeds && sums);
+
+    for (i = 0; i < count; i++)
+        seeds[i] = i;
+
+    start = MPI_Wtime();
+
+    for (i = 0; i < repeat; i++)
+        server_elapsed += do_sum_batch(count, seeds, sums, &failed);
+
+    stop = MPI_Wtime();
+
+    if (rank == 0) {
+        double total_runtime = stop - start;
+        double avg = total_runtime / repeat;
+
+        /* batch,nservers,repeat,failed,batch latency,per-op latency,
+         * server per-op latency,transport */
+        printf("## %d,%d,%d,%d,%.6lf,%.9lf,%.9lf,%s,%s\n",
+               count, server_nranks, repeat, failed,
+               avg, avg / count, server_elapsed / repeat / count,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
+    }
+
+    free(seeds);
+    free(sums);
+
+wait:
+    MPI_Barrier(MPI_COMM_WORLD);
+    return 0;
+}
+
+static struct option l_opts[] = {
+    { "batch", 1, 0, 'b' },
+    { "help", 0, 0, 'h' },
+    { "max-batch", 1, 0, 'm' },
+    { "repeat", 1, 0, 'r' },
+    { "verbose", 0, 0, 'v' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "b:hm:r:v";
+
+static char *usage_str =
+"\n"
+"Usage: sumbatch [options...]\n"
+"\n"
+"-b, --batch=<N>      number of sums in a batch (default=1)\n"
+"-h, --help           print this help message\n"
+"-m, --max-batch=<N>  repeat with batch sizes doubling up to <N>\n"
+"-r, --repeat=<N>     repeat <N> times (default=1)\n"
+"-v, --verbose        print debugging messages\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int repeat = 1;
+    int32_t batch = 1;
+    int32_t max_batch = 0;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'b':
+            batch = atoi(optarg);
+            break;
+
+        case 'm':
+            max_batch = atoi(optarg);
+            break;
+
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+
+        case 'v':
+            log_error = 1;
+            log_debug = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (batch <= 0 || repeat <= 0)
+        print_usage(1);
+
+    if (max_batch < batch)
+        max_batch = batch;
+
+    pid = getpid();
+
+    metasim = metasim_init();
+    assert(metasim);
+
+    ret = metasim_invoke_init(metasim, rank, (int32_t) pid,
+                              &server_rank, &server_nranks);
+    if (ret) {
+        __error("[%d] rpc failed, terminating..", rank);
+        fflush(stdout);
+        goto out;
+    } else {
+        __debug("[%d] RPC INIT (rank=%d,pid=%d) => "
+                "(server_rank=%d, server_nranks=%d)",
+                rank, rank, pid, server_rank, server_nranks);
+    }
+
+    for ( ; batch <= max_batch; batch *= 2)
+        do_sum_serial(batch, repeat);
+
+out:
+    metasim_exit(metasim);
+
+    MPI_Finalize();
+
+    return ret;
+}
@@ -82,8 +82,9 @@ static int do_sum_serial(int repeat)
         double total_runtime = stop - start;
         double avg = total_runtime / repeat;
 
-        printf("## %d,%.6lf,%.6lf,%.6lf\n",
-               repeat, total_runtime, avg, server_elapsed/repeat);
+        printf("## %d,%.6lf,%.6lf,%.6lf,%s,%s\n",
+               repeat, total_runtime, avg, server_elapsed/repeat,
+               metasim_get_transport(metasim), metasim_get_inject(metasim));
     }
 
 wait:
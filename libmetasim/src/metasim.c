@@ -13,14 +13,27 @@
 #include <errno.h>
 #include <limits.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "metasim-common.h"
+#include "metasim-progress.h"
 #include "metasim.h"
 
 struct metasim_ctx {
     margo_instance_id mid;
     hg_addr_t listener_addr;
     metasim_rpcset_t rpc;
+    char *transport;        /* server transport, from metasim_invoke_init */
+    char *inject;           /* injected delays on servers, likewise */
+    metasim_progress_conf_t progress;   /* from METASIM_PROGRESS */
+
+    /* direct path to remote servers, enabled by METASIM_DIRECT=1. the server
+     * addresses are looked up on the first use. */
+    margo_instance_id direct_mid;
+    hg_id_t direct_ping;
+    int32_t nservers;
+    char **server_addr_str;
+    hg_addr_t *server_addrs;
 };
 
 typedef struct metasim_ctx metasim_ctx_t;
@@ -37,6 +50,276 @@ typedef struct metasim_ctx metasim_ctx_t;
 
 #define metasim_ctx(m)  ((metasim_ctx_t *) (m))
 
+/* bounded exponential backoff when the listener is busy */
+#define METASIM_BACKOFF_INIT_USEC   100
+#define METASIM_BACKOFF_MAX_USEC    (100*1000)
+#define METASIM_BACKOFF_MAX_RETRY   16
+
+/* forwards @in on @handle and waits for the response. in hybrid progress
+ * mode, this polls for the response for the spin budget before blocking. */
+static hg_return_t client_forward(metasim_ctx_t *self, hg_handle_t handle,
+                                  void *in)
+{
+    int done = 0;
+    uint64_t usec = 0;
+    hg_return_t hret;
+    margo_request req;
+    struct timespec start, now;
+
+    if (self->progress.mode != METASIM_PROGRESS_HYBRID)
+        return margo_forward(handle, in);
+
+    hret = margo_iforward(handle, in, &req);
+    if (hret != HG_SUCCESS)
+        return hret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (usec < self->progress.spin_usec) {
+        margo_test(req, &done);
+        if (done)
+            break;
+
+        /* let the progress ult poll the network */
+        ABT_thread_yield();
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        usec = (now.tv_sec - start.tv_sec) * 1000000 +
+               (now.tv_nsec - start.tv_nsec) / 1000;
+    }
+
+    return margo_wait(req);
+}
+
+/* forwards the rpc to the local listener, and retries while the listener
+ * responds with EBUSY. all listener outputs begin with the ret field. on
+ * success, the caller should free the output and destroy @handle. */
+static hg_return_t forward_listener(metasim_ctx_t *self, hg_id_t rpc_id,
+                                    void *in, void *out, hg_handle_t *handle)
+{
+    int ret = 0;
+    int retry = 0;
+    useconds_t usec = METASIM_BACKOFF_INIT_USEC;
+    hg_return_t hret;
+
+    while (1) {
+        hret = margo_create(self->mid, self->listener_addr, rpc_id, handle);
+        if (hret != HG_SUCCESS)
+            return hret;
+
+        hret = client_forward(self, *handle, in);
+        if (hret == HG_SUCCESS)
+            hret = margo_get_output(*handle, out);
+
+        if (hret != HG_SUCCESS) {
+            margo_destroy(*handle);
+            return hret;
+        }
+
+        ret = *((int32_t *) out);
+        if (ret != EBUSY || retry == METASIM_BACKOFF_MAX_RETRY)
+            break;
+
+        margo_free_output(*handle, out);
+        margo_destroy(*handle);
+
+        /* full jitter, so that clients don't retry in lockstep */
+        usleep(usec/2 + random() % (usec/2 + 1));
+
+        usec <<= 1;
+        if (usec > METASIM_BACKOFF_MAX_USEC)
+            usec = METASIM_BACKOFF_MAX_USEC;
+        retry++;
+    }
+
+    if (retry > 0)
+        __debug("listener was busy, retried %d times (ret=%d)\n",
+                retry, ret);
+
+    return HG_SUCCESS;
+}
+
+/*
+ * sending rpc directly to remote servers
+ */
+
+static hg_addr_t direct_get_addr(metasim_ctx_t *self, int32_t target)
+{
+    hg_return_t hret;
+
+    if (self->server_addrs[target] == HG_ADDR_NULL) {
+        hret = margo_addr_lookup(self->direct_mid,
+                                 self->server_addr_str[target],
+                                 &self->server_addrs[target]);
+        if (hret != HG_SUCCESS) {
+            __error("failed to look up server %d (%s)\n",
+                    target, self->server_addr_str[target]);
+            self->server_addrs[target] = HG_ADDR_NULL;
+        }
+    }
+
+    return self->server_addrs[target];
+}
+
+static int direct_ping(metasim_ctx_t *self, int32_t target, int32_t ping,
+                       int32_t *pong)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    hg_addr_t addr;
+    metasim_rpc_ping_in_t in;
+    metasim_rpc_ping_out_t out;
+
+    if (target < 0 || target >= self->nservers)
+        return EINVAL;
+
+    addr = direct_get_addr(self, target);
+    if (addr == HG_ADDR_NULL)
+        return ENOTCONN;
+
+    in.ping = ping;
+
+    hret = margo_create(self->direct_mid, addr, self->direct_ping, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    hret = client_forward(self, handle, &in);
+    if (hret == HG_SUCCESS)
+        hret = margo_get_output(handle, &out);
+
+    if (hret != HG_SUCCESS) {
+        ret = EIO;
+        goto out;
+    }
+
+    *pong = out.pong;
+
+    margo_free_output(handle, &out);
+out:
+    margo_destroy(handle);
+
+    return ret;
+}
+
+/* adds the newline-separated addresses in @addrs from rank @offset */
+static int direct_add_peers(metasim_ctx_t *self, int32_t offset,
+                            int32_t count, const char *addrs)
+{
+    int32_t i = 0;
+    char *buf = strdup(addrs);
+    char *pos = NULL;
+    char *str = NULL;
+
+    if (!buf)
+        return ENOMEM;
+
+    for (str = strtok_r(buf, "\n", &pos); str && i < count;
+         str = strtok_r(NULL, "\n", &pos), i++) {
+        self->server_addr_str[offset + i] = strdup(str);
+        if (!self->server_addr_str[offset + i])
+            break;
+    }
+
+    free(buf);
+
+    return i == count ? 0 : EIO;
+}
+
+static char *read_addr_proto(char *listener_addr);
+
+/* fetches the server peer table from the local listener, and opens a margo
+ * instance on the server transport to reach remote servers directly */
+static int init_direct(metasim_ctx_t *self)
+{
+    int ret = 0;
+    int32_t offset = 0;
+    char *proto = NULL;
+    hg_return_t hret;
+    hg_handle_t handle;
+    metasim_peers_in_t in;
+    metasim_peers_out_t out;
+
+    do {
+        in.offset = offset;
+
+        hret = forward_listener(self, self->rpc.peers, &in, &out, &handle);
+        if (hret != HG_SUCCESS)
+            return EIO;
+
+        ret = out.ret;
+        if (ret == 0 && !self->server_addr_str) {
+            self->nservers = out.nranks;
+            self->server_addr_str = calloc(out.nranks, sizeof(char *));
+            self->server_addrs = calloc(out.nranks, sizeof(hg_addr_t));
+            if (!self->server_addr_str || !self->server_addrs)
+                ret = ENOMEM;
+        }
+
+        if (ret == 0 && (out.count <= 0 || offset + out.count > out.nranks))
+            ret = EIO;
+
+        if (ret == 0)
+            ret = direct_add_peers(self, offset, out.count, out.addrs);
+
+        offset += out.count;
+
+        margo_free_output(handle, &out);
+        margo_destroy(handle);
+    } while (ret == 0 && offset < self->nservers);
+
+    if (ret)
+        return ret;
+
+    /* the protocol part of the server address, e.g., ofi+tcp */
+    proto = read_addr_proto(self->server_addr_str[0]);
+    if (!proto)
+        return ENOMEM;
+
+    __debug("direct path to %d servers (proto = %s)\n",
+            self->nservers, proto);
+
+    self->direct_mid = margo_init(proto, MARGO_CLIENT_MODE, 0, 0);
+    free(proto);
+
+    if (self->direct_mid == MARGO_INSTANCE_NULL)
+        return ENOTCONN;
+
+    if (self->progress.mode == METASIM_PROGRESS_SPIN)
+        metasim_progress_set_timeout(self->direct_mid, 0);
+
+    self->direct_ping =
+        MARGO_REGISTER(self->direct_mid, METASIM_RPC_PING,
+                       metasim_rpc_ping_in_t,
+                       metasim_rpc_ping_out_t,
+                       NULL);
+
+    return 0;
+}
+
+static void exit_direct(metasim_ctx_t *self)
+{
+    int32_t i = 0;
+
+    for (i = 0; i < self->nservers; i++) {
+        if (self->server_addrs && self->server_addrs[i] != HG_ADDR_NULL)
+            margo_addr_free(self->direct_mid, self->server_addrs[i]);
+        if (self->server_addr_str)
+            free(self->server_addr_str[i]);
+    }
+
+    if (self->direct_mid != MARGO_INSTANCE_NULL)
+        margo_finalize(self->direct_mid);
+
+    free(self->server_addrs);
+    free(self->server_addr_str);
+
+    self->direct_mid = MARGO_INSTANCE_NULL;
+    self->server_addrs = NULL;
+    self->server_addr_str = NULL;
+    self->nservers = 0;
+}
+
 /*
  * sending rpc to local listener
  */
@@ -67,6 +350,12 @@ int metasim_invoke_init(metasim_t metasim,
     *localrank = out.rank;
     *nservers = out.nranks;
 
+    if (!self->transport && out.transport)
+        self->transport = strdup(out.transport);
+
+    if (!self->inject && out.inject)
+        self->inject = strdup(out.inject);
+
     margo_free_output(handle, &out);
     margo_destroy(handle);
 
@@ -135,6 +424,7 @@ int metasim_invoke_ping(metasim_t metasim,
 {
     int ret = 0;
     metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
     hg_handle_t handle;
     hg_id_t rpc_id;
     metasim_ping_in_t in;
@@ -143,14 +433,18 @@ int metasim_invoke_ping(metasim_t metasim,
     if (!self)
         return EINVAL;
 
+    if (self->direct_mid != MARGO_INSTANCE_NULL)
+        return direct_ping(self, target, ping, pong);
+
     rpc_id = self->rpc.ping;
     in.target = target;
     in.ping = ping;
 
-    margo_create(self->mid, self->listener_addr, rpc_id, &handle);
-    margo_forward(handle, &in);
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
 
-    margo_get_output(handle, &out);
+    ret = out.ret;
     *pong = out.pong;
 
     margo_free_output(handle, &out);
@@ -159,11 +453,13 @@ int metasim_invoke_ping(metasim_t metasim,
     return ret;
 }
 
-int metasim_invoke_sum(metasim_t metasim, int32_t seed, int32_t *sum,
-                       uint64_t *elapsed_usec)
+int metasim_invoke_sum_timed(metasim_t metasim, int32_t seed,
+                             uint64_t timeout_usec, int32_t *sum,
+                             int32_t *contributors, uint64_t *elapsed_usec)
 {
     int ret = 0;
     metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
     hg_handle_t handle;
     hg_id_t rpc_id;
     metasim_sum_in_t in;
@@ -174,13 +470,15 @@ int metasim_invoke_sum(metasim_t metasim, int32_t seed, int32_t *sum,
 
     rpc_id = self->rpc.sum;
     in.seed = seed;
+    in.timeout_usec = timeout_usec;
 
-    margo_create(self->mid, self->listener_addr, rpc_id, &handle);
-    margo_forward(handle, &in);
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
 
-    margo_get_output(handle, &out);
     ret = out.ret;
     *sum = out.sum;
+    *contributors = out.contributors;
     *elapsed_usec = out.elapsed_usec;
 
     margo_free_output(handle, &out);
@@ -189,11 +487,21 @@ int metasim_invoke_sum(metasim_t metasim, int32_t seed, int32_t *sum,
     return ret;
 }
 
+int metasim_invoke_sum(metasim_t metasim, int32_t seed, int32_t *sum,
+                       uint64_t *elapsed_usec)
+{
+    int32_t contributors = 0;
+
+    return metasim_invoke_sum_timed(metasim, seed, 0, sum, &contributors,
+                                    elapsed_usec);
+}
+
 int metasim_invoke_sumrepeat(metasim_t metasim, int32_t seed, int32_t repeat,
                              int32_t *sum, uint64_t *elapsed_usec)
 {
     int ret = 0;
     metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
     hg_handle_t handle;
     hg_id_t rpc_id;
     metasim_sumrepeat_in_t in;
@@ -206,10 +514,10 @@ int metasim_invoke_sumrepeat(metasim_t metasim, int32_t seed, int32_t repeat,
     in.seed = seed;
     in.repeat = repeat;
 
-    margo_create(self->mid, self->listener_addr, rpc_id, &handle);
-    margo_forward(handle, &in);
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
 
-    margo_get_output(handle, &out);
     ret = out.ret;
     *sum = out.sum;
     *elapsed_usec = out.elapsed_usec;
@@ -220,6 +528,214 @@ int metasim_invoke_sumrepeat(metasim_t metasim, int32_t seed, int32_t repeat,
     return ret;
 }
 
+int metasim_invoke_sum_batch(metasim_t metasim, int32_t count,
+                             int32_t *seeds, int32_t *sums,
+                             uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_sum_batch_in_t in;
+    metasim_sum_batch_out_t out;
+
+    if (!self || count <= 0 || count > METASIM_SUM_BATCH_MAX)
+        return EINVAL;
+
+    rpc_id = self->rpc.sum_batch;
+    in.seeds.count = count;
+    in.seeds.v = seeds;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    if (ret == 0 && out.sums.count != count)
+        ret = EIO;
+
+    if (ret == 0)
+        memcpy(sums, out.sums.v, count * sizeof(*sums));
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
+int metasim_invoke_exscan(metasim_t metasim, uint64_t value,
+                          uint64_t *offset, uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_exscan_in_t in;
+    metasim_exscan_out_t out;
+
+    if (!self)
+        return EINVAL;
+
+    rpc_id = self->rpc.exscan;
+    in.value = value;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    *offset = out.offset;
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
+int metasim_invoke_alltoall(metasim_t metasim, uint64_t size,
+                            int32_t aggregate, int32_t window,
+                            uint64_t *msgs, uint64_t *len,
+                            uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_alltoall_in_t in;
+    metasim_alltoall_out_t out;
+
+    if (!self)
+        return EINVAL;
+
+    rpc_id = self->rpc.alltoall;
+    in.size = size;
+    in.aggregate = aggregate;
+    in.window = window;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    *msgs = out.msgs;
+    *len = out.len;
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
+int metasim_invoke_reduce_scatter(metasim_t metasim, uint64_t count,
+                                  int32_t op, int32_t algo,
+                                  uint64_t *bytes, uint64_t *msgs,
+                                  uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_reduce_scatter_in_t in;
+    metasim_reduce_scatter_out_t out;
+
+    if (!self)
+        return EINVAL;
+
+    rpc_id = self->rpc.reduce_scatter;
+    in.count = count;
+    in.op = op;
+    in.algo = algo;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    *bytes = out.bytes;
+    *msgs = out.msgs;
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
+int metasim_invoke_gather(metasim_t metasim, int32_t size, int32_t all,
+                          int32_t *count, uint64_t *len, uint64_t *mem_peak,
+                          uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_gather_in_t in;
+    metasim_gather_out_t out;
+
+    if (!self)
+        return EINVAL;
+
+    rpc_id = self->rpc.gather;
+    in.size = size;
+    in.all = all;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    *count = out.count;
+    *len = out.len;
+    *mem_peak = out.mem_peak;
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
+int metasim_invoke_bcast(metasim_t metasim, uint64_t size, uint64_t segsize,
+                         int32_t degree, int32_t tree, uint64_t *elapsed_usec)
+{
+    int ret = 0;
+    metasim_ctx_t *self = metasim_ctx(metasim);
+    hg_return_t hret;
+    hg_handle_t handle;
+    hg_id_t rpc_id;
+    metasim_bcast_in_t in;
+    metasim_bcast_out_t out;
+
+    if (!self)
+        return EINVAL;
+
+    rpc_id = self->rpc.bcast;
+    in.size = size;
+    in.segsize = segsize;
+    in.degree = degree;
+    in.tree = tree;
+
+    hret = forward_listener(self, rpc_id, &in, &out, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    ret = out.ret;
+    *elapsed_usec = out.elapsed_usec;
+
+    margo_free_output(handle, &out);
+    margo_destroy(handle);
+
+    return ret;
+}
+
 static char *get_local_listener_addr(void)
 {
     int ret = 0;
@@ -294,6 +810,11 @@ static void register_rpc(metasim_ctx_t *self)
                        metasim_terminate_in_t,
                        metasim_terminate_out_t,
                        NULL);
+    rpc->peers =
+        MARGO_REGISTER(mid, "listener_peers",
+                       metasim_peers_in_t,
+                       metasim_peers_out_t,
+                       NULL);
     rpc->echo =
         MARGO_REGISTER(mid, "listener_echo",
                        metasim_echo_in_t,
@@ -314,6 +835,36 @@ static void register_rpc(metasim_ctx_t *self)
                        metasim_sumrepeat_in_t,
                        metasim_sumrepeat_out_t,
                        NULL);
+    rpc->sum_batch =
+        MARGO_REGISTER(mid, "listener_sum_batch",
+                       metasim_sum_batch_in_t,
+                       metasim_sum_batch_out_t,
+                       NULL);
+    rpc->exscan =
+        MARGO_REGISTER(mid, "listener_exscan",
+                       metasim_exscan_in_t,
+                       metasim_exscan_out_t,
+                       NULL);
+    rpc->alltoall =
+        MARGO_REGISTER(mid, "listener_alltoall",
+                       metasim_alltoall_in_t,
+                       metasim_alltoall_out_t,
+                       NULL);
+    rpc->reduce_scatter =
+        MARGO_REGISTER(mid, "listener_reduce_scatter",
+                       metasim_reduce_scatter_in_t,
+                       metasim_reduce_scatter_out_t,
+                       NULL);
+    rpc->gather =
+        MARGO_REGISTER(mid, "listener_gather",
+                       metasim_gather_in_t,
+                       metasim_gather_out_t,
+                       NULL);
+    rpc->bcast =
+        MARGO_REGISTER(mid, "listener_bcast",
+                       metasim_bcast_in_t,
+                       metasim_bcast_out_t,
+                       NULL);
 }
 
 static int init_rpc(metasim_ctx_t *self)
@@ -355,6 +906,9 @@ static int init_rpc(metasim_ctx_t *self)
     self->mid = mid;
     self->listener_addr = addr;
 
+    if (self->progress.mode == METASIM_PROGRESS_SPIN)
+        metasim_progress_set_timeout(mid, 0);
+
     register_rpc(self);
 
 out_free:
@@ -371,8 +925,14 @@ metasim_t metasim_init(void)
     int ret = 0;
     metasim_ctx_t *self = NULL;
 
+    const char *direct = getenv("METASIM_DIRECT");
+    const char *progress = getenv("METASIM_PROGRESS");
+
     self = calloc(1, sizeof(*self));
     if (self) {
+        if (metasim_progress_parse(progress, &self->progress))
+            __error("invalid METASIM_PROGRESS (%s), using block\n", progress);
+
         ret = init_rpc(self);
         if (ret) {
             free(self);
@@ -380,6 +940,15 @@ metasim_t metasim_init(void)
         }
     }
 
+    if (self && direct && atoi(direct)) {
+        ret = init_direct(self);
+        if (ret) {
+            __error("failed to set up the direct path to servers (ret=%d), "
+                    "relaying through the listener\n", ret);
+            exit_direct(self);
+        }
+    }
+
     return (metasim_t) self;
 }
 
@@ -388,13 +957,53 @@ void metasim_exit(metasim_t metasim)
     metasim_ctx_t *self = metasim_ctx(metasim);
 
     if (self) {
+        exit_direct(self);
+
         if (self->mid != MARGO_INSTANCE_NULL) {
             margo_addr_free(self->mid, self->listener_addr);
             margo_finalize(self->mid);
         }
 
+        if (self->transport)
+            free(self->transport);
+        if (self->inject)
+            free(self->inject);
+
         free(self);
         self = NULL;
     }
 }
 
+const char *metasim_get_transport(metasim_t metasim)
+{
+    metasim_ctx_t *self = metasim_ctx(metasim);
+
+    if (!self || !self->transport)
+        return "unknown";
+
+    return self->transport;
+}
+
+const char *metasim_get_inject(metasim_t metasim)
+{
+    metasim_ctx_t *self = metasim_ctx(metasim);
+
+    if (!self || !self->inject)
+        return "unknown";
+
+    return self->inject;
+}
+
+int metasim_is_direct(metasim_t metasim)
+{
+    metasim_ctx_t *self = metasim_ctx(metasim);
+
+    return self && self->direct_mid != MARGO_INSTANCE_NULL;
+}
+
+const char *metasim_get_progress(metasim_t metasim)
+{
+    metasim_ctx_t *self = metasim_ctx(metasim);
+
+    return metasim_progress_name(self ? self->progress.mode : 0);
+}
@@ -5,10 +5,31 @@
 
 typedef void * metasim_t;
 
+/* connects to the local server listener. if METASIM_DIRECT=1 is set in the
+ * environment, it also fetches the server addresses from the listener, and
+ * sends point-to-point rpcs (ping) directly to remote servers, instead of
+ * relaying them through the listener. */
 metasim_t metasim_init(void);
 
 void metasim_exit(metasim_t metasim);
 
+/* the mercury transport used between servers, e.g., "ofi+tcp://". it is
+ * known after metasim_invoke_init(), and "unknown" before. */
+const char *metasim_get_transport(metasim_t metasim);
+
+/* the delays and drops injected on the servers (see metasimd --inject-delay),
+ * e.g., "fixed:500@3/drop:0.01" or "none", known after metasim_invoke_init().
+ * it has no commas, to be printed in a csv field. */
+const char *metasim_get_inject(metasim_t metasim);
+
+/* true if point-to-point rpcs are sent directly to remote servers */
+int metasim_is_direct(metasim_t metasim);
+
+/* progress mode of the client, set by METASIM_PROGRESS in the environment:
+ * "block" (default), "spin" (busy-polling while waiting for responses), or
+ * "hybrid[:<usec>]" (polls for <usec>, default 1000, then blocks) */
+const char *metasim_get_progress(metasim_t metasim);
+
 int metasim_invoke_init(metasim_t metasim,
                         int32_t rank, int32_t pid,
                         int32_t *localrank, int32_t *nservers);
@@ -17,14 +38,75 @@ int metasim_invoke_terminate(metasim_t metasim, int32_t rank, int32_t pid);
 
 int metasim_invoke_echo(metasim_t metasim, int32_t num, int32_t *echo);
 
+/* pings server @target, which should be in [0, nservers). returns EINVAL for
+ * targets out of the range. */
 int metasim_invoke_ping(metasim_t metasim,
                         int32_t target, int32_t ping, int32_t *pong);
 
 int metasim_invoke_sum(metasim_t metasim, int32_t seed, int32_t *sum,
                        uint64_t *elapsed_usec);
 
-/* @elapsed_usec returns the total elapsed time */
+/* same as metasim_invoke_sum, but the servers respond within @timeout_usec
+ * with a partial sum if some of them are slow or unresponsive. @contributors
+ * returns the number of servers in @sum. */
+int metasim_invoke_sum_timed(metasim_t metasim, int32_t seed,
+                             uint64_t timeout_usec, int32_t *sum,
+                             int32_t *contributors, uint64_t *elapsed_usec);
+
+/* performs @repeat sums of @seed, each a separate traversal of the tree (see
+ * metasim_invoke_sum_batch for batched sums). @elapsed_usec returns the total
+ * elapsed time. */
 int metasim_invoke_sumrepeat(metasim_t metasim, int32_t seed, int32_t repeat,
                              int32_t *sum, uint64_t *elapsed_usec);
 
+/* performs @count independent sums, one for each of @seeds, in a single
+ * traversal of the server tree. @sums should have room for @count elements,
+ * and @count should not exceed METASIM_SUM_BATCH_MAX (4096). */
+int metasim_invoke_sum_batch(metasim_t metasim, int32_t count,
+                             int32_t *seeds, int32_t *sums,
+                             uint64_t *elapsed_usec);
+
+/* exclusive prefix sum of @value over servers, e.g., to assign write offsets.
+ * @offset returns the sum of values from the lower server ranks. exactly one
+ * client of each server should call this for each scan. */
+int metasim_invoke_exscan(metasim_t metasim, uint64_t value,
+                          uint64_t *offset, uint64_t *elapsed_usec);
+
+/* exchanges @size bytes between every pair of servers, with at most @window
+ * (0 for default) transfers in flight from each server. if @aggregate is set,
+ * the records are routed through node leaders. @msgs returns the messages
+ * sent by the local server, and @len the bytes received. exactly one client
+ * of each server should call this. fails with EINVAL if @size * nservers
+ * exceeds METASIM_ALLTOALL_BYTES_MAX (1 GiB). */
+int metasim_invoke_alltoall(metasim_t metasim, uint64_t size,
+                            int32_t aggregate, int32_t window,
+                            uint64_t *msgs, uint64_t *len,
+                            uint64_t *elapsed_usec);
+
+/* reduce-scatter of a synthetic vector of nservers blocks of @count int64_t
+ * elements. @op: 0 sum, 1 min, 2 max. @algo: 0 auto, 1 recursive halving,
+ * 2 ring, 3 reduce+scatter over the tree. @bytes and @msgs return the payload
+ * bytes and messages sent by the local server. fails with EINVAL if the vector
+ * exceeds 1 GiB. exactly one client of each server should call this. */
+int metasim_invoke_reduce_scatter(metasim_t metasim, uint64_t count,
+                                  int32_t op, int32_t algo,
+                                  uint64_t *bytes, uint64_t *msgs,
+                                  uint64_t *elapsed_usec);
+
+/* gathers a synthetic record of @size bytes from each server. if @all is set,
+ * the gathered buffer is delivered to all servers (allgather). @len returns
+ * the total length of the gathered buffer, @mem_peak returns the peak memory
+ * used for gather buffers at the local server. */
+int metasim_invoke_gather(metasim_t metasim, int32_t size, int32_t all,
+                          int32_t *count, uint64_t *len, uint64_t *mem_peak,
+                          uint64_t *elapsed_usec);
+
+/* broadcasts @size bytes from the local server to all servers over a
+ * @degree-ary tree, pipelined in segments of @segsize bytes (0 for default).
+ * if @tree is 1, segments alternate between a binary tree and its mirror
+ * (double binary tree), and @degree is ignored. fails with EINVAL if @size
+ * exceeds 1 GiB or @degree exceeds 64. */
+int metasim_invoke_bcast(metasim_t metasim, uint64_t size, uint64_t segsize,
+                         int32_t degree, int32_t tree, uint64_t *elapsed_usec);
+
 #endif /* __METASIM_H */
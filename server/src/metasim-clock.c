@@ -0,0 +1,205 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <margo.h>
+
+#include "metasim-server.h"
+#include "metasim-rpc.h"
+#include "metasim-clock.h"
+
+extern metasim_server_t *metasim;
+
+static metasim_clock_est_t clock_est;
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* past offsets, to shift each recorded event by the estimate of its time */
+typedef struct {
+    int64_t usec;           /* local time of the estimate */
+    int64_t offset;
+} clock_history_t;
+
+static clock_history_t clock_history[METASIM_CLOCK_HISTORY];
+static uint64_t clock_history_count;
+
+typedef struct {
+    margo_instance_id mid;
+    ABT_thread ult;
+    int samples;
+    double interval;        /* msec */
+} clock_sync_t;
+
+/* the periodic sync sleeps in slices, so that finalize does not wait for a
+ * whole interval */
+#define CLOCK_SYNC_SLICE_MSEC   100.0
+
+static int clock_stop;
+
+int metasim_clock_sync(int samples)
+{
+    int i = 0;
+    int ret = 0;
+    int64_t offset = 0;
+    int64_t rtt = 0;
+    struct timespec now;
+    clock_history_t *h = NULL;
+    metasim_clock_est_t est = { 0, };
+
+    if (metasim->rank == 0) {
+        pthread_mutex_lock(&clock_lock);
+        clock_est.rounds++;
+        pthread_mutex_unlock(&clock_lock);
+        return 0;
+    }
+
+    est.rtt = INT64_MAX;
+
+    for (i = 0; i < samples && !clock_stop; i++) {
+        ret = metasim_rpc_clock_probe(0, &offset, &rtt);
+        if (ret)
+            continue;
+
+        est.samples++;
+
+        /* the round trip with the least queueing is the most symmetric */
+        if (rtt < est.rtt) {
+            est.rtt = rtt;
+            est.offset = offset;
+        }
+    }
+
+    if (est.samples == 0) {
+        __error("failed to estimate the clock offset (%d samples)", samples);
+        return EIO;
+    }
+
+    est.uncertainty = (est.rtt + 1) / 2;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    pthread_mutex_lock(&clock_lock);
+    est.rounds = clock_est.rounds + 1;
+    clock_est = est;
+
+    h = &clock_history[clock_history_count++ % METASIM_CLOCK_HISTORY];
+    h->usec = (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    h->offset = est.offset;
+    pthread_mutex_unlock(&clock_lock);
+
+    __debug("clock offset to rank 0: %lld usec (+/- %lld, rtt=%lld, %d/%d "
+            "samples)", (long long) est.offset, (long long) est.uncertainty,
+            (long long) est.rtt, est.samples, samples);
+
+    return 0;
+}
+
+void metasim_clock_get(metasim_clock_est_t *est)
+{
+    pthread_mutex_lock(&clock_lock);
+    *est = clock_est;
+    pthread_mutex_unlock(&clock_lock);
+}
+
+int64_t metasim_clock_offset_at(int64_t usec)
+{
+    uint64_t i = 0;
+    uint64_t first = 0;
+    int64_t offset = 0;
+
+    pthread_mutex_lock(&clock_lock);
+
+    if (clock_history_count > METASIM_CLOCK_HISTORY)
+        first = clock_history_count - METASIM_CLOCK_HISTORY;
+
+    /* rank 0, or not estimated yet */
+    offset = clock_est.offset;
+
+    for (i = clock_history_count; i > first; i--) {
+        clock_history_t *h = &clock_history[(i - 1) % METASIM_CLOCK_HISTORY];
+
+        offset = h->offset;
+        if (h->usec <= usec)
+            break;
+    }
+
+    pthread_mutex_unlock(&clock_lock);
+
+    return offset;
+}
+
+static void clock_sync_run(void *arg)
+{
+    clock_sync_t *c = (clock_sync_t *) arg;
+    double slept = 0;
+    double slice = 0;
+
+    while (!clock_stop) {
+        slice = c->interval - slept;
+        if (slice > CLOCK_SYNC_SLICE_MSEC)
+            slice = CLOCK_SYNC_SLICE_MSEC;
+
+        margo_thread_sleep(c->mid, slice);
+        slept += slice;
+        if (clock_stop || slept < c->interval)
+            continue;
+
+        metasim_clock_sync(c->samples);
+        slept = 0;
+    }
+}
+
+static void clock_sync_stop(void *arg)
+{
+    clock_sync_t *c = (clock_sync_t *) arg;
+
+    clock_stop = 1;
+    ABT_thread_join(c->ult);
+    ABT_thread_free(&c->ult);
+
+    free(c);
+}
+
+int metasim_clock_start(margo_instance_id mid, int samples, double interval)
+{
+    int ret = 0;
+    ABT_pool pool;
+    clock_sync_t *c = NULL;
+
+    if (interval <= 0 || metasim->rank == 0)
+        return 0;
+
+    c = calloc(1, sizeof(*c));
+    if (!c)
+        return ENOMEM;
+
+    c->mid = mid;
+    c->samples = samples;
+    c->interval = interval * 1e3;
+
+    ret = margo_get_handler_pool(mid, &pool);
+    if (ret) {
+        free(c);
+        return EIO;
+    }
+
+    ret = ABT_thread_create(pool, clock_sync_run, c, ABT_THREAD_ATTR_NULL,
+                            &c->ult);
+    if (ret != ABT_SUCCESS) {
+        free(c);
+        return EIO;
+    }
+
+    margo_push_finalize_callback(mid, clock_sync_stop, c);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __METASIM_CLOCK_H
+#define __METASIM_CLOCK_H
+
+#include <stdint.h>
+#include <margo.h>
+
+/* estimates the offset of the local clock (CLOCK_REALTIME) relative to rank 0
+ * with ntp-style pings, keeping the round trip with the smallest rtt among the
+ * samples. adding the offset to a local timestamp gives the time of rank 0,
+ * within the uncertainty of half the minimum rtt. */
+
+typedef struct {
+    int64_t offset;         /* usec to add to the local clock */
+    int64_t uncertainty;    /* usec, half the minimum rtt */
+    int64_t rtt;            /* minimum rtt in usec */
+    int samples;            /* successful round trips */
+    uint64_t rounds;        /* number of estimates so far */
+} metasim_clock_est_t;
+
+/* estimates the offset with @samples round trips to rank 0. the offset of
+ * rank 0 itself is always 0. */
+int metasim_clock_sync(int samples);
+
+/* re-estimates the offset every @interval seconds, until @mid is finalized */
+int metasim_clock_start(margo_instance_id mid, int samples, double interval);
+
+void metasim_clock_get(metasim_clock_est_t *est);
+
+/* the offset in effect at the local time @usec (CLOCK_REALTIME), i.e., from
+ * the last estimate before @usec, or the first estimate for earlier times.
+ * only the last METASIM_CLOCK_HISTORY estimates are kept. */
+int64_t metasim_clock_offset_at(int64_t usec);
+
+#define METASIM_CLOCK_HISTORY 1024
+
+#endif /* __METASIM_CLOCK_H */
@@ -0,0 +1,383 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+
+/* metasim-diag: merges the margo diagnostics dumped by all servers (see
+ * metasimd --diag) into a single table per instance (server, sm, listener).
+ *
+ * every stat line in a dump, i.e., "<stat or breadcrumb> <avg> <min> <max>
+ * <count>" separated by tabs or commas, is merged across ranks: counts are
+ * added up, the average is weighted by the count, and the rank with the
+ * largest maximum is reported. lines mapping a breadcrumb to an rpc name
+ * ("0x<breadcrumb> <name>") are used to name the breadcrumb stats. dumps from
+ * older runs, named diag-<host>-<pid>, are taken as server instances of an
+ * unknown rank.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+
+typedef struct {
+    char instance[32];
+    char key[128];
+    int ranks;
+    uint64_t count;
+    double total;       /* sum of avg * count */
+    double min;
+    double max;
+    int max_rank;
+} stat_t;
+
+typedef struct {
+    char breadcrumb[32];
+    char name[96];
+} rpc_name_t;
+
+static stat_t *stats;
+static int nstats;
+static int stats_capacity;
+
+static rpc_name_t *names;
+static int nnames;
+static int names_capacity;
+
+static int nfiles;
+
+static void *grow(void *buf, int *capacity, int count, size_t size)
+{
+    void *tmp = NULL;
+
+    if (count < *capacity)
+        return buf;
+
+    *capacity = *capacity ? *capacity * 2 : 256;
+    tmp = realloc(buf, *capacity * size);
+    if (!tmp) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(ENOMEM);
+    }
+
+    return tmp;
+}
+
+static stat_t *find_stat(const char *instance, const char *key)
+{
+    int i = 0;
+    stat_t *s = NULL;
+
+    for (i = 0; i < nstats; i++)
+        if (!strcmp(stats[i].key, key) && !strcmp(stats[i].instance, instance))
+            return &stats[i];
+
+    stats = grow(stats, &stats_capacity, nstats, sizeof(*stats));
+
+    s = &stats[nstats++];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->instance, sizeof(s->instance), "%s", instance);
+    snprintf(s->key, sizeof(s->key), "%s", key);
+    s->max_rank = -1;
+
+    return s;
+}
+
+static void add_name(const char *breadcrumb, const char *name)
+{
+    int i = 0;
+
+    for (i = 0; i < nnames; i++)
+        if (!strcmp(names[i].breadcrumb, breadcrumb))
+            return;
+
+    names = grow(names, &names_capacity, nnames, sizeof(*names));
+
+    snprintf(names[nnames].breadcrumb, sizeof(names[nnames].breadcrumb),
+             "%s", breadcrumb);
+    snprintf(names[nnames].name, sizeof(names[nnames].name), "%s", name);
+    nnames++;
+}
+
+static const char *lookup_name(const char *key)
+{
+    int i = 0;
+
+    for (i = 0; i < nnames; i++)
+        if (!strcmp(names[i].breadcrumb, key))
+            return names[i].name;
+
+    return NULL;
+}
+
+static int split(char *line, char **fields, int max)
+{
+    int n = 0;
+    char *saveptr = NULL;
+    char *tok = NULL;
+
+    for (tok = strtok_r(line, "\t,\n", &saveptr); tok && n < max;
+         tok = strtok_r(NULL, "\t,\n", &saveptr)) {
+        while (*tok == ' ')
+            tok++;
+        fields[n++] = tok;
+    }
+
+    return n;
+}
+
+static int parse_number(const char *str, double *val)
+{
+    char *end = NULL;
+
+    *val = strtod(str, &end);
+
+    return end == str || (*end && *end != ' ');
+}
+
+static void add_line(const char *instance, int rank, char *line)
+{
+    int n = 0;
+    double avg, min, max, count;
+    char *fields[8];
+    stat_t *s = NULL;
+
+    n = split(line, fields, 8);
+
+    if (n == 2 && !strncmp(fields[0], "0x", 2) &&
+        parse_number(fields[1], &avg)) {
+        add_name(fields[0], fields[1]);
+        return;
+    }
+
+    if (n < 5 || parse_number(fields[1], &avg) ||
+        parse_number(fields[2], &min) || parse_number(fields[3], &max) ||
+        parse_number(fields[4], &count))
+        return;
+
+    s = find_stat(instance, fields[0]);
+
+    if (s->ranks == 0 || min < s->min)
+        s->min = min;
+    if (s->ranks == 0 || max > s->max) {
+        s->max = max;
+        s->max_rank = rank;
+    }
+
+    s->ranks++;
+    s->count += (uint64_t) count;
+    s->total += avg * count;
+}
+
+/* diag-<rank>-<instance>[.diag], or diag-<host>-<pid> of older runs */
+static void parse_file_name(const char *name, int *rank, char *instance,
+                            size_t len)
+{
+    char *end = NULL;
+    const char *pos = NULL;
+
+    *rank = -1;
+    snprintf(instance, len, "server");
+
+    if (strncmp(name, "diag-", 5))
+        return;
+
+    *rank = strtol(&name[5], &end, 10);
+    if (end == &name[5] || *end != '-') {
+        *rank = -1;
+        return;
+    }
+
+    pos = &end[1];
+    snprintf(instance, len, "%.*s", (int) strcspn(pos, "."), pos);
+}
+
+static int read_diag_file(const char *dir, const char *name)
+{
+    int rank = -1;
+    FILE *fp = NULL;
+    char path[4096];
+    char line[1024];
+    char instance[32];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    parse_file_name(name, &rank, instance, sizeof(instance));
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s (%s)\n", path, strerror(errno));
+        return errno;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        add_line(instance, rank, line);
+    }
+
+    fclose(fp);
+    nfiles++;
+
+    return 0;
+}
+
+static int read_diag_dir(const char *dir)
+{
+    int ret = 0;
+    size_t len = 0;
+    DIR *dp = NULL;
+    struct dirent *de = NULL;
+
+    dp = opendir(dir);
+    if (!dp) {
+        fprintf(stderr, "failed to open %s (%s)\n", dir, strerror(errno));
+        return errno;
+    }
+
+    while ((de = readdir(dp)) != NULL) {
+        len = strlen(de->d_name);
+
+        if (strncmp(de->d_name, "diag-", 5) &&
+            (len < 6 || strcmp(&de->d_name[len - 5], ".diag")))
+            continue;
+
+        ret = read_diag_file(dir, de->d_name);
+        if (ret)
+            break;
+    }
+
+    closedir(dp);
+
+    if (!ret && nfiles == 0) {
+        fprintf(stderr, "no diagnostics files in %s\n", dir);
+        ret = ENOENT;
+    }
+
+    return ret;
+}
+
+/* by instance, then by the total time, largest first */
+static int compare_stat(const void *a, const void *b)
+{
+    const stat_t *sa = (const stat_t *) a;
+    const stat_t *sb = (const stat_t *) b;
+    int cmp = strcmp(sa->instance, sb->instance);
+
+    if (cmp)
+        return cmp;
+
+    return sa->total < sb->total ? 1 : sa->total > sb->total ? -1 : 0;
+}
+
+static void print_stats(const char *instance, int top)
+{
+    int i = 0;
+    int printed = 0;
+    const char *name = NULL;
+    char key[256];
+
+    qsort(stats, nstats, sizeof(*stats), compare_stat);
+
+    printf("# %d files\n", nfiles);
+    printf("# instance,stat,ranks,count,avg,min,max,max rank,total\n");
+
+    for (i = 0; i < nstats; i++) {
+        stat_t *s = &stats[i];
+
+        if (instance && strcmp(s->instance, instance))
+            continue;
+
+        if (i > 0 && strcmp(s->instance, stats[i - 1].instance))
+            printed = 0;
+
+        if (top > 0 && printed >= top)
+            continue;
+
+        name = lookup_name(s->key);
+        if (name)
+            snprintf(key, sizeof(key), "%s(%s)", name, s->key);
+        else
+            snprintf(key, sizeof(key), "%s", s->key);
+
+        printf("## diag,%s,%s,%d,%llu,%.9lf,%.9lf,%.9lf,%d,%.6lf\n",
+               s->instance, key, s->ranks, (unsigned long long) s->count,
+               s->count ? s->total / s->count : .0f, s->min, s->max,
+               s->max_rank, s->total);
+        printed++;
+    }
+}
+
+static struct option l_opts[] = {
+    { "dir", 1, 0, 'd' },
+    { "help", 0, 0, 'h' },
+    { "instance", 1, 0, 'i' },
+    { "top", 1, 0, 'n' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "d:hi:n:";
+
+static const char *usage_str =
+"\n"
+"Usage: metasim-diag [options...]\n"
+"\n"
+"-d, --dir=<path>  directory of the margo dumps (default: logs/margo)\n"
+"-h, --help        print this help message\n"
+"-i, --instance=<name>\n"
+"                  print only the given instance (server, sm, listener)\n"
+"-n, --top=<N>     print only the <N> stats with the largest total time of\n"
+"                  each instance\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int top = 0;
+    const char *dir = "logs/margo";
+    const char *instance = NULL;
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'd':
+            dir = optarg;
+            break;
+
+        case 'i':
+            instance = optarg;
+            break;
+
+        case 'n':
+            top = atoi(optarg);
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    ret = read_diag_dir(dir);
+    if (ret)
+        return ret;
+
+    print_stats(instance, top);
+
+    free(stats);
+    free(names);
+
+    return 0;
+}
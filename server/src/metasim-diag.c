@@ -0,0 +1,184 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <margo.h>
+
+#include "metasim-log.h"
+#include "metasim-diag.h"
+
+#define DIAG_MAX_INSTANCES  4
+
+typedef struct {
+    margo_instance_id mid;
+    const char *name;
+} diag_instance_t;
+
+static metasim_diag_conf_t diag_conf;
+static int diag_rank;
+static int diag_count;
+static diag_instance_t diag_instances[DIAG_MAX_INSTANCES];
+static uint64_t diag_dumps;
+
+/* periodic dumps and SIGUSR1 may come at the same time */
+static pthread_mutex_t diag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    margo_instance_id mid;
+    ABT_thread ult;
+    int stop;
+} diag_dumper_t;
+
+int metasim_diag_init(metasim_diag_conf_t *conf, int rank)
+{
+    diag_conf = *conf;
+    diag_rank = rank;
+
+    if (diag_conf.profile)
+        diag_conf.enabled = 1;
+
+    if (diag_conf.enabled)
+        __debug("margo diagnostics enabled (profile=%d, interval=%.1lf sec)",
+                diag_conf.profile, diag_conf.interval);
+
+    return 0;
+}
+
+/* finalize callback of an added instance, so that it is not dumped after */
+static void diag_remove(void *arg)
+{
+    int i = 0;
+    margo_instance_id mid = (margo_instance_id) arg;
+
+    pthread_mutex_lock(&diag_lock);
+
+    for (i = 0; i < diag_count; i++) {
+        if (diag_instances[i].mid != mid)
+            continue;
+
+        diag_count--;
+        for ( ; i < diag_count; i++)
+            diag_instances[i] = diag_instances[i + 1];
+        break;
+    }
+
+    pthread_mutex_unlock(&diag_lock);
+}
+
+int metasim_diag_add(margo_instance_id mid, const char *name)
+{
+    if (!diag_conf.enabled || mid == MARGO_INSTANCE_NULL)
+        return 0;
+
+    if (diag_count == DIAG_MAX_INSTANCES)
+        return ENOSPC;
+
+    margo_diag_start(mid);
+    if (diag_conf.profile)
+        margo_profile_start(mid);
+
+    pthread_mutex_lock(&diag_lock);
+    diag_instances[diag_count].mid = mid;
+    diag_instances[diag_count].name = name;
+    diag_count++;
+    pthread_mutex_unlock(&diag_lock);
+
+    margo_push_finalize_callback(mid, diag_remove, mid);
+
+    return 0;
+}
+
+void metasim_diag_dump(void)
+{
+    int i = 0;
+    char path[PATH_MAX];
+
+    if (!diag_conf.enabled)
+        return;
+
+    pthread_mutex_lock(&diag_lock);
+
+    for (i = 0; i < diag_count; i++) {
+        diag_instance_t *d = &diag_instances[i];
+
+        sprintf(path, "logs/margo/diag-%d-%s", diag_rank, d->name);
+        margo_diag_dump(d->mid, path, 0);
+
+        if (diag_conf.profile) {
+            sprintf(path, "logs/margo/profile-%d-%s", diag_rank, d->name);
+            margo_profile_dump(d->mid, path, 0);
+        }
+    }
+
+    diag_dumps++;
+
+    pthread_mutex_unlock(&diag_lock);
+}
+
+static void diag_dumper_run(void *arg)
+{
+    diag_dumper_t *d = (diag_dumper_t *) arg;
+
+    while (!d->stop) {
+        margo_thread_sleep(d->mid, diag_conf.interval * 1e3);
+        if (!d->stop)
+            metasim_diag_dump();
+    }
+}
+
+static void diag_dumper_stop(void *arg)
+{
+    diag_dumper_t *d = (diag_dumper_t *) arg;
+
+    if (d->ult != ABT_THREAD_NULL) {
+        d->stop = 1;
+        ABT_thread_join(d->ult);
+        ABT_thread_free(&d->ult);
+    }
+
+    __debug("dumped margo diagnostics %llu times",
+            (unsigned long long) diag_dumps);
+
+    free(d);
+}
+
+int metasim_diag_start(margo_instance_id mid)
+{
+    int ret = 0;
+    ABT_pool pool;
+    diag_dumper_t *d = NULL;
+
+    if (!diag_conf.enabled)
+        return 0;
+
+    d = calloc(1, sizeof(*d));
+    if (!d)
+        return ENOMEM;
+
+    d->mid = mid;
+    d->ult = ABT_THREAD_NULL;
+
+    if (diag_conf.interval > 0) {
+        ret = margo_get_handler_pool(mid, &pool);
+        if (ret == 0)
+            ret = ABT_thread_create(pool, diag_dumper_run, d,
+                                    ABT_THREAD_ATTR_NULL, &d->ult);
+        if (ret) {
+            free(d);
+            return EIO;
+        }
+    }
+
+    margo_push_finalize_callback(mid, diag_dumper_stop, d);
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __METASIM_DIAG_H
+#define __METASIM_DIAG_H
+
+#include <margo.h>
+
+/* margo diagnostics (and optionally profiling) of the server instances. each
+ * instance is dumped to logs/margo/diag-<rank>-<name> (and profile-<rank>-
+ * <name>), overwritten periodically, so that the latest numbers survive a
+ * server that never exits cleanly. metasim-diag merges the dumps of all
+ * ranks. */
+
+typedef struct {
+    int enabled;
+    int profile;        /* margo_profile_start as well */
+    double interval;    /* seconds between dumps, 0 for exit only */
+} metasim_diag_conf_t;
+
+int metasim_diag_init(metasim_diag_conf_t *conf, int rank);
+
+/* starts collecting the diagnostics of @mid, dumped under @name until @mid
+ * is finalized */
+int metasim_diag_add(margo_instance_id mid, const char *name);
+
+/* dumps all added instances every interval, until @mid is finalized */
+int metasim_diag_start(margo_instance_id mid);
+
+/* dumps all added instances now. the last dump should be taken before the
+ * instances are finalized. */
+void metasim_diag_dump(void);
+
+#endif /* __METASIM_DIAG_H */
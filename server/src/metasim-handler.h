@@ -0,0 +1,43 @@
+#ifndef __METASIM_HANDLER_H
+#define __METASIM_HANDLER_H
+
+#include <margo.h>
+
+#include "metasim-timeline.h"
+#include "metasim-perf.h"
+#include "metasim-poll.h"
+
+/* rpc handlers instrumented with the timeline (metasim-timeline.h) and the
+ * hardware counters (metasim-perf.h), and counted in flight for the hybrid
+ * progress (metasim-poll.h). use these in place of the margo macros,
+ * i.e., METASIM_DECLARE_RPC_HANDLER(fn) and METASIM_DEFINE_RPC_HANDLER(fn)
+ * for a handler fn(), and METASIM_REGISTER() to register it. the handler
+ * names are pasted here, as margo pastes them again without expanding
+ * macros. */
+#define METASIM_DECLARE_RPC_HANDLER(__fn)                                   \
+    DECLARE_MARGO_RPC_HANDLER(__fn##_instrumented)
+
+#define METASIM_DEFINE_RPC_HANDLER(__fn)                                    \
+    static metasim_perf_stat_t __fn##_perf = { .name = #__fn };             \
+    static void __fn##_instrumented(hg_handle_t handle)                     \
+    {                                                                       \
+        metasim_perf_sample_t sample;                                       \
+        margo_instance_id __mid = margo_hg_handle_get_instance(handle);     \
+                                                                            \
+        metasim_poll_enter(__mid);                                          \
+        if (metasim_timeline_enabled) {                                     \
+            metasim_timeline_record(METASIM_TIMELINE_POOL, #__fn);          \
+            metasim_timeline_record(METASIM_TIMELINE_BEGIN, #__fn);         \
+        }                                                                   \
+        metasim_perf_enter(&sample);                                        \
+        __fn(handle);                                                       \
+        metasim_perf_exit(&__fn##_perf, &sample);                           \
+        metasim_timeline_end(#__fn);                                        \
+        metasim_poll_leave(__mid);                                          \
+    }                                                                       \
+    DEFINE_MARGO_RPC_HANDLER(__fn##_instrumented)
+
+#define METASIM_REGISTER(__mid, __name, __in, __out, __fn)                  \
+    MARGO_REGISTER(__mid, __name, __in, __out, __fn##_instrumented)
+
+#endif /* __METASIM_HANDLER_H */
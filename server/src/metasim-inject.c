@@ -0,0 +1,219 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <margo.h>
+
+#include "metasim-log.h"
+#include "metasim-inject.h"
+
+static struct {
+    int rank;
+    int dist;
+    int targeted;           /* this server is in the rank set */
+    double usec;            /* fixed delay, minimum, or mean */
+    double max_usec;        /* maximum of uniform delays */
+    double drop;
+    uint64_t dropped;
+    char desc[256];
+} inject;
+
+static __thread unsigned int inject_seed;
+
+static double inject_random(void)
+{
+    if (!inject_seed)
+        inject_seed = (unsigned int) (inject.rank + 1) * 2654435761u ^
+                      (unsigned int) (uintptr_t) &inject_seed;
+
+    return rand_r(&inject_seed) / ((double) RAND_MAX + 1);
+}
+
+static int inject_parse_delay(const char *str)
+{
+    char *end = NULL;
+
+    if (!strncmp(str, "fixed:", 6)) {
+        inject.dist = METASIM_INJECT_FIXED;
+        inject.usec = strtod(&str[6], &end);
+    } else if (!strncmp(str, "uniform:", 8)) {
+        inject.dist = METASIM_INJECT_UNIFORM;
+        inject.usec = strtod(&str[8], &end);
+        if (*end != ':')
+            return EINVAL;
+        inject.max_usec = strtod(&end[1], &end);
+        if (inject.max_usec < inject.usec)
+            return EINVAL;
+    } else if (!strncmp(str, "exp:", 4)) {
+        inject.dist = METASIM_INJECT_EXP;
+        inject.usec = strtod(&str[4], &end);
+    } else {
+        return EINVAL;
+    }
+
+    return (*end || inject.usec < 0) ? EINVAL : 0;
+}
+
+/* whether @rank is in @list, e.g., "1,4-7" */
+static int inject_parse_ranks(const char *list, int rank, int *found)
+{
+    const char *pos = list;
+    char *end = NULL;
+    long first = 0;
+    long last = 0;
+
+    *found = 0;
+
+    while (*pos) {
+        first = strtol(pos, &end, 10);
+        if (end == pos)
+            return EINVAL;
+
+        last = first;
+        if (*end == '-') {
+            pos = &end[1];
+            last = strtol(pos, &end, 10);
+            if (end == pos || last < first)
+                return EINVAL;
+        }
+
+        if (rank >= first && rank <= last)
+            *found = 1;
+
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return EINVAL;
+
+        pos = end;
+    }
+
+    return 0;
+}
+
+int metasim_inject_init(metasim_inject_conf_t *conf, int rank)
+{
+    int ret = 0;
+    const char *delay = conf->delay ? conf->delay :
+                        getenv("METASIM_INJECT_DELAY");
+    const char *ranks = conf->ranks ? conf->ranks :
+                        getenv("METASIM_INJECT_RANKS");
+    const char *drop = conf->drop ? conf->drop :
+                       getenv("METASIM_INJECT_DROP");
+    char *end = NULL;
+    char *pos = NULL;
+    int len = 0;
+
+    memset(&inject, 0, sizeof(inject));
+    inject.rank = rank;
+    inject.targeted = 1;
+
+    if (delay && *delay) {
+        ret = inject_parse_delay(delay);
+        if (ret) {
+            __error("invalid delay injection (%s)", delay);
+            return ret;
+        }
+    }
+
+    if (drop && *drop) {
+        inject.drop = strtod(drop, &end);
+        if (*end || inject.drop < 0 || inject.drop > 1) {
+            __error("invalid drop probability (%s)", drop);
+            return EINVAL;
+        }
+    }
+
+    if (ranks && *ranks && strcmp(ranks, "all")) {
+        ret = inject_parse_ranks(ranks, rank, &inject.targeted);
+        if (ret) {
+            __error("invalid rank list for injection (%s)", ranks);
+            return ret;
+        }
+    } else {
+        ranks = NULL;
+    }
+
+    if (inject.dist == METASIM_INJECT_NONE && inject.drop == 0) {
+        inject.targeted = 0;
+        sprintf(inject.desc, "none");
+        return 0;
+    }
+
+    len = snprintf(inject.desc, sizeof(inject.desc), "%s",
+                   inject.dist ? delay : "nodelay");
+    if (ranks)
+        len += snprintf(&inject.desc[len], sizeof(inject.desc) - len,
+                        "@%s", ranks);
+    if (inject.drop > 0)
+        snprintf(&inject.desc[len], sizeof(inject.desc) - len,
+                 "/drop:%g", inject.drop);
+
+    /* keep the description in a single csv field */
+    for (pos = inject.desc; *pos; pos++)
+        if (*pos == ',')
+            *pos = ';';
+
+    __debug("injecting %s (%s)", inject.desc,
+            inject.targeted ? "targeted" : "not targeted");
+
+    return 0;
+}
+
+const char *metasim_inject_describe(void)
+{
+    return inject.desc[0] ? inject.desc : "none";
+}
+
+static double inject_delay_usec(void)
+{
+    switch (inject.dist) {
+    case METASIM_INJECT_FIXED:
+        return inject.usec;
+    case METASIM_INJECT_UNIFORM:
+        return inject.usec + (inject.max_usec - inject.usec) * inject_random();
+    case METASIM_INJECT_EXP:
+        return -inject.usec * log(1 - inject_random());
+    default:
+        return 0;
+    }
+}
+
+void metasim_inject_delay(hg_handle_t handle)
+{
+    double usec = 0;
+
+    if (!inject.targeted)
+        return;
+
+    usec = inject_delay_usec();
+    if (usec > 0)
+        margo_thread_sleep(margo_hg_handle_get_instance(handle), usec*1e-3);
+}
+
+int metasim_inject_drop(void)
+{
+    if (!inject.targeted || inject.drop == 0 || inject_random() >= inject.drop)
+        return 0;
+
+    __debug("dropping a response (%llu dropped)",
+            (unsigned long long) __sync_add_and_fetch(&inject.dropped, 1));
+
+    return 1;
+}
+
+hg_return_t metasim_inject_respond(hg_handle_t handle, void *out)
+{
+    metasim_inject_delay(handle);
+
+    return margo_respond(handle, out);
+}
@@ -0,0 +1,46 @@
+#ifndef __METASIM_INJECT_H
+#define __METASIM_INJECT_H
+
+#include <stdint.h>
+#include <margo.h>
+
+/*
+ * latency and fault injection, to reproduce slow servers. rpc handlers are
+ * delayed before responding (one-way handlers on entry), on all servers or
+ * on a set of ranks. only the sum responses to a parent waiting with a
+ * deadline (--op-timeout) can be dropped, as other callers would hang.
+ */
+
+enum {
+    METASIM_INJECT_NONE = 0,
+    METASIM_INJECT_FIXED,       /* fixed:<usec> */
+    METASIM_INJECT_UNIFORM,     /* uniform:<min usec>:<max usec> */
+    METASIM_INJECT_EXP,         /* exp:<mean usec> */
+};
+
+typedef struct {
+    const char *delay;      /* delay spec, see above */
+    const char *ranks;      /* e.g., "1,4-7", NULL for all ranks */
+    const char *drop;       /* probability of dropping a response */
+} metasim_inject_conf_t;
+
+/* the fields not set in @conf are taken from the environment variables
+ * METASIM_INJECT_DELAY, METASIM_INJECT_RANKS and METASIM_INJECT_DROP.
+ * returns EINVAL on an invalid spec. */
+int metasim_inject_init(metasim_inject_conf_t *conf, int rank);
+
+/* the injected settings for benchmark output, without commas, e.g.,
+ * "exp:500@1;4-7/drop:0.01", or "none" */
+const char *metasim_inject_describe(void);
+
+/* delays the calling handler of @handle, if this server is targeted */
+void metasim_inject_delay(hg_handle_t handle);
+
+/* whether to drop the next response, if this server is targeted */
+int metasim_inject_drop(void);
+
+/* margo_respond with the injected delay. the response is never dropped, use
+ * metasim_inject_drop() where the caller waits with a deadline. */
+hg_return_t metasim_inject_respond(hg_handle_t handle, void *out);
+
+#endif /* __METASIM_INJECT_H */
@@ -8,6 +8,8 @@
  */
 #include <config.h>
 
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <time.h>
 #include <assert.h>
@@ -17,12 +19,207 @@
 #include "metasim-server.h"
 #include "metasim-listener.h"
 #include "metasim-rpc.h"
+#include "metasim-inject.h"
+#include "metasim-handler.h"
+#include "metasim-poll.h"
+#include "metasim-diag.h"
 
 static margo_instance_id listener_mid;
 static const int listener_default_pool_size = 4;
 
 static hg_addr_t listener_addr;
 
+/* fabric address strings of all servers, for clients that send
+ * point-to-point rpcs directly to remote servers */
+static char **listener_peer_addrs;
+
+/* pings relayed to remote servers on behalf of clients */
+static uint64_t listener_relayed;
+
+/*
+ * admission control
+ *
+ * requests that trigger server operations are admitted only if the number of
+ * running handlers is below the high-water mark. otherwise, the request is
+ * either rejected with EBUSY, which clients retry with backoff, or deferred.
+ *
+ * a deferred request does not keep its handler ult: the handler only queues
+ * the handle and returns, and the request is run again in a new ult when a
+ * running handler leaves and hands over its slot. this bounds the number of
+ * live handler ults, rather than parking them on a condition variable.
+ */
+static metasim_listener_conf_t listener_conf;
+
+typedef struct listener_deferred {
+    hg_handle_t handle;
+    void (*fn)(hg_handle_t);
+    struct listener_deferred *next;
+} listener_deferred_t;
+
+static ABT_mutex listener_admit_lock;
+static int listener_running;
+static int listener_waiting;
+static uint64_t listener_rejected;
+static uint64_t listener_deferred;
+
+/* waiting requests, in arrival order, and requests that were handed a slot
+ * but have not run yet */
+static listener_deferred_t *listener_queue_head;
+static listener_deferred_t *listener_queue_tail;
+static listener_deferred_t *listener_resumed;
+
+static void listener_run_deferred(void *arg)
+{
+    listener_deferred_t *d = (listener_deferred_t *) arg;
+
+    /* the wrapper that deferred it has returned, count it in flight again */
+    metasim_poll_enter(listener_mid);
+    d->fn(d->handle);
+    metasim_poll_leave(listener_mid);
+}
+
+static int listener_take_resumed(hg_handle_t handle)
+{
+    listener_deferred_t **pos = NULL;
+    listener_deferred_t *d = NULL;
+
+    for (pos = &listener_resumed; *pos; pos = &(*pos)->next) {
+        if ((*pos)->handle == handle) {
+            d = *pos;
+            *pos = d->next;
+            free(d);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* called first in the handlers that are subject to admission. in delay mode,
+ * this takes a slot for the request, or queues the request and returns 1, in
+ * which case the handler returns right away without touching @handle. */
+static int listener_defer(hg_handle_t handle, void (*fn)(hg_handle_t))
+{
+    int ret = 0;
+    listener_deferred_t *d = NULL;
+
+    if (listener_conf.hwm <= 0 || listener_conf.reject)
+        return 0;
+
+    ABT_mutex_lock(listener_admit_lock);
+
+    /* run again with the slot handed over by listener_leave() */
+    if (listener_take_resumed(handle))
+        goto out_unlock;
+
+    if (listener_running < listener_conf.hwm) {
+        listener_running++;
+        goto out_unlock;
+    }
+
+    d = calloc(1, sizeof(*d));
+    if (!d) {
+        /* run over the high-water mark rather than losing the request */
+        listener_running++;
+        goto out_unlock;
+    }
+
+    d->handle = handle;
+    d->fn = fn;
+
+    if (listener_queue_tail)
+        listener_queue_tail->next = d;
+    else
+        listener_queue_head = d;
+    listener_queue_tail = d;
+
+    listener_waiting++;
+    listener_deferred++;
+    ret = 1;
+
+out_unlock:
+    ABT_mutex_unlock(listener_admit_lock);
+
+    if (ret)
+        __debug("[ADMIT] deferred (running=%d, waiting=%d, deferred=%llu)",
+                listener_running, listener_waiting,
+                (unsigned long long) listener_deferred);
+
+    return ret;
+}
+
+/* in delay mode, the slot was already taken by listener_defer() */
+static int listener_admit(void)
+{
+    int ret = 0;
+    size_t queued = 0;
+    ABT_pool pool = NULL;
+
+    if (listener_conf.hwm <= 0 || !listener_conf.reject)
+        return 0;
+
+    ABT_mutex_lock(listener_admit_lock);
+
+    if (listener_running >= listener_conf.hwm) {
+        listener_rejected++;
+        ret = EBUSY;
+    } else {
+        listener_running++;
+    }
+
+    ABT_mutex_unlock(listener_admit_lock);
+
+    if (metasim_log_debug) {
+        margo_get_handler_pool(listener_mid, &pool);
+        ABT_pool_get_size(pool, &queued);
+
+        __debug("[ADMIT] %s (running=%d, queued=%zu, rejected=%llu)",
+                ret ? "rejected" : "admitted", listener_running, queued,
+                (unsigned long long) listener_rejected);
+    }
+
+    return ret;
+}
+
+static void listener_leave(void)
+{
+    int ret = 0;
+    ABT_pool pool = NULL;
+    listener_deferred_t *d = NULL;
+
+    if (listener_conf.hwm <= 0)
+        return;
+
+    ABT_mutex_lock(listener_admit_lock);
+
+    d = listener_queue_head;
+    if (d) {
+        listener_queue_head = d->next;
+        if (!listener_queue_head)
+            listener_queue_tail = NULL;
+        listener_waiting--;
+
+        d->next = listener_resumed;
+        listener_resumed = d;
+    } else {
+        listener_running--;
+    }
+
+    ABT_mutex_unlock(listener_admit_lock);
+
+    if (!d)
+        return;
+
+    margo_get_handler_pool(listener_mid, &pool);
+    ret = ABT_thread_create(pool, listener_run_deferred, d,
+                            ABT_THREAD_ATTR_NULL, NULL);
+    if (ret != ABT_SUCCESS) {
+        /* run it here, the slot is ours until it completes */
+        __error("failed to resume a deferred request (ret=%d)", ret);
+        listener_run_deferred(d);
+    }
+}
+
 /*
  * listener rpc handlers
  */
@@ -43,15 +240,17 @@ static void metasim_listener_handle_init(hg_handle_t handle)
     out.ret = 0;
     out.rank = metasim->rank;
     out.nranks = metasim->nranks;
+    out.transport = metasim->transport;
+    out.inject = metasim_inject_describe();
 
-    __debug("[RPC INIT] respoding rpc (rank=%d, nranks=%d)",
-            metasim->rank, metasim->nranks);
+    __debug("[RPC INIT] respoding rpc (rank=%d, nranks=%d, transport=%s)",
+            metasim->rank, metasim->nranks, metasim->transport);
 
     margo_respond(handle, &out);
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_init);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_init);
 
 static void metasim_listener_handle_terminate(hg_handle_t handle)
 {
@@ -72,7 +271,92 @@ static void metasim_listener_handle_terminate(hg_handle_t handle)
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_terminate);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_terminate);
+
+static int listener_init_peers(void)
+{
+    int i = 0;
+    char str[512];
+    size_t len = 0;
+    hg_return_t hret;
+
+    listener_peer_addrs = calloc(metasim->nranks, sizeof(char *));
+    if (!listener_peer_addrs)
+        return ENOMEM;
+
+    for (i = 0; i < metasim->nranks; i++) {
+        len = sizeof(str);
+        hret = margo_addr_to_string(metasim->mid, str, &len,
+                                    metasim->peer_addrs[i]);
+        if (hret != HG_SUCCESS) {
+            __error("failed to get the address of rank %d", i);
+            return EIO;
+        }
+
+        listener_peer_addrs[i] = strdup(str);
+        if (!listener_peer_addrs[i])
+            return ENOMEM;
+    }
+
+    return 0;
+}
+
+static void metasim_listener_handle_peers(hg_handle_t handle)
+{
+    int ret = 0;
+    int32_t i = 0;
+    int32_t count = 0;
+    size_t len = 0;
+    char *buf = NULL;
+    metasim_peers_in_t in;
+    metasim_peers_out_t out;
+
+    margo_get_input(handle, &in);
+
+    __debug("[RPC PEERS] received rpc (offset=%d)", in.offset);
+
+    /* one address (< 512 bytes) may go beyond the limit */
+    buf = malloc(METASIM_PEERS_MAX_LEN + 512);
+    if (!buf) {
+        ret = ENOMEM;
+        goto respond;
+    }
+
+    if (!listener_peer_addrs || in.offset < 0) {
+        ret = EINVAL;
+        goto respond;
+    }
+
+    for (i = in.offset; i < metasim->nranks; i++) {
+        size_t n = strlen(listener_peer_addrs[i]) + 1;
+
+        if (count > 0 && len + n > METASIM_PEERS_MAX_LEN)
+            break;
+
+        sprintf(&buf[len], "%s\n", listener_peer_addrs[i]);
+        len += n;
+        count++;
+    }
+
+    buf[len] = '\0';
+
+respond:
+    __debug("[RPC PEERS] respoding rpc (ret=%d, count=%d)", ret, count);
+
+    out.ret = ret;
+    out.nranks = metasim->nranks;
+    out.count = count;
+    out.transport = metasim->transport;
+    out.addrs = ret ? "" : buf;
+
+    margo_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+
+    if (buf)
+        free(buf);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_peers);
 
 static void metasim_listener_handle_echo(hg_handle_t handle)
 {
@@ -91,11 +375,11 @@ static void metasim_listener_handle_echo(hg_handle_t handle)
 
     __debug("[RPC ECHO] (num=%d) => (echo=%d)", num, echo);
 
-    margo_respond(handle, &out);
+    metasim_inject_respond(handle, &out);
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_echo);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_echo);
 
 static void metasim_listener_handle_ping(hg_handle_t handle)
 {
@@ -108,16 +392,31 @@ static void metasim_listener_handle_ping(hg_handle_t handle)
 
     print_margo_handler_pool_size(listener_mid);
 
+    if (listener_defer(handle, metasim_listener_handle_ping))
+        return;
+
     margo_get_input(handle, &in);
     target = in.target;
     ping = in.ping;
 
-    if (target >= metasim->nranks)
-        target = target % metasim->nranks;
-
     __debug("[RPC PING] received & forwarding rpc (target=%d, ping=%d)",
             target, ping);
 
+    ret = listener_admit();
+    if (ret) {
+        pong = -1;
+        goto respond;
+    }
+
+    if (target < 0 || target >= metasim->nranks) {
+        ret = EINVAL;
+        pong = -1;
+        listener_leave();
+        goto respond;
+    }
+
+    __sync_fetch_and_add(&listener_relayed, 1);
+
     ret = metasim_rpc_invoke_ping(target, ping, &pong);
     if (ret) {
         __error("metasim_rpc_invoke_ping failed, will return -1 (ret=%d)",
@@ -125,15 +424,19 @@ static void metasim_listener_handle_ping(hg_handle_t handle)
         pong = -1;
     }
 
+    listener_leave();
+
+respond:
+    out.ret = ret;
     out.pong = pong;
 
     __debug("[RPC PING] respoding rpc (pong=%d)", pong);
 
-    margo_respond(handle, &out);
+    metasim_inject_respond(handle, &out);
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_ping);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_ping);
 
 static uint64_t
 calculate_elapsed_usec(struct timespec *t1, struct timespec *t2)
@@ -150,6 +453,7 @@ static void metasim_listener_handle_sum(hg_handle_t handle)
     int ret = 0;
     int32_t seed = 0;
     int32_t sum = 0;
+    int32_t contributors = 0;
     metasim_sum_in_t in;
     metasim_sum_out_t out;
     struct timespec start, stop;
@@ -157,17 +461,34 @@ static void metasim_listener_handle_sum(hg_handle_t handle)
 
     print_margo_handler_pool_size(listener_mid);
 
+    if (listener_defer(handle, metasim_listener_handle_sum))
+        return;
+
     margo_get_input(handle, &in);
     seed = in.seed;
 
     __debug("[RPC SUM] received & forwarding rpc (seed=%d)", seed);
 
+    ret = listener_admit();
+    if (ret) {
+        sum = -1;
+        goto respond;
+    }
+
     clock_gettime(CLOCK_REALTIME, &start);
 
-    ret = metasim_rpc_invoke_sum(seed, &sum);
+    ret = metasim_rpc_invoke_sum_timed(1, &seed, &sum, in.timeout_usec,
+                                       &contributors);
 
     clock_gettime(CLOCK_REALTIME, &stop);
 
+    listener_leave();
+
+    /* partial sums are only for clients that asked for a deadline. without
+     * any deadline, a partial sum is not a timeout. */
+    if (ret == 0 && in.timeout_usec == 0 && contributors < metasim->nranks)
+        ret = metasim_rpc_get_op_timeout() ? ETIMEDOUT : EIO;
+
     if (ret) {
         __error("metasim_rpc_invoke_ping failed, will return -1 (ret=%d)",
                 ret);
@@ -176,22 +497,25 @@ static void metasim_listener_handle_sum(hg_handle_t handle)
 
     usec = calculate_elapsed_usec(&start, &stop);
 
-    __debug("[RPC SUM] respoding rpc (sum=%d, usec=%llu)",
-            sum, (unsigned long long) usec);
+respond:
+    __debug("[RPC SUM] respoding rpc (sum=%d, contributors=%d, usec=%llu)",
+            sum, contributors, (unsigned long long) usec);
 
     out.ret = ret;
     out.sum = sum;
+    out.contributors = contributors;
     out.elapsed_usec = usec;
 
-    margo_respond(handle, &out);
+    metasim_inject_respond(handle, &out);
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_sum);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_sum);
 
 static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
 {
     int ret = 0;
+    int rc = 0;
     int32_t i = 0;
     int32_t seed = 0;
     int32_t repeat = 0;
@@ -203,6 +527,9 @@ static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
 
     print_margo_handler_pool_size(listener_mid);
 
+    if (listener_defer(handle, metasim_listener_handle_sumrepeat))
+        return;
+
     margo_get_input(handle, &in);
     seed = in.seed;
     repeat = in.repeat;
@@ -210,6 +537,12 @@ static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
     __debug("[RPC SUMREPEAT] received & forwarding rpc (seed=%d, repeat=%d)",
             seed, repeat);
 
+    ret = listener_admit();
+    if (ret) {
+        sum = -1;
+        goto respond;
+    }
+
     /* the 1st run took longer than the subsequent runs */
     clock_gettime(CLOCK_REALTIME, &start);
 
@@ -226,15 +559,20 @@ static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
     usec = calculate_elapsed_usec(&start, &stop);
     __debug("[RPC SUMREPEAT] first sum took %llu", (unsigned long long) usec);
 
-    /* now repeat and measure the time */
-    ret = 0;
+    /* now repeat and measure the time, one sum per tree traversal (batched
+     * sums go through listener_sum_batch). the first error is reported. */
     clock_gettime(CLOCK_REALTIME, &start);
 
-    for (i = 0; i < repeat; i++)
-        ret |= metasim_rpc_invoke_sum(seed, &sum);
+    for (i = 0; i < repeat; i++) {
+        rc = metasim_rpc_invoke_sum(seed, &sum);
+        if (!ret)
+            ret = rc;
+    }
 
     clock_gettime(CLOCK_REALTIME, &stop);
 
+    listener_leave();
+
     if (ret) {
         __error("metasim_rpc_invoke_ping failed, will return -1 (ret=%d)",
                 ret);
@@ -243,6 +581,7 @@ static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
 
     usec = calculate_elapsed_usec(&start, &stop);
 
+respond:
     __debug("[RPC SUM] respoding rpc (sum=%d, usec=%llu)",
             sum, (unsigned long long) usec);
 
@@ -250,46 +589,601 @@ static void metasim_listener_handle_sumrepeat(hg_handle_t handle)
     out.sum = sum;
     out.elapsed_usec = usec;
 
-    margo_respond(handle, &out);
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_sumrepeat);
+
+static void metasim_listener_handle_sum_batch(hg_handle_t handle)
+{
+    int ret = 0;
+    int32_t count = 0;
+    int32_t *sums = NULL;
+    metasim_sum_batch_in_t in;
+    metasim_sum_batch_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_sum_batch))
+        return;
+
+    margo_get_input(handle, &in);
+    count = in.seeds.count;
+
+    __debug("[RPC SUMBATCH] received & forwarding rpc (count=%d)", count);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    if (count <= 0 || count > METASIM_SUM_BATCH_MAX) {
+        ret = EINVAL;
+        listener_leave();
+        goto respond;
+    }
+
+    sums = calloc(count, sizeof(*sums));
+    if (!sums) {
+        ret = ENOMEM;
+        listener_leave();
+        goto respond;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    ret = metasim_rpc_invoke_sum_batch(count, in.seeds.v, sums);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    if (ret)
+        __error("metasim_rpc_invoke_sum_batch failed (ret=%d)", ret);
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+respond:
+    __debug("[RPC SUMBATCH] respoding rpc (ret=%d, count=%d, usec=%llu)",
+            ret, count, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.sums.count = ret ? 0 : count;
+    out.sums.v = sums;
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
+
+    if (sums)
+        free(sums);
+
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_sum_batch);
+
+static void metasim_listener_handle_exscan(hg_handle_t handle)
+{
+    int ret = 0;
+    uint64_t offset = 0;
+    metasim_exscan_in_t in;
+    metasim_exscan_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_exscan))
+        return;
+
+    margo_get_input(handle, &in);
+
+    __debug("[RPC EXSCAN] received & forwarding rpc (value=%llu)",
+            (unsigned long long) in.value);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    ret = metasim_rpc_exscan(in.value, &offset);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    if (ret)
+        __error("metasim_rpc_exscan failed (ret=%d)", ret);
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+respond:
+    __debug("[RPC EXSCAN] respoding rpc (ret=%d, offset=%llu, usec=%llu)",
+            ret, (unsigned long long) offset, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.offset = offset;
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_exscan);
+
+/* each server sends @size bytes to every server, filled with a pattern of
+ * (source + destination), which is verified by the receiver. */
+static int alltoall_run(uint64_t size, int aggregate, int window,
+                        uint64_t *msgs, uint64_t *len)
+{
+    int ret = 0;
+    int r = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    uint64_t i = 0;
+    uint64_t total = 0;
+    uint64_t *sendlens = NULL;
+    uint64_t *recvlens = NULL;
+    char *sendbuf = NULL;
+    char *recvbuf = NULL;
+
+    /* the size comes from the client */
+    if (size > (UINT64_MAX - 1) / nranks ||
+        size * nranks > METASIM_ALLTOALL_BYTES_MAX) {
+        __error("all-to-all size is too large (%llu bytes to %d servers)",
+                (unsigned long long) size, nranks);
+        return EINVAL;
+    }
+
+    sendlens = calloc(nranks, sizeof(*sendlens));
+    recvlens = calloc(nranks, sizeof(*recvlens));
+    sendbuf = malloc(size * nranks + 1);
+    if (!sendlens || !recvlens || !sendbuf) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    for (r = 0; r < nranks; r++) {
+        sendlens[r] = size;
+        memset(&sendbuf[r * size], (rank + r) & 0xff, size);
+    }
+
+    ret = metasim_rpc_alltoall(sendbuf, sendlens, aggregate, window,
+                               (void **) &recvbuf, recvlens, msgs);
+    if (ret)
+        goto out;
+
+    for (r = 0; r < nranks; r++) {
+        if (recvlens[r] != size) {
+            ret = EIO;
+            break;
+        }
+
+        for (i = 0; i < size; i++) {
+            if (recvbuf[total + i] != (char) ((rank + r) & 0xff)) {
+                ret = EIO;
+                break;
+            }
+        }
+
+        total += recvlens[r];
+    }
+
+    if (ret)
+        __error("all-to-all received corrupted buffer from rank %d", r);
+
+    *len = total;
+
+out:
+    if (recvbuf)
+        free(recvbuf);
+    if (sendbuf)
+        free(sendbuf);
+    if (recvlens)
+        free(recvlens);
+    if (sendlens)
+        free(sendlens);
+
+    return ret;
+}
+
+static void metasim_listener_handle_alltoall(hg_handle_t handle)
+{
+    int ret = 0;
+    uint64_t msgs = 0;
+    uint64_t len = 0;
+    metasim_alltoall_in_t in;
+    metasim_alltoall_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_alltoall))
+        return;
+
+    margo_get_input(handle, &in);
+
+    __debug("[RPC ALLTOALL] received & forwarding rpc (size=%llu, "
+            "aggregate=%d, window=%d)", (unsigned long long) in.size,
+            in.aggregate, in.window);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    ret = alltoall_run(in.size, in.aggregate,
+                       in.window > 0 ? in.window : METASIM_A2A_WINDOW_DEFAULT,
+                       &msgs, &len);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+respond:
+    __debug("[RPC ALLTOALL] respoding rpc (ret=%d, msgs=%llu, len=%llu, "
+            "usec=%llu)", ret, (unsigned long long) msgs,
+            (unsigned long long) len, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.msgs = msgs;
+    out.len = len;
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_listener_handle_sumrepeat);
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_alltoall);
+
+/* element j of block b at rank r is (r + b + j), so that the result can be
+ * verified for each operator. */
+static int reduce_scatter_run(uint64_t count, int op, int algo,
+                              uint64_t *bytes, uint64_t *msgs)
+{
+    int ret = 0;
+    int b = 0;
+    int rank = metasim->rank;
+    int64_t nranks = metasim->nranks;
+    uint64_t j = 0;
+    int64_t expected = 0;
+    int64_t *vec = NULL;
+    int64_t *result = NULL;
+
+    /* the count comes from the client */
+    if (count > UINT64_MAX / sizeof(*vec) / nranks ||
+        count * nranks * sizeof(*vec) > METASIM_REDUCE_SCATTER_BYTES_MAX) {
+        __error("reduce-scatter count is too large (%llu for %lld servers)",
+                (unsigned long long) count, (long long) nranks);
+        return EINVAL;
+    }
+
+    vec = calloc(nranks * count, sizeof(*vec));
+    result = calloc(count, sizeof(*result));
+    if (!vec || !result) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    for (b = 0; b < nranks; b++)
+        for (j = 0; j < count; j++)
+            vec[b * count + j] = rank + b + j;
+
+    ret = metasim_rpc_reduce_scatter(op, algo, vec, count, result,
+                                     bytes, msgs);
+    if (ret)
+        goto out;
+
+    for (j = 0; j < count; j++) {
+        switch (op) {
+        case METASIM_REDUCE_SUM:
+            expected = nranks * (nranks - 1) / 2 + nranks * (rank + j);
+            break;
+        case METASIM_REDUCE_MIN:
+            expected = rank + j;
+            break;
+        default:
+            expected = nranks - 1 + rank + j;
+            break;
+        }
+
+        if (result[j] != expected) {
+            __error("reduce-scatter result mismatch at %llu (%lld != %lld)",
+                    (unsigned long long) j, (long long) result[j],
+                    (long long) expected);
+            ret = EIO;
+            break;
+        }
+    }
+
+out:
+    if (result)
+        free(result);
+    if (vec)
+        free(vec);
+
+    return ret;
+}
+
+static void metasim_listener_handle_reduce_scatter(hg_handle_t handle)
+{
+    int ret = 0;
+    uint64_t bytes = 0;
+    uint64_t msgs = 0;
+    metasim_reduce_scatter_in_t in;
+    metasim_reduce_scatter_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_reduce_scatter))
+        return;
+
+    margo_get_input(handle, &in);
+
+    __debug("[RPC REDUCE_SCATTER] received & forwarding rpc (count=%llu, "
+            "op=%d, algo=%d)", (unsigned long long) in.count, in.op, in.algo);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    ret = reduce_scatter_run(in.count, in.op, in.algo, &bytes, &msgs);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+respond:
+    __debug("[RPC REDUCE_SCATTER] respoding rpc (ret=%d, bytes=%llu, "
+            "msgs=%llu, usec=%llu)", ret, (unsigned long long) bytes,
+            (unsigned long long) msgs, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.bytes = bytes;
+    out.msgs = msgs;
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_reduce_scatter);
+
+static void metasim_listener_handle_gather(hg_handle_t handle)
+{
+    int ret = 0;
+    int32_t size = 0;
+    int32_t all = 0;
+    int32_t count = 0;
+    void *buf = NULL;
+    uint64_t len = 0;
+    metasim_record_iter_t rec;
+    metasim_gather_in_t in;
+    metasim_gather_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_gather))
+        return;
+
+    margo_get_input(handle, &in);
+    size = in.size;
+    all = in.all;
+
+    __debug("[RPC GATHER] received & forwarding rpc (size=%d, all=%d)",
+            size, all);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    /* the record size comes from the client */
+    if (size < 0 ||
+        (uint64_t) size * metasim->nranks > METASIM_GATHER_BYTES_MAX) {
+        ret = EINVAL;
+        listener_leave();
+        goto respond;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    if (all)
+        ret = metasim_rpc_invoke_allgather(METASIM_RECORD_TEST, size,
+                                           &buf, &len);
+    else
+        ret = metasim_rpc_invoke_gather(METASIM_RECORD_TEST, size,
+                                        &buf, &len);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    if (ret) {
+        __error("metasim_rpc_invoke_gather failed (ret=%d)", ret);
+    } else {
+        metasim_record_for_each(&rec, buf, len)
+            count++;
+
+        free(buf);
+    }
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+respond:
+    __debug("[RPC GATHER] respoding rpc (count=%d, len=%llu, usec=%llu)",
+            count, (unsigned long long) len, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.count = count;
+    out.len = len;
+    out.mem_peak = metasim_rpc_gather_mem_peak();
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_gather);
+
+static void metasim_listener_handle_bcast(hg_handle_t handle)
+{
+    int ret = 0;
+    uint64_t size = 0;
+    uint64_t segsize = 0;
+    int32_t degree = 0;
+    char *buf = NULL;
+    metasim_bcast_in_t in;
+    metasim_bcast_out_t out;
+    struct timespec start, stop;
+    uint64_t usec = 0;
+
+    print_margo_handler_pool_size(listener_mid);
+
+    if (listener_defer(handle, metasim_listener_handle_bcast))
+        return;
+
+    margo_get_input(handle, &in);
+    size = in.size;
+    segsize = in.segsize;
+    degree = in.degree;
+
+    __debug("[RPC BCAST] received & forwarding rpc "
+            "(size=%llu, segsize=%llu, degree=%d, tree=%d)",
+            (unsigned long long) size, (unsigned long long) segsize, degree,
+            in.tree);
+
+    ret = listener_admit();
+    if (ret)
+        goto respond;
+
+    /* the size and the degree come from the client */
+    if (size > METASIM_BCAST_BYTES_MAX || degree > METASIM_BCAST_DEGREE_MAX) {
+        ret = EINVAL;
+        listener_leave();
+        goto respond;
+    }
+
+    buf = malloc(size);
+    if (!buf) {
+        ret = ENOMEM;
+        listener_leave();
+        goto respond;
+    }
+
+    memset(buf, metasim->rank & 0xff, size);
+
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    ret = metasim_rpc_invoke_bcast(buf, size, segsize, degree, in.tree);
+
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    listener_leave();
+
+    if (ret)
+        __error("metasim_rpc_invoke_bcast failed (ret=%d)", ret);
+
+    usec = calculate_elapsed_usec(&start, &stop);
+
+    free(buf);
+
+respond:
+    __debug("[RPC BCAST] respoding rpc (ret=%d, usec=%llu)",
+            ret, (unsigned long long) usec);
+
+    out.ret = ret;
+    out.elapsed_usec = usec;
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_listener_handle_bcast);
 
 static void listener_register_rpc(margo_instance_id mid)
 {
-    MARGO_REGISTER(mid, "listener_init",
-                   metasim_init_in_t,
-                   metasim_init_out_t,
-                   metasim_listener_handle_init);
-
-    MARGO_REGISTER(mid, "listener_terminate",
-                   metasim_terminate_in_t,
-                   metasim_terminate_out_t,
-                   metasim_listener_handle_terminate);
-
-    MARGO_REGISTER(mid, "listener_echo",
-                   metasim_echo_in_t,
-                   metasim_echo_out_t,
-                   metasim_listener_handle_echo);
-
-    MARGO_REGISTER(mid, "listener_ping",
-                   metasim_ping_in_t,
-                   metasim_ping_out_t,
-                   metasim_listener_handle_ping);
-
-    MARGO_REGISTER(mid, "listener_sum",
-                   metasim_sum_in_t,
-                   metasim_sum_out_t,
-                   metasim_listener_handle_sum);
-
-    MARGO_REGISTER(mid, "listener_sumrepeat",
-                   metasim_sumrepeat_in_t,
-                   metasim_sumrepeat_out_t,
-                   metasim_listener_handle_sumrepeat);
+    METASIM_REGISTER(mid, "listener_init",
+                     metasim_init_in_t,
+                     metasim_init_out_t,
+                     metasim_listener_handle_init);
+
+    METASIM_REGISTER(mid, "listener_terminate",
+                     metasim_terminate_in_t,
+                     metasim_terminate_out_t,
+                     metasim_listener_handle_terminate);
+
+    METASIM_REGISTER(mid, "listener_peers",
+                     metasim_peers_in_t,
+                     metasim_peers_out_t,
+                     metasim_listener_handle_peers);
+
+    METASIM_REGISTER(mid, "listener_echo",
+                     metasim_echo_in_t,
+                     metasim_echo_out_t,
+                     metasim_listener_handle_echo);
+
+    METASIM_REGISTER(mid, "listener_ping",
+                     metasim_ping_in_t,
+                     metasim_ping_out_t,
+                     metasim_listener_handle_ping);
+
+    METASIM_REGISTER(mid, "listener_sum",
+                     metasim_sum_in_t,
+                     metasim_sum_out_t,
+                     metasim_listener_handle_sum);
+
+    METASIM_REGISTER(mid, "listener_sumrepeat",
+                     metasim_sumrepeat_in_t,
+                     metasim_sumrepeat_out_t,
+                     metasim_listener_handle_sumrepeat);
+
+    METASIM_REGISTER(mid, "listener_sum_batch",
+                     metasim_sum_batch_in_t,
+                     metasim_sum_batch_out_t,
+                     metasim_listener_handle_sum_batch);
+
+    METASIM_REGISTER(mid, "listener_exscan",
+                     metasim_exscan_in_t,
+                     metasim_exscan_out_t,
+                     metasim_listener_handle_exscan);
+
+    METASIM_REGISTER(mid, "listener_alltoall",
+                     metasim_alltoall_in_t,
+                     metasim_alltoall_out_t,
+                     metasim_listener_handle_alltoall);
+
+    METASIM_REGISTER(mid, "listener_reduce_scatter",
+                     metasim_reduce_scatter_in_t,
+                     metasim_reduce_scatter_out_t,
+                     metasim_listener_handle_reduce_scatter);
+
+    METASIM_REGISTER(mid, "listener_gather",
+                     metasim_gather_in_t,
+                     metasim_gather_out_t,
+                     metasim_listener_handle_gather);
+
+    METASIM_REGISTER(mid, "listener_bcast",
+                     metasim_bcast_in_t,
+                     metasim_bcast_out_t,
+                     metasim_listener_handle_bcast);
 }
 
-int metasim_listener_init(void)
+int metasim_listener_init(metasim_listener_conf_t *conf)
 {
     int ret = 0;
     char addrstr[512];
@@ -301,6 +1195,16 @@ int metasim_listener_init(void)
 
     __debug("launching listener");
 
+    if (conf)
+        listener_conf = *conf;
+
+    if (listener_conf.hwm > 0) {
+        __debug("listener admission control: hwm=%d, %s when busy",
+                listener_conf.hwm, listener_conf.reject ? "reject" : "delay");
+
+        ABT_mutex_create(&listener_admit_lock);
+    }
+
     mid = margo_init("na+sm://", MARGO_SERVER_MODE, 1,
                      listener_default_pool_size);
     if (mid == MARGO_INSTANCE_NULL) {
@@ -310,6 +1214,14 @@ int metasim_listener_init(void)
 
     __debug("listener margo initialized");
 
+    ret = metasim_poll_init(mid, &listener_conf.progress);
+    if (ret)
+        __error("failed to set the listener progress mode (ret=%d)", ret);
+
+    ret = metasim_diag_add(mid, "listener");
+    if (ret)
+        __error("failed to start the listener diagnostics (ret=%d)", ret);
+
     hret = margo_addr_self(mid, &addr);
     assert(hret == HG_SUCCESS);
 
@@ -318,6 +1230,12 @@ int metasim_listener_init(void)
 
     __debug("listener address: %s", addrstr);
 
+    ret = listener_init_peers();
+    if (ret) {
+        __error("failed to initialize the server peer table");
+        return ret;
+    }
+
     listener_register_rpc(mid);
 
     __debug("publishing the address (%s)", addrstr);
@@ -346,9 +1264,20 @@ int metasim_listener_init(void)
 int metasim_listener_exit(void)
 {
     int ret = 0;
+    int i = 0;
+
+    __debug("listener relayed %llu pings to servers",
+            (unsigned long long) listener_relayed);
 
     margo_finalize(listener_mid);
 
+    if (listener_peer_addrs) {
+        for (i = 0; i < metasim->nranks; i++)
+            free(listener_peer_addrs[i]);
+        free(listener_peer_addrs);
+        listener_peer_addrs = NULL;
+    }
+
     return ret;
 }
 
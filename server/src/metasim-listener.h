@@ -3,7 +3,17 @@
 
 #include <margo.h>
 
-int metasim_listener_init(void);
+#include "metasim-progress.h"
+
+struct metasim_listener_conf {
+    int hwm;        /* high-water mark of running handlers, 0 for unlimited */
+    int reject;     /* reject with EBUSY instead of delaying when busy */
+    metasim_progress_conf_t progress;   /* progress mode of the listener */
+};
+
+typedef struct metasim_listener_conf metasim_listener_conf_t;
+
+int metasim_listener_init(metasim_listener_conf_t *conf);
 
 int metasim_listener_exit(void);
 
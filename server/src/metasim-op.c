@@ -0,0 +1,346 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <margo.h>
+
+#include "metasim-server.h"
+#include "metasim-op.h"
+
+extern metasim_server_t *metasim;
+
+static const char *op_type_str[] = {
+    "sum", "gather", "allgather", "bcast",
+};
+
+static const char *op_state_str[] = {
+    "free", "queued", "running",
+};
+
+/* the table is indexed by a hash of the operation id, i.e., of both the root
+ * and the sequence number, with linear probing. a finished op leaves a
+ * tombstone, so that lookups can stop at the first free slot, and tombstones
+ * at the end of a probe chain are freed. we use a pthread mutex here instead
+ * of abt mutex, since the table is also dumped from the signal handling
+ * thread. */
+static metasim_op_t op_table[METASIM_OP_TABLE_SIZE];
+static pthread_mutex_t op_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static int op_table_count;
+
+static uint64_t op_seq;
+
+#define OP_STATE_DELETED    (-1)
+
+/* ops of the same sequence number from different roots would otherwise land
+ * in adjacent slots */
+static inline int op_hash(uint64_t opid)
+{
+    opid ^= opid >> 33;
+    opid *= 0xff51afd7ed558ccdULL;
+    opid ^= opid >> 33;
+
+    return (int) (opid % METASIM_OP_TABLE_SIZE);
+}
+
+/* admission of the collectives rooted at this server */
+static int op_max_inflight;
+static int op_inflight;
+static ABT_mutex op_admit_lock;
+static ABT_cond op_admit_cond;
+
+static inline uint64_t op_elapsed_usec(metasim_op_t *op)
+{
+    struct timespec now;
+    double ns = .0f;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    ns = (now.tv_sec*1e9 + now.tv_nsec) -
+         (op->start.tv_sec*1e9 + op->start.tv_nsec);
+
+    return (uint64_t) ns*1e-3;
+}
+
+int metasim_op_init(int max_inflight)
+{
+    int ret = 0;
+
+    op_max_inflight = max_inflight;
+
+    ret = ABT_mutex_create(&op_admit_lock);
+    if (ret != ABT_SUCCESS)
+        return ENOMEM;
+
+    ret = ABT_cond_create(&op_admit_cond);
+    if (ret != ABT_SUCCESS) {
+        ABT_mutex_free(&op_admit_lock);
+        return ENOMEM;
+    }
+
+    return 0;
+}
+
+void metasim_op_exit(void)
+{
+    ABT_cond_free(&op_admit_cond);
+    ABT_mutex_free(&op_admit_lock);
+}
+
+uint64_t metasim_op_new_id(void)
+{
+    uint64_t seq = __sync_fetch_and_add(&op_seq, 1);
+
+    return ((uint64_t) metasim->rank << 32) | (seq & 0xffffffff);
+}
+
+/* should be called with op_table_lock held */
+static metasim_op_t *op_table_find(uint64_t opid)
+{
+    int i = 0;
+    int pos = 0;
+    metasim_op_t *op = NULL;
+
+    for (i = 0; i < METASIM_OP_TABLE_SIZE; i++) {
+        pos = (op_hash(opid) + i) % METASIM_OP_TABLE_SIZE;
+
+        if (op_table[pos].state == METASIM_OP_STATE_FREE)
+            break;
+
+        if (op_table[pos].state != OP_STATE_DELETED &&
+            op_table[pos].opid == opid) {
+            op = &op_table[pos];
+            break;
+        }
+    }
+
+    return op;
+}
+
+/* with @shared set, an operation of @opid already in the table is returned
+ * instead, and it is removed once finished as many times as started */
+static metasim_op_t *op_table_insert(uint64_t opid, int32_t type,
+                                     int32_t root, int32_t state, int shared)
+{
+    int i = 0;
+    int pos = 0;
+    metasim_op_t *op = NULL;
+
+    pthread_mutex_lock(&op_table_lock);
+
+    if (shared) {
+        op = op_table_find(opid);
+        if (op) {
+            op->starts++;
+            pthread_mutex_unlock(&op_table_lock);
+            return op;
+        }
+    }
+
+    for (i = 0; i < METASIM_OP_TABLE_SIZE; i++) {
+        pos = (op_hash(opid) + i) % METASIM_OP_TABLE_SIZE;
+
+        if (op_table[pos].state == METASIM_OP_STATE_FREE ||
+            op_table[pos].state == OP_STATE_DELETED) {
+            op = &op_table[pos];
+            op->opid = opid;
+            op->type = type;
+            op->root = root;
+            op->state = state;
+            op->data = NULL;
+            op->refs = 0;
+            op->starts = 1;
+            clock_gettime(CLOCK_REALTIME, &op->start);
+
+            op_table_count++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&op_table_lock);
+
+    if (!op)
+        __error("in-flight table is full, operation %llu is not tracked",
+                (unsigned long long) opid);
+
+    return op;
+}
+
+metasim_op_t *metasim_op_begin(int32_t type, uint64_t *opid)
+{
+    metasim_op_t *op = NULL;
+    uint64_t _opid = metasim_op_new_id();
+
+    op = op_table_insert(_opid, type, metasim->rank, METASIM_OP_STATE_QUEUED,
+                         0);
+
+    if (op_max_inflight > 0) {
+        ABT_mutex_lock(op_admit_lock);
+        while (op_inflight >= op_max_inflight)
+            ABT_cond_wait(op_admit_cond, op_admit_lock);
+        op_inflight++;
+        ABT_mutex_unlock(op_admit_lock);
+    }
+
+    if (op) {
+        pthread_mutex_lock(&op_table_lock);
+        op->state = METASIM_OP_STATE_RUNNING;
+        pthread_mutex_unlock(&op_table_lock);
+
+        __debug("[OP %llu] %s started (queued %llu usec)",
+                (unsigned long long) _opid, op_type_str[type],
+                (unsigned long long) op_elapsed_usec(op));
+    }
+
+    *opid = _opid;
+
+    return op;
+}
+
+metasim_op_t *metasim_op_start(uint64_t opid, int32_t type, int32_t root)
+{
+    metasim_op_t *op = NULL;
+
+    /* an adopter may send the operation again to a server running it */
+    op = op_table_insert(opid, type, root, METASIM_OP_STATE_RUNNING, 1);
+    if (op)
+        __debug("[OP %llu] %s started (root=%d)",
+                (unsigned long long) opid, op_type_str[type], root);
+
+    return op;
+}
+
+metasim_op_t *metasim_op_lookup(uint64_t opid)
+{
+    metasim_op_t *op = NULL;
+
+    pthread_mutex_lock(&op_table_lock);
+    op = op_table_find(opid);
+    pthread_mutex_unlock(&op_table_lock);
+
+    return op;
+}
+
+void metasim_op_set_data(metasim_op_t *op, void *data)
+{
+    pthread_mutex_lock(&op_table_lock);
+    op->data = data;
+    pthread_mutex_unlock(&op_table_lock);
+
+    /* the holders got the data before it was cleared, and release it soon */
+    if (!data)
+        while (__sync_fetch_and_add(&op->refs, 0) > 0)
+            ABT_thread_yield();
+}
+
+void *metasim_op_get_data(uint64_t opid, metasim_op_t **op)
+{
+    void *data = NULL;
+    metasim_op_t *_op = NULL;
+
+    pthread_mutex_lock(&op_table_lock);
+
+    _op = op_table_find(opid);
+    if (_op && _op->data) {
+        __sync_fetch_and_add(&_op->refs, 1);
+        data = _op->data;
+    }
+
+    pthread_mutex_unlock(&op_table_lock);
+
+    *op = data ? _op : NULL;
+
+    return data;
+}
+
+void metasim_op_put_data(metasim_op_t *op)
+{
+    if (op)
+        __sync_fetch_and_sub(&op->refs, 1);
+}
+
+void metasim_op_finish(metasim_op_t *op)
+{
+    int i = 0;
+    int pos = 0;
+
+    if (!op)
+        return;
+
+    __debug("[OP %llu] %s finished (%llu usec)",
+            (unsigned long long) op->opid, op_type_str[op->type],
+            (unsigned long long) op_elapsed_usec(op));
+
+    pthread_mutex_lock(&op_table_lock);
+
+    if (--op->starts > 0) {
+        pthread_mutex_unlock(&op_table_lock);
+        return;
+    }
+
+    op->state = OP_STATE_DELETED;
+    op_table_count--;
+
+    /* no chain goes through the tombstones before a free slot */
+    pos = op - op_table;
+    if (op_table[(pos + 1) % METASIM_OP_TABLE_SIZE].state ==
+        METASIM_OP_STATE_FREE) {
+        for (i = 0; i < METASIM_OP_TABLE_SIZE; i++) {
+            if (op_table[pos].state != OP_STATE_DELETED)
+                break;
+
+            op_table[pos].state = METASIM_OP_STATE_FREE;
+            pos = (pos + METASIM_OP_TABLE_SIZE - 1) % METASIM_OP_TABLE_SIZE;
+        }
+    }
+
+    pthread_mutex_unlock(&op_table_lock);
+}
+
+void metasim_op_end(metasim_op_t *op)
+{
+    metasim_op_finish(op);
+
+    if (op_max_inflight > 0) {
+        ABT_mutex_lock(op_admit_lock);
+        op_inflight--;
+        ABT_cond_signal(op_admit_cond);
+        ABT_mutex_unlock(op_admit_lock);
+    }
+}
+
+void metasim_op_dump(FILE *fp)
+{
+    int i = 0;
+    metasim_op_t *op = NULL;
+
+    pthread_mutex_lock(&op_table_lock);
+
+    fprintf(fp, "## in-flight operations at rank %d: %d (max rooted=%d)\n",
+            metasim->rank, op_table_count, op_max_inflight);
+    fprintf(fp, "## opid,origin,type,root,state,elapsed_usec\n");
+
+    for (i = 0; i < METASIM_OP_TABLE_SIZE; i++) {
+        op = &op_table[i];
+        if (op->state == METASIM_OP_STATE_FREE ||
+            op->state == OP_STATE_DELETED)
+            continue;
+
+        fprintf(fp, "%llu,%u,%s,%d,%s,%llu\n",
+                (unsigned long long) op->opid, metasim_op_origin(op->opid),
+                op_type_str[op->type], op->root, op_state_str[op->state],
+                (unsigned long long) op_elapsed_usec(op));
+    }
+
+    pthread_mutex_unlock(&op_table_lock);
+
+    fflush(fp);
+}
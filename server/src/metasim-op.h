@@ -0,0 +1,90 @@
+#ifndef __METASIM_OP_H
+#define __METASIM_OP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* in-flight collective operations. every collective carries a globally unique
+ * operation id, and each server records the operations it participates in
+ * into a preallocated table. */
+
+#define METASIM_OP_TABLE_SIZE   1024
+
+enum {
+    METASIM_OP_SUM = 0,
+    METASIM_OP_GATHER,
+    METASIM_OP_ALLGATHER,
+    METASIM_OP_BCAST,
+    METASIM_OP_TYPE_MAX,
+};
+
+enum {
+    METASIM_OP_STATE_FREE = 0,
+    METASIM_OP_STATE_QUEUED,    /* waiting for a slot (root only) */
+    METASIM_OP_STATE_RUNNING,
+};
+
+struct metasim_op {
+    uint64_t opid;
+    int32_t type;
+    int32_t root;
+    int32_t state;
+    struct timespec start;
+    void *data;                 /* operation specific */
+    int32_t refs;               /* holders of data, see metasim_op_get_data */
+    int32_t starts;             /* metasim_op_start() calls not finished */
+};
+
+typedef struct metasim_op metasim_op_t;
+
+/* @max_inflight limits the number of collectives rooted at this server, 0 for
+ * unlimited */
+int metasim_op_init(int max_inflight);
+
+void metasim_op_exit(void);
+
+/* allocates a new globally unique operation id */
+uint64_t metasim_op_new_id(void);
+
+/* starts a new collective rooted at this server, and the new operation id is
+ * returned in @opid. this blocks the calling ult if there are already
+ * max_inflight collectives running. the returned op can be NULL if the table
+ * is full, in which case the operation is not tracked. */
+metasim_op_t *metasim_op_begin(int32_t type, uint64_t *opid);
+
+/* ends the collective started by metasim_op_begin(), and admits a queued
+ * operation if any */
+void metasim_op_end(metasim_op_t *op);
+
+/* records an operation rooted at other server. starting an operation that
+ * is already recorded returns the same op, which is removed after as many
+ * metasim_op_finish() calls. */
+metasim_op_t *metasim_op_start(uint64_t opid, int32_t type, int32_t root);
+
+/* removes the operation recorded by metasim_op_start() */
+void metasim_op_finish(metasim_op_t *op);
+
+/* finds the operation of @opid. returns NULL if not found. */
+metasim_op_t *metasim_op_lookup(uint64_t opid);
+
+/* sets the operation specific data of @op. clearing it (NULL) waits until
+ * all holders release the previous data, which can be freed afterwards. */
+void metasim_op_set_data(metasim_op_t *op, void *data);
+
+/* returns the data of the operation of @opid, which stays valid until
+ * released with metasim_op_put_data(@op). returns NULL if not found or the
+ * data is not set. */
+void *metasim_op_get_data(uint64_t opid, metasim_op_t **op);
+
+void metasim_op_put_data(metasim_op_t *op);
+
+/* dump all in-flight operations to @fp */
+void metasim_op_dump(FILE *fp);
+
+static inline uint32_t metasim_op_origin(uint64_t opid)
+{
+    return (uint32_t) (opid >> 32);
+}
+
+#endif /* __METASIM_OP_H */
@@ -0,0 +1,258 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <abt.h>
+
+#include "metasim-log.h"
+#include "metasim-perf.h"
+
+typedef struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} perf_counter_t;
+
+static perf_counter_t perf_counters[METASIM_PERF_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+      "context switches" },
+};
+
+/* counter group of an execution stream, opened by the stream itself on its
+ * first handler call, as the counters follow the calling thread */
+typedef struct {
+    int state;                  /* 0: not opened, 1: opened, -1: failed */
+    int leader;
+    int fds[METASIM_PERF_COUNTERS];     /* the leader and its members */
+    int nfds;
+} perf_group_t;
+
+int metasim_perf_enabled;
+
+static int perf_rank;
+static int perf_available[METASIM_PERF_COUNTERS];
+static int perf_navailable;
+static perf_group_t perf_groups[METASIM_PERF_MAX_ES];
+static metasim_perf_stat_t *perf_stats;
+
+static int perf_open(int counter, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_counters[counter].type;
+    attr.config = perf_counters[counter].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group < 0;
+
+    /* context switches only happen in the kernel */
+    if (attr.type == PERF_TYPE_HARDWARE) {
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+    }
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+int metasim_perf_init(int rank, int enabled)
+{
+    int i = 0;
+    int fd = 0;
+
+    perf_rank = rank;
+
+    if (!enabled)
+        return 0;
+
+    for (i = 0; i < METASIM_PERF_COUNTERS; i++) {
+        fd = perf_open(i, -1);
+        if (fd < 0) {
+            __error("%s cannot be counted (%s)", perf_counters[i].name,
+                    strerror(errno));
+            continue;
+        }
+
+        close(fd);
+        perf_available[i] = 1;
+        perf_navailable++;
+    }
+
+    if (!perf_navailable) {
+        __error("no counters are available, check perf_event_paranoid");
+        return ENOTSUP;
+    }
+
+    metasim_perf_enabled = 1;
+
+    return 0;
+}
+
+static perf_group_t *perf_group(int es)
+{
+    int i = 0;
+    int fd = 0;
+    perf_group_t *group = &perf_groups[es];
+
+    if (group->state)
+        return group->state > 0 ? group : NULL;
+
+    group->leader = -1;
+
+    for (i = 0; i < METASIM_PERF_COUNTERS; i++) {
+        if (!perf_available[i])
+            continue;
+
+        fd = perf_open(i, group->leader);
+        if (fd < 0) {
+            __error("failed to open %s counter on es %d (%s)",
+                    perf_counters[i].name, es, strerror(errno));
+
+            while (group->nfds > 0)
+                close(group->fds[--group->nfds]);
+            group->leader = -1;
+            group->state = -1;
+            return NULL;
+        }
+
+        group->fds[group->nfds++] = fd;
+        if (group->leader < 0)
+            group->leader = fd;
+    }
+
+    ioctl(group->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    group->state = 1;
+
+    return group;
+}
+
+void metasim_perf_read(metasim_perf_sample_t *sample)
+{
+    int i = 0;
+    int n = 0;
+    int es = 0;
+    perf_group_t *group = NULL;
+    uint64_t buf[1 + METASIM_PERF_COUNTERS];
+
+    sample->es = -1;
+
+    ABT_xstream_self_rank(&es);
+    if (es < 0 || es >= METASIM_PERF_MAX_ES)
+        return;
+
+    group = perf_group(es);
+    if (!group)
+        return;
+
+    /* with PERF_FORMAT_GROUP: nr, followed by the values in opening order */
+    if (read(group->leader, buf, sizeof(buf)) < 0 ||
+        buf[0] != (uint64_t) perf_navailable)
+        return;
+
+    for (i = 0; i < METASIM_PERF_COUNTERS; i++)
+        sample->value[i] = perf_available[i] ? buf[1 + n++] : 0;
+
+    sample->es = es;
+}
+
+/* handlers are listed on their first call */
+static void perf_list(metasim_perf_stat_t *stat)
+{
+    metasim_perf_stat_t *head = NULL;
+
+    if (!__sync_bool_compare_and_swap(&stat->listed, 0, 1))
+        return;
+
+    do {
+        head = perf_stats;
+        stat->next = head;
+    } while (!__sync_bool_compare_and_swap(&perf_stats, head, stat));
+}
+
+void metasim_perf_account(metasim_perf_stat_t *stat,
+                          metasim_perf_sample_t *start)
+{
+    int i = 0;
+    metasim_perf_sample_t end;
+
+    if (!stat->listed)
+        perf_list(stat);
+
+    __sync_fetch_and_add(&stat->calls, 1);
+
+    if (start->es < 0)
+        return;
+
+    metasim_perf_read(&end);
+    if (end.es != start->es) {
+        __sync_fetch_and_add(&stat->migrated, 1);
+        return;
+    }
+
+    for (i = 0; i < METASIM_PERF_COUNTERS; i++)
+        __sync_fetch_and_add(&stat->sum[i], end.value[i] - start->value[i]);
+
+    __sync_fetch_and_add(&stat->samples, 1);
+}
+
+static void print_average(FILE *fp, metasim_perf_stat_t *stat, int counter)
+{
+    if (!perf_available[counter] || !stat->samples) {
+        fprintf(fp, ",-");
+        return;
+    }
+
+    fprintf(fp, ",%.1lf", (double) stat->sum[counter] / stat->samples);
+}
+
+void metasim_perf_report(FILE *fp)
+{
+    metasim_perf_stat_t *stat = NULL;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+
+    if (!metasim_perf_enabled)
+        return;
+
+    fprintf(fp, "# perf,rank,handler,calls,samples,migrated,cycles,"
+            "instructions,ipc,cache misses,context switches (per call)\n");
+
+    for (stat = perf_stats; stat; stat = stat->next) {
+        fprintf(fp, "## perf,%d,%s,%llu,%llu,%llu", perf_rank, stat->name,
+                (unsigned long long) stat->calls,
+                (unsigned long long) stat->samples,
+                (unsigned long long) stat->migrated);
+
+        print_average(fp, stat, METASIM_PERF_CYCLES);
+        print_average(fp, stat, METASIM_PERF_INSTRUCTIONS);
+
+        cycles = stat->sum[METASIM_PERF_CYCLES];
+        instructions = stat->sum[METASIM_PERF_INSTRUCTIONS];
+        if (cycles && perf_available[METASIM_PERF_INSTRUCTIONS])
+            fprintf(fp, ",%.2lf", (double) instructions / cycles);
+        else
+            fprintf(fp, ",-");
+
+        print_average(fp, stat, METASIM_PERF_CACHE_MISSES);
+        print_average(fp, stat, METASIM_PERF_CONTEXT_SWITCHES);
+        fprintf(fp, "\n");
+    }
+
+    fflush(fp);
+}
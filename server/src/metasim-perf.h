@@ -0,0 +1,70 @@
+#ifndef __METASIM_PERF_H
+#define __METASIM_PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* hardware counters around rpc handlers (see metasim-handler.h), read with
+ * perf_event_open on the execution stream that runs the handler, and
+ * aggregated per handler.
+ *
+ * the counters follow the thread of the execution stream, so a handler that
+ * blocks is also charged for the ults that ran on the stream meanwhile, and a
+ * call that resumes on another stream cannot be measured, and is only
+ * counted as migrated. */
+
+#define METASIM_PERF_MAX_ES     64
+
+enum {
+    METASIM_PERF_CYCLES = 0,
+    METASIM_PERF_INSTRUCTIONS,
+    METASIM_PERF_CACHE_MISSES,
+    METASIM_PERF_CONTEXT_SWITCHES,
+    METASIM_PERF_COUNTERS,
+};
+
+/* per handler, defined statically by METASIM_DEFINE_RPC_HANDLER */
+typedef struct metasim_perf_stat {
+    const char *name;
+    struct metasim_perf_stat *next;
+    int listed;
+    uint64_t calls;
+    uint64_t samples;
+    uint64_t migrated;
+    uint64_t sum[METASIM_PERF_COUNTERS];
+} metasim_perf_stat_t;
+
+typedef struct {
+    int es;                     /* -1 if the counters could not be read */
+    uint64_t value[METASIM_PERF_COUNTERS];
+} metasim_perf_sample_t;
+
+extern int metasim_perf_enabled;
+
+/* probes which counters can be opened. without any, counting is disabled and
+ * an error is returned. */
+int metasim_perf_init(int rank, int enabled);
+
+void metasim_perf_read(metasim_perf_sample_t *sample);
+
+void metasim_perf_account(metasim_perf_stat_t *stat,
+                          metasim_perf_sample_t *start);
+
+static inline void metasim_perf_enter(metasim_perf_sample_t *sample)
+{
+    if (metasim_perf_enabled)
+        metasim_perf_read(sample);
+}
+
+static inline void metasim_perf_exit(metasim_perf_stat_t *stat,
+                                     metasim_perf_sample_t *start)
+{
+    if (metasim_perf_enabled)
+        metasim_perf_account(stat, start);
+}
+
+/* prints the per-call averages of each handler called so far as
+ * "## perf,..." lines */
+void metasim_perf_report(FILE *fp);
+
+#endif /* __METASIM_PERF_H */
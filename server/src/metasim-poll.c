@@ -0,0 +1,222 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <margo.h>
+
+#include "metasim-server.h"
+#include "metasim-poll.h"
+
+/* the hybrid mode counts the handlers in flight on each margo instance. the
+ * first handler switches progress to spinning, and once none has been in
+ * flight for the spin budget, progress blocks again. the monitor ult only
+ * wakes up on the transition to idle, to wait out the budget. */
+typedef struct {
+    margo_instance_id mid;
+    ABT_thread ult;
+    ABT_mutex lock;
+    ABT_cond idle;          /* signaled when no handler is in flight */
+    double budget;          /* spin budget in msec */
+    int inflight;
+    int spinning;
+    int stop;
+    uint64_t epoch;         /* bumped on every transition to busy */
+    uint64_t switches;
+} poll_monitor_t;
+
+/* the server, na+sm and listener instances */
+#define POLL_MONITOR_MAX 4
+
+static poll_monitor_t *poll_monitors[POLL_MONITOR_MAX];
+static int poll_monitor_count;
+
+static poll_monitor_t *poll_monitor_find(margo_instance_id mid)
+{
+    int i = 0;
+
+    for (i = 0; i < poll_monitor_count; i++)
+        if (poll_monitors[i]->mid == mid)
+            return poll_monitors[i];
+
+    return NULL;
+}
+
+/* should be called with m->lock held */
+static void poll_monitor_set(poll_monitor_t *m, int spin)
+{
+    if (m->spinning == spin)
+        return;
+
+    metasim_progress_set_timeout(m->mid,
+                                 spin ? 0 : METASIM_PROGRESS_TIMEOUT_DEFAULT);
+    m->spinning = spin;
+    m->switches++;
+}
+
+void metasim_poll_enter(margo_instance_id mid)
+{
+    poll_monitor_t *m = NULL;
+
+    if (!poll_monitor_count)
+        return;
+
+    m = poll_monitor_find(mid);
+    if (!m || __sync_fetch_and_add(&m->inflight, 1) > 0)
+        return;
+
+    ABT_mutex_lock(m->lock);
+    m->epoch++;
+    poll_monitor_set(m, 1);
+    ABT_mutex_unlock(m->lock);
+}
+
+void metasim_poll_leave(margo_instance_id mid)
+{
+    poll_monitor_t *m = NULL;
+
+    if (!poll_monitor_count)
+        return;
+
+    m = poll_monitor_find(mid);
+    if (!m || __sync_sub_and_fetch(&m->inflight, 1) > 0)
+        return;
+
+    ABT_mutex_lock(m->lock);
+    ABT_cond_signal(m->idle);
+    ABT_mutex_unlock(m->lock);
+}
+
+static void poll_monitor(void *arg)
+{
+    poll_monitor_t *m = (poll_monitor_t *) arg;
+    uint64_t epoch = 0;
+
+    while (1) {
+        ABT_mutex_lock(m->lock);
+        while (!m->stop && !(m->spinning && m->inflight == 0))
+            ABT_cond_wait(m->idle, m->lock);
+        epoch = m->epoch;
+        ABT_mutex_unlock(m->lock);
+
+        if (m->stop)
+            break;
+
+        margo_thread_sleep(m->mid, m->budget);
+
+        /* block unless a handler came in while sleeping */
+        ABT_mutex_lock(m->lock);
+        if (m->inflight == 0 && m->epoch == epoch)
+            poll_monitor_set(m, 0);
+        ABT_mutex_unlock(m->lock);
+    }
+
+    __debug("hybrid progress monitor stopped (%llu switches)",
+            (unsigned long long) m->switches);
+}
+
+static void poll_monitor_free(poll_monitor_t *m)
+{
+    if (m->idle != ABT_COND_NULL)
+        ABT_cond_free(&m->idle);
+    if (m->lock != ABT_MUTEX_NULL)
+        ABT_mutex_free(&m->lock);
+    free(m);
+}
+
+static void poll_monitor_stop(void *arg)
+{
+    poll_monitor_t *m = (poll_monitor_t *) arg;
+
+    ABT_mutex_lock(m->lock);
+    m->stop = 1;
+    ABT_cond_signal(m->idle);
+    ABT_mutex_unlock(m->lock);
+
+    ABT_thread_join(m->ult);
+    ABT_thread_free(&m->ult);
+
+    /* the handlers are done by now, keep the slot not to race with them */
+    m->mid = MARGO_INSTANCE_NULL;
+}
+
+static int poll_monitor_start(margo_instance_id mid, unsigned int spin_usec)
+{
+    int ret = 0;
+    ABT_pool pool = ABT_POOL_NULL;
+    poll_monitor_t *m = NULL;
+
+    if (poll_monitor_count == POLL_MONITOR_MAX)
+        return ENOSPC;
+
+    m = calloc(1, sizeof(*m));
+    if (!m)
+        return ENOMEM;
+
+    m->mid = mid;
+    m->budget = spin_usec * 1e-3;
+    m->lock = ABT_MUTEX_NULL;
+    m->idle = ABT_COND_NULL;
+
+    if (ABT_mutex_create(&m->lock) != ABT_SUCCESS ||
+        ABT_cond_create(&m->idle) != ABT_SUCCESS) {
+        poll_monitor_free(m);
+        return ENOMEM;
+    }
+
+    ret = margo_get_handler_pool(mid, &pool);
+    if (ret) {
+        poll_monitor_free(m);
+        return EIO;
+    }
+
+    ret = ABT_thread_create(pool, poll_monitor, m, ABT_THREAD_ATTR_NULL,
+                            &m->ult);
+    if (ret != ABT_SUCCESS) {
+        poll_monitor_free(m);
+        return EIO;
+    }
+
+    poll_monitors[poll_monitor_count++] = m;
+
+    margo_push_finalize_callback(mid, poll_monitor_stop, m);
+
+    return 0;
+}
+
+int metasim_poll_init(margo_instance_id mid, metasim_progress_conf_t *conf)
+{
+    __debug("progress mode: %s (spin budget=%u usec)",
+            metasim_progress_name(conf->mode), conf->spin_usec);
+
+    switch (conf->mode) {
+    case METASIM_PROGRESS_SPIN:
+        metasim_progress_set_timeout(mid, 0);
+        return 0;
+
+    case METASIM_PROGRESS_HYBRID:
+        return poll_monitor_start(mid, conf->spin_usec);
+
+    default:
+        return 0;
+    }
+}
+
+double metasim_poll_cpu_time(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru))
+        return .0f;
+
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
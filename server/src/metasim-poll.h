@@ -0,0 +1,22 @@
+#ifndef __METASIM_POLL_H
+#define __METASIM_POLL_H
+
+#include <margo.h>
+
+#include "metasim-progress.h"
+
+/* applies the progress mode in @conf to @mid. in hybrid mode, progress spins
+ * while handlers are in flight, and blocks after the spin budget without
+ * any. a ult waits out the budget, and stops when @mid is finalized. */
+int metasim_poll_init(margo_instance_id mid, metasim_progress_conf_t *conf);
+
+/* a handler on @mid starts and completes. these are called by the handler
+ * wrapper (metasim-handler.h), and do nothing unless @mid is hybrid. */
+void metasim_poll_enter(margo_instance_id mid);
+
+void metasim_poll_leave(margo_instance_id mid);
+
+/* cpu time (user + system) used by this process so far, in seconds */
+double metasim_poll_cpu_time(void);
+
+#endif /* __METASIM_POLL_H */
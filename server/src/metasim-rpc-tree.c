@@ -127,6 +127,169 @@ int metasim_rpc_tree_init(
     return 0;
 }
 
+/* maps a rank relative to the root into the mirrored numbering, and back */
+static inline int tree_mirror(int rel, int ranks)
+{
+    return rel == 0 ? 0 : ranks - rel;
+}
+
+/* rotates a rank relative to the root into the global rank */
+static inline int tree_rotate(int rel, int ranks, int root)
+{
+    rel += root;
+    if (rel >= ranks) {
+        rel -= ranks;
+    }
+    return rel;
+}
+
+/**
+ * @brief same as metasim_rpc_tree_init(), but non-root ranks are numbered in
+ * the reverse order. the interior nodes of a k-ary tree are the lowest ranks
+ * from the root, so the interior nodes of the mirrored tree are mostly the
+ * leaves of the original one.
+ *
+ * @param rank rank of calling process
+ * @param ranks number of ranks in tree
+ * @param root rank of root of tree
+ * @param k degree of k-ary tree
+ * @param t output tree structure
+ */
+int metasim_rpc_tree_init_mirror(
+    int rank,          /* rank of calling process */
+    int ranks,         /* number of ranks in tree */
+    int root,          /* rank of root of tree */
+    int k,             /* degree of k-ary tree */
+    metasim_rpc_tree_t* t) /* output tree structure */
+{
+    int i;
+    int rc;
+
+    /* build the tree rooted at 0 with the mirrored rank */
+    int rel = rank - root;
+    if (rel < 0) {
+        rel += ranks;
+    }
+
+    rc = metasim_rpc_tree_init(tree_mirror(rel, ranks), ranks, 0, k, t);
+    if (rc) {
+        return rc;
+    }
+
+    /* map neighbor ranks back to global ranks */
+    t->rank = rank;
+
+    if (t->parent_rank != -1) {
+        t->parent_rank = tree_rotate(tree_mirror(t->parent_rank, ranks),
+                                     ranks, root);
+    }
+
+    for (i = 0; i < t->child_count; i++) {
+        t->child_ranks[i] = tree_rotate(tree_mirror(t->child_ranks[i], ranks),
+                                        ranks, root);
+    }
+
+    return 0;
+}
+
+/* the head of the node of @r in a hierarchical tree. the root stands in for
+ * the node leader of its own node. */
+static inline int tree_node_head(int r, int root, const int *leaders)
+{
+    return leaders[r] == leaders[root] ? root : leaders[r];
+}
+
+/**
+ * @brief computes a two-level tree from the node map: the ranks on a node
+ * are direct children of the node head, and the node heads form a k-ary tree
+ * rooted at the node of @root. the node head is the node leader, except on
+ * the root node, where @root takes its place. every rank must pass the same
+ * @leaders array.
+ *
+ * @param rank rank of calling process
+ * @param ranks number of ranks in tree
+ * @param root rank of root of tree
+ * @param k degree of k-ary tree across the node heads
+ * @param leaders node leader (lowest rank on the node) of each rank
+ * @param t output tree structure
+ */
+int metasim_rpc_tree_init_hier(
+    int rank,          /* rank of calling process */
+    int ranks,         /* number of ranks in tree */
+    int root,          /* rank of root of tree */
+    int k,             /* degree of k-ary tree */
+    const int* leaders, /* node leader of each rank */
+    metasim_rpc_tree_t* t) /* output tree structure */
+{
+    int i;
+    int r;
+    int head = tree_node_head(rank, root, leaders);
+    int index = -1;
+    int nheads = 0;
+    int local = 0;
+    int* heads = NULL;
+
+    /* initialize fields */
+    t->rank        = rank;
+    t->ranks       = ranks;
+    t->parent_rank = -1;
+    t->child_count = 0;
+    t->child_ranks = NULL;
+
+    /* a rank other than the node head only talks to its head */
+    if (head != rank) {
+        t->parent_rank = head;
+        return 0;
+    }
+
+    /* list the node heads, starting from the root so that the root node is
+     * at index 0, and count the ranks on our node */
+    heads = (int*) malloc((size_t)ranks * sizeof(int));
+    if (heads == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < ranks; i++) {
+        r = tree_rotate(i, ranks, root);
+
+        if (tree_node_head(r, root, leaders) == r) {
+            if (r == rank) {
+                index = nheads;
+            }
+            heads[nheads++] = r;
+        } else if (tree_node_head(r, root, leaders) == rank) {
+            local++;
+        }
+    }
+
+    t->child_ranks = (int*) malloc((size_t)(k + local) * sizeof(int));
+    if (t->child_ranks == NULL) {
+        free(heads);
+        return ENOMEM;
+    }
+
+    if (index > 0) {
+        t->parent_rank = heads[(index - 1) / k];
+    }
+
+    /* children across the nodes first, so that the requests over the
+     * network are issued before the ones to the local ranks */
+    for (i = index * k + 1; i <= index * k + k && i < nheads; i++) {
+        t->child_ranks[t->child_count++] = heads[i];
+    }
+
+    for (i = 0; i < ranks && local > 0; i++) {
+        if (i != rank && tree_node_head(i, root, leaders) == rank) {
+            t->child_ranks[t->child_count++] = i;
+            local--;
+        }
+    }
+
+    free(heads);
+
+    return 0;
+}
+
 void metasim_rpc_tree_free(metasim_rpc_tree_t* t)
 {
     /* free child rank list */
@@ -20,6 +20,29 @@ int metasim_rpc_tree_init(
     metasim_rpc_tree_t* t /* output tree structure */
 );
 
+/* same as metasim_rpc_tree_init, but the non-root ranks are numbered in the
+ * reverse order. together with the original tree, this forms a double tree,
+ * where most of the leaves in one tree are interior nodes in the other. */
+int metasim_rpc_tree_init_mirror(
+    int rank,         /* rank of calling process */
+    int ranks,        /* number of ranks in tree */
+    int root,         /* rank of root process */
+    int k,            /* degree of k-ary tree */
+    metasim_rpc_tree_t* t /* output tree structure */
+);
+
+/* computes a two-level tree: the ranks on each node hang off a node head,
+ * and the node heads form a k-ary tree. @leaders is the node leader (lowest
+ * rank on the node) of each rank. */
+int metasim_rpc_tree_init_hier(
+    int rank,         /* rank of calling process */
+    int ranks,        /* number of ranks in tree */
+    int root,         /* rank of root process */
+    int k,            /* degree of k-ary tree across nodes */
+    const int* leaders, /* node leader of each rank */
+    metasim_rpc_tree_t* t /* output tree structure */
+);
+
 /* free resources allocated in metasim_rpc_tree_init */
 void metasim_rpc_tree_free(metasim_rpc_tree_t* t);
 
@@ -6,16 +6,40 @@
  */
 #include <config.h>
 
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <errno.h>
+#include <time.h>
 #include <margo.h>
 
+#include "metasim-peer.h"
 #include "metasim-server.h"
 #include "metasim-rpc.h"
+#include "metasim-inject.h"
+#include "metasim-timeline.h"
+#include "metasim-handler.h"
+#include "metasim-trace.h"
 #include "metasim-rpc-tree.h"
+#include "metasim-op.h"
 
 struct rpc_set {
     hg_id_t ping;
     hg_id_t sum;
+    hg_id_t gather;
+    hg_id_t gather_release;
+    hg_id_t gather_bcast;
+    hg_id_t barrier_arrive;
+    hg_id_t barrier_release;
+    hg_id_t barrier_dissem;
+    hg_id_t bcast_seg;
+    hg_id_t merge_request;
+    hg_id_t merge_reduce;
+    hg_id_t merge_result;
+    hg_id_t sum_down;
+    hg_id_t sum_up;
+    hg_id_t scan;
+    hg_id_t a2a;
 };
 
 typedef struct rpc_set rpc_set_t;
@@ -24,32 +48,255 @@ static rpc_set_t rpcset;
 
 extern metasim_server_t *metasim;
 
-MERCURY_GEN_PROC(metasim_ping_in_t,
-                 ((int32_t)(ping)));
-MERCURY_GEN_PROC(metasim_ping_out_t,
-                 ((int32_t)(pong)));
-DECLARE_MARGO_RPC_HANDLER(metasim_rpc_handle_ping);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_ping);
 
+/* length-prefixed opaque buffer, carried inline in rpc. the largest are the
+ * sum batches of METASIM_SUM_BATCH_MAX (metasim-common.h) int32_t seeds, the
+ * inline gather and all-to-all payloads are smaller. */
+typedef struct {
+    hg_size_t len;
+    void *data;
+} metasim_buf_t;
+
+#define METASIM_BUF_MAX (4096 * sizeof(int32_t))
+
+static hg_return_t hg_proc_metasim_buf_t(hg_proc_t proc, void *data)
+{
+    hg_return_t hret = HG_SUCCESS;
+    metasim_buf_t *buf = (metasim_buf_t *) data;
+
+    hret = hg_proc_hg_size_t(proc, &buf->len);
+    if (hret != HG_SUCCESS)
+        return hret;
+
+    /* the length comes from the wire when decoding */
+    if (buf->len > METASIM_BUF_MAX)
+        return HG_INVALID_ARG;
+
+    switch (hg_proc_get_op(proc)) {
+    case HG_ENCODE:
+        if (buf->len > 0)
+            hret = hg_proc_memcpy(proc, buf->data, buf->len);
+        break;
+
+    case HG_DECODE:
+        buf->data = NULL;
+        if (buf->len > 0) {
+            buf->data = malloc(buf->len);
+            if (!buf->data)
+                return HG_NOMEM;
+            hret = hg_proc_memcpy(proc, buf->data, buf->len);
+        }
+        break;
+
+    case HG_FREE:
+        if (buf->data) {
+            free(buf->data);
+            buf->data = NULL;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return hret;
+}
+
+/* seeds and sums are int32_t vectors of the same length, so that a single
+ * traversal of the tree carries a batch of independent sums. with a non-zero
+ * budget, a server responds within @budget_usec of receiving the request, and
+ * each tree level takes @slice_usec off the budget of its children. count is
+ * the number of servers that contributed to the sums. with @sampled set, the
+ * servers record trace events of the operation. */
+/* @sender is the server that sent the request, i.e., the parent or the
+ * adopting server (-1 at the root) */
 MERCURY_GEN_PROC(metasim_sum_in_t,
+                 ((uint64_t)(opid))
                  ((int32_t)(root))
-                 ((int32_t)(seed)));
+                 ((int32_t)(sender))
+                 ((int32_t)(sampled))
+                 ((uint64_t)(budget_usec))
+                 ((uint64_t)(slice_usec))
+                 ((metasim_buf_t)(seeds)));
 MERCURY_GEN_PROC(metasim_sum_out_t,
-                 ((int32_t)(sum)));
-DECLARE_MARGO_RPC_HANDLER(metasim_rpc_handle_sum);
+                 ((int32_t)(ret))
+                 ((int32_t)(count))
+                 ((metasim_buf_t)(sums)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_sum);
+
+/* one-way variant: sum_down carries metasim_sum_in_t to children, and each
+ * child reports the partial sums to its parent with sum_up. */
+MERCURY_GEN_PROC(metasim_sum_up_in_t,
+                 ((uint64_t)(opid))
+                 ((int32_t)(ret))
+                 ((metasim_buf_t)(sums)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_sum_down);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_sum_up);
+
+MERCURY_GEN_PROC(metasim_merge_in_t,
+                 ((uint64_t)(epoch)));
+MERCURY_GEN_PROC(metasim_merge_out_t,
+                 ((int32_t)(ret))
+                 ((int32_t)(value)));
+MERCURY_GEN_PROC(metasim_merge_result_in_t,
+                 ((uint64_t)(epoch))
+                 ((int32_t)(ret))
+                 ((int32_t)(value)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_merge_request);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_merge_reduce);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_merge_result);
+
+MERCURY_GEN_PROC(metasim_gather_in_t,
+                 ((uint64_t)(opid))
+                 ((int32_t)(root))
+                 ((int32_t)(kind))
+                 ((int32_t)(size)));
+MERCURY_GEN_PROC(metasim_gather_out_t,
+                 ((int32_t)(ret))
+                 ((int32_t)(count))
+                 ((hg_size_t)(len))
+                 ((hg_bulk_t)(bulk))
+                 ((metasim_buf_t)(inline_buf)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_gather);
+
+MERCURY_GEN_PROC(metasim_gather_release_in_t,
+                 ((uint64_t)(opid)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_gather_release);
+
+MERCURY_GEN_PROC(metasim_gather_bcast_in_t,
+                 ((uint64_t)(opid))
+                 ((int32_t)(root))
+                 ((int32_t)(kind))
+                 ((hg_size_t)(len))
+                 ((hg_bulk_t)(bulk)));
+MERCURY_GEN_PROC(metasim_gather_bcast_out_t,
+                 ((int32_t)(ret)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_gather_bcast);
+
+MERCURY_GEN_PROC(metasim_barrier_in_t,
+                 ((uint64_t)(epoch))
+                 ((int32_t)(round)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_barrier_arrive);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_barrier_release);
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_barrier_dissem);
+
+MERCURY_GEN_PROC(metasim_scan_in_t,
+                 ((uint64_t)(epoch))
+                 ((int32_t)(round))
+                 ((uint64_t)(value))
+                 ((int32_t)(ret)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_scan);
+
+MERCURY_GEN_PROC(metasim_a2a_in_t,
+                 ((uint64_t)(epoch))
+                 ((int32_t)(phase))
+                 ((int32_t)(src))
+                 ((hg_size_t)(len))
+                 ((hg_bulk_t)(bulk))
+                 ((metasim_buf_t)(inline_buf)));
+MERCURY_GEN_PROC(metasim_a2a_out_t,
+                 ((int32_t)(ret)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_a2a);
+
+MERCURY_GEN_PROC(metasim_bcast_seg_in_t,
+                 ((uint64_t)(opid))
+                 ((int32_t)(root))
+                 ((int32_t)(degree))
+                 ((int32_t)(tree))
+                 ((hg_size_t)(len))
+                 ((hg_size_t)(segsize))
+                 ((hg_size_t)(offset))
+                 ((hg_bulk_t)(bulk)));
+MERCURY_GEN_PROC(metasim_bcast_seg_out_t,
+                 ((int32_t)(ret)));
+METASIM_DECLARE_RPC_HANDLER(metasim_rpc_handle_bcast_seg);
 
 static metasim_rpc_tree_t bcast_tree;
 
+/* with tree_hier set, the tree collectives fan in to a leader on each node
+ * first, and only the node leaders talk to each other across the nodes */
+static int tree_hier;
+
+/* the tree as seen from @rank, e.g., to find the children of a peer */
+static int rpc_tree_init_rank(int rank, int root, int k, metasim_rpc_tree_t *t)
+{
+    if (tree_hier)
+        return metasim_rpc_tree_init_hier(rank, metasim->nranks,
+                                          root, k, metasim->node_leaders, t);
+    else
+        return metasim_rpc_tree_init(rank, metasim->nranks, root, k, t);
+}
+
+static int rpc_tree_init(int root, int k, metasim_rpc_tree_t *t)
+{
+    return rpc_tree_init_rank(metasim->rank, root, k, t);
+}
+
+/* rpcs that expose a single bulk buffer to several children stay on the
+ * fabric instance. the others go over na+sm to the servers on the same node,
+ * if enabled. */
+static int rpc_fabric_only(hg_id_t rpc)
+{
+    return rpc == rpcset.gather || rpc == rpcset.gather_bcast ||
+           rpc == rpcset.bcast_seg;
+}
+
+static margo_instance_id rpc_mid(hg_id_t rpc, int target)
+{
+    if (rpc_fabric_only(rpc))
+        return metasim->mid;
+    else
+        return metasim_get_rank_mid(metasim, target);
+}
+
+static hg_return_t rpc_create(hg_id_t rpc, int target, hg_handle_t *handle)
+{
+    hg_addr_t addr;
+
+    if (rpc_fabric_only(rpc))
+        addr = metasim->peer_addrs[target];
+    else
+        addr = metasim_get_rank_addr(metasim, target);
+
+    return margo_create(rpc_mid(rpc, target), addr, rpc, handle);
+}
+
 /*
  * rpc: ping
  */
+static uint64_t rpc_now_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* the absolute time @usec from now, for ABT_cond_timedwait */
+static void rpc_deadline(struct timespec *ts, uint64_t usec)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+
+    ts->tv_sec += usec / 1000000;
+    ts->tv_nsec += (usec % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
 static void metasim_rpc_handle_ping(hg_handle_t handle)
 {
     hg_return_t ret = HG_SUCCESS;
-    metasim_ping_in_t in;
-    metasim_ping_out_t out;
+    metasim_rpc_ping_in_t in;
+    metasim_rpc_ping_out_t out;
     int32_t ping = 0;
     int32_t pong = 0;
 
+    out.recv_usec = rpc_now_usec();
+
     __debug("received ping request");
 
     ret = margo_get_input(handle, &in);
@@ -65,6 +312,9 @@ static void metasim_rpc_handle_ping(hg_handle_t handle)
 
     __debug("responding (ping=%d, pong=%d)", ping, pong);
 
+    metasim_inject_delay(handle);
+    out.send_usec = rpc_now_usec();
+
     ret = margo_respond(handle, &out);
     if (ret != HG_SUCCESS)
         __error("margo_respond failed");
@@ -73,30 +323,30 @@ out:
     margo_free_input(handle, &in);
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_rpc_handle_ping)
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_ping)
 
 int metasim_rpc_invoke_ping(int32_t targetrank, int32_t ping, int32_t *pong)
 {
     int ret = 0;
     hg_handle_t handle = 0;
-    hg_addr_t addr;
-    metasim_ping_in_t in;
-    metasim_ping_out_t out;
+    metasim_rpc_ping_in_t in;
+    metasim_rpc_ping_out_t out;
     int32_t nranks = metasim->nranks;
 
     if (targetrank > nranks - 1)
         return EINVAL;
 
-    addr = metasim_get_rank_addr(metasim, targetrank);
     in.ping = ping;
 
-    hg_return_t hret = margo_create(metasim->mid, addr, rpcset.ping, &handle);
+    hg_return_t hret = rpc_create(rpcset.ping, targetrank, &handle);
     if (hret != HG_SUCCESS) {
         __error("failed to create margo instance");
         goto out;
     }
 
+    metasim_timeline_begin("forward_wait");
     hret = margo_forward(handle, &in);
+    metasim_timeline_end("forward_wait");
 
     margo_get_output(handle, &out);
     *pong = out.pong;
@@ -110,6 +360,58 @@ out:
     return ret;
 }
 
+/* a probe that takes longer is of no use for the estimate anyway, and rank 0
+ * may be gone at shutdown */
+#define CLOCK_PROBE_TIMEOUT_MSEC    1000
+
+int metasim_rpc_clock_probe(int32_t target, int64_t *offset, int64_t *rtt)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    metasim_rpc_ping_in_t in;
+    metasim_rpc_ping_out_t out;
+    int64_t t1, t2, t3, t4;
+
+    if (target < 0 || target >= metasim->nranks)
+        return EINVAL;
+
+    in.ping = metasim->rank;
+
+    hret = rpc_create(rpcset.ping, target, &handle);
+    if (hret != HG_SUCCESS)
+        return EIO;
+
+    t1 = rpc_now_usec();
+    metasim_timeline_begin("forward_wait");
+    hret = margo_forward_timed(handle, &in, CLOCK_PROBE_TIMEOUT_MSEC);
+    metasim_timeline_end("forward_wait");
+    t4 = rpc_now_usec();
+
+    if (hret != HG_SUCCESS) {
+        ret = hret == HG_TIMEOUT ? ETIMEDOUT : EIO;
+        goto out;
+    }
+
+    hret = margo_get_output(handle, &out);
+    if (hret != HG_SUCCESS) {
+        ret = EIO;
+        goto out;
+    }
+
+    t2 = out.recv_usec;
+    t3 = out.send_usec;
+
+    *offset = ((t2 - t1) + (t3 - t4)) / 2;
+    *rtt = (t4 - t1) - (t3 - t2);
+
+    margo_free_output(handle, &out);
+out:
+    margo_destroy(handle);
+
+    return ret;
+}
+
 /*
  * collective helpers
  */
@@ -123,9 +425,8 @@ static int corpc_get_handle(hg_id_t rpc, int target, corpc_req_t *creq)
 {
     int ret = 0;
     hg_return_t hret;
-    hg_addr_t addr = metasim_get_rank_addr(metasim, target);
 
-    hret = margo_create(metasim->mid, addr, rpc, &(creq->handle));
+    hret = rpc_create(rpc, target, &(creq->handle));
     if (hret != HG_SUCCESS) {
         __error("failed to create request (%p)", creq);
         ret = hret;
@@ -139,7 +440,9 @@ static int corpc_forward_request(void *in, corpc_req_t *creq)
     int ret = 0;
     hg_return_t hret;
 
+    metasim_timeline_begin("forward");
     hret = margo_iforward(creq->handle, in, &(creq->req));
+    metasim_timeline_end("forward");
     if (hret != HG_SUCCESS) {
         __error("failed to forward request (%p)", creq);
         ret = hret;
@@ -153,7 +456,9 @@ static int corpc_wait_request(corpc_req_t *creq)
     int ret = 0;
     hg_return_t hret;
 
+    metasim_timeline_begin("wait");
     hret = margo_wait(creq->req);
+    metasim_timeline_end("wait");
     if (hret != HG_SUCCESS) {
         __error("failed to wait for request (%p)", creq);
         ret = hret;
@@ -162,177 +467,3909 @@ static int corpc_wait_request(corpc_req_t *creq)
     return ret;
 }
 
+/* polling interval of timed waits in msec */
+#define CORPC_POLL_MSEC     0.05
+
+/* waits for @creq until @deadline (ABT_get_wtime), and cancels the request if
+ * it has not completed by then. a zero @deadline waits without a bound. */
+static int corpc_wait_request_until(corpc_req_t *creq, double deadline)
+{
+    int flag = 0;
+    hg_return_t hret;
+
+    if (deadline == 0)
+        return corpc_wait_request(creq);
+
+    metasim_timeline_begin("wait_until");
+
+    while (1) {
+        hret = margo_test(creq->req, &flag);
+        if (hret != HG_SUCCESS || flag) {
+            metasim_timeline_end("wait_until");
+            return corpc_wait_request(creq);
+        }
+
+        if (ABT_get_wtime() >= deadline)
+            break;
+
+        margo_thread_sleep(metasim->mid, CORPC_POLL_MSEC);
+    }
+
+    /* the callback still fires, with HG_CANCELED */
+    margo_cancel(creq->handle);
+    margo_wait(creq->req);
+    metasim_timeline_end("wait_until");
+
+    return ETIMEDOUT;
+}
+
 /*
- * sum rpc (broadcasting)
+ * merged sums
+ *
+ * with a merge window, concurrent rooted sums from different servers are
+ * satisfied by a single allreduce over the tree rooted at rank 0, instead of
+ * a tree traversal for each root. the reduced value (sum of ranks) does not
+ * depend on the seeds, so each root adjusts the result with its own seeds,
+ * i.e., sum = total + nranks * seed.
+ *
+ * a server with pending sums sends a one-way request towards rank 0, and
+ * each server forwards at most one request per epoch. rank 0 waits for the
+ * merge window to collect more requests, and then runs rounds of reduce and
+ * result, one at a time. the reduce closes the open epoch at each server, and
+ * the result wakes up all sums that joined the closed epoch.
  */
 
-static int sum_forward(metasim_rpc_tree_t *tree,
-                       metasim_sum_in_t *in, metasim_sum_out_t *out)
+static struct {
+    ABT_mutex lock;
+    ABT_cond cond;
+    double window;                  /* msec, 0 to disable */
+    metasim_rpc_tree_t tree;        /* tree rooted at rank 0 */
+    uint64_t epoch;                 /* open epoch */
+    int requested;                  /* request sent for the open epoch */
+    int running;                    /* rank 0 is running rounds */
+    uint64_t done;                  /* number of completed epochs */
+    int ret;                        /* result of the last completed epoch */
+    int32_t total;
+    uint64_t rounds;
+    uint64_t merged;                /* local sums satisfied by merging */
+} merge;
+
+/* forwards @in to all children in the merge tree, and returns the sum of
+ * values from the children in @value. */
+static int merge_forward(hg_id_t rpc, void *in, int32_t *value)
 {
     int ret = 0;
-    int i;
-    int32_t seed = 0;
-    int32_t partial_sum = 0;
+    int i = 0;
+    int issued = 0;
     int32_t sum = 0;
-    int child_count = tree->child_count;
-    int *child_ranks = tree->child_ranks;
+    int child_count = merge.tree.child_count;
+    int *child_ranks = merge.tree.child_ranks;
     corpc_req_t *req = NULL;
 
-    seed = in->seed;
-
-    if (child_count == 0) {
-        __debug("i have no child (sum=%d)", sum);
+    if (child_count == 0)
         goto out;
-    }
-
-    __debug("bcasting sum to %d children:", child_count);
 
-    for (i = 0; i < child_count; i++)
-        __debug("child[%d] = rank %d", i, child_ranks[i]);
-
-    /* forward requests to children in the rpc tree */
     req = calloc(child_count, sizeof(*req));
     if (!req) {
         __error("failed to allocate memory for corpc");
         return ENOMEM;
     }
 
-    for (i = 0; i < child_count; i++) {
-        corpc_req_t *r = &req[i];
-        int child = child_ranks[i];
+    for (issued = 0; issued < child_count; issued++) {
+        corpc_req_t *r = &req[issued];
 
-        ret = corpc_get_handle(rpcset.sum, child, r);
-        if (ret) {
-            __error("corpc_get_handle failed, abort rpc");
-            goto out;
-        }
+        ret = corpc_get_handle(rpc, child_ranks[issued], r);
+        if (ret)
+            break;
 
-        ret = corpc_forward_request((void *) in, r);
+        ret = corpc_forward_request(in, r);
         if (ret) {
-            __error("corpc_forward_request failed, abort rpc");
-            goto out;
+            margo_destroy(r->handle);
+            break;
         }
     }
 
-    /* collect results */
-    for (i = 0; i < child_count; i++) {
-        metasim_sum_out_t _out;
+    for (i = 0; i < issued; i++) {
+        metasim_merge_out_t out;
         corpc_req_t *r = &req[i];
 
-        ret = corpc_wait_request(r);
-        if (ret) {
-            __error("corpc_wait_request failed, abort rpc");
-            goto out;
+        if (corpc_wait_request(r) == 0 &&
+            margo_get_output(r->handle, &out) == HG_SUCCESS) {
+            if (out.ret)
+                ret = out.ret;
+            sum += out.value;
+            margo_free_output(r->handle, &out);
+        } else {
+            ret = EIO;
         }
 
-        /* TODO: check returns */
-        margo_get_output(r->handle, &_out);
-        partial_sum = _out.sum;
-        sum += partial_sum;
-
-        __debug("sum from child[%d] (rank=%d): %d (sum=%d)",
-                i, child_ranks[i], partial_sum, sum);
-
-        margo_free_output(r->handle, &_out);
         margo_destroy(r->handle);
     }
 
-out:
-    sum += metasim->rank + seed;
-    out->sum = sum;
+    free(req);
 
-    if (req)
-        free(req);
+out:
+    *value = sum;
 
     return ret;
 }
 
-static void metasim_rpc_handle_sum(hg_handle_t handle)
+static void merge_close(uint64_t epoch)
+{
+    ABT_mutex_lock(merge.lock);
+    if (merge.epoch == epoch) {
+        merge.epoch++;
+        merge.requested = 0;
+    }
+    ABT_mutex_unlock(merge.lock);
+}
+
+static void merge_complete(uint64_t epoch, int ret, int32_t total)
+{
+    ABT_mutex_lock(merge.lock);
+    merge.done = epoch + 1;
+    merge.ret = ret;
+    merge.total = total;
+    ABT_cond_broadcast(merge.cond);
+    ABT_mutex_unlock(merge.lock);
+}
+
+static int merge_round(uint64_t epoch)
 {
     int ret = 0;
+    int32_t total = 0;
+    metasim_merge_in_t in;
+    metasim_merge_result_in_t result;
+
+    in.epoch = epoch;
+
+    merge_close(epoch);
+
+    ret = merge_forward(rpcset.merge_reduce, &in, &total);
+    total += metasim->rank;
+
+    __debug("merged sum round (epoch=%llu, ret=%d, total=%d)",
+            (unsigned long long) epoch, ret, total);
+
+    result.epoch = epoch;
+    result.ret = ret;
+    result.value = total;
+
+    ret = merge_forward(rpcset.merge_result, &result, &total);
+    merge_complete(epoch, result.ret, result.value);
+
+    /* read by metasim_rpc_merge_stats() under the lock */
+    ABT_mutex_lock(merge.lock);
+    merge.rounds++;
+    ABT_mutex_unlock(merge.lock);
+
+    return ret;
+}
+
+/* runs on rank 0, until no more requests are pending */
+static void merge_run(void)
+{
+    uint64_t epoch = 0;
+
+    margo_thread_sleep(metasim->mid, merge.window);
+
+    ABT_mutex_lock(merge.lock);
+    while (merge.requested) {
+        epoch = merge.epoch;
+        ABT_mutex_unlock(merge.lock);
+
+        merge_round(epoch);
+
+        ABT_mutex_lock(merge.lock);
+    }
+    merge.running = 0;
+    ABT_mutex_unlock(merge.lock);
+}
+
+static void merge_request(uint64_t epoch)
+{
+    int send = 0;
+    int run = 0;
     hg_return_t hret;
-    metasim_rpc_tree_t tree;
-    metasim_sum_in_t in;
-    metasim_sum_out_t out;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    metasim_merge_in_t in;
 
-    __debug("sum rpc handler");
-    print_margo_handler_pool_info(metasim->mid);
+    ABT_mutex_lock(merge.lock);
+    if (epoch == merge.epoch && !merge.requested) {
+        merge.requested = 1;
 
-    hret = margo_get_input(handle, &in);
-    if (hret != HG_SUCCESS) {
-        __error("margo_get_input failed");
+        if (merge.tree.parent_rank >= 0)
+            send = 1;
+        else if (!merge.running)
+            run = merge.running = 1;
+    }
+    ABT_mutex_unlock(merge.lock);
+
+    if (run) {
+        merge_run();
         return;
     }
 
-    /* TODO: check returns */
-    metasim_rpc_tree_init(metasim->rank, metasim->nranks, in.root, 2, &tree);
+    if (!send)
+        return;
 
-    ret = sum_forward(&tree, &in, &out);
-    if (ret)
-        __error("sum_forward failed");
+    in.epoch = epoch;
 
-    metasim_rpc_tree_free(&tree);
-    margo_free_input(handle, &in);
+    hret = rpc_create(rpcset.merge_request, merge.tree.parent_rank, &handle);
+    if (hret != HG_SUCCESS) {
+        __error("failed to create merge request");
+        return;
+    }
 
-    margo_respond(handle, &out);
+    metasim_timeline_begin("forward_wait");
+    hret = margo_forward(handle, &in);
+    metasim_timeline_end("forward_wait");
+    if (hret != HG_SUCCESS)
+        __error("failed to forward merge request");
 
     margo_destroy(handle);
 }
-DEFINE_MARGO_RPC_HANDLER(metasim_rpc_handle_sum)
 
-int metasim_rpc_invoke_sum(int32_t seed, int32_t *sum)
+static int merge_sum(int32_t count, int32_t *seeds, int32_t *sums)
 {
     int ret = 0;
-    int32_t _sum = 0;
-    //metasim_rpc_tree_t tree;
-    metasim_sum_in_t in;
-    metasim_sum_out_t out;
+    int32_t i = 0;
+    int32_t total = 0;
+    uint64_t epoch = 0;
 
-#if 0
-    ret = metasim_rpc_tree_init(metasim->rank, metasim->nranks, metasim->rank,
-                                2, &tree);
-    if (ret) {
-        __error("failed to initialize the rpc tree (ret=%d)", ret);
+    ABT_mutex_lock(merge.lock);
+    epoch = merge.epoch;
+    merge.merged++;
+    ABT_mutex_unlock(merge.lock);
+
+    merge_request(epoch);
+
+    /* a later epoch may have completed in the meantime, which carries the
+     * same contributions. */
+    ABT_mutex_lock(merge.lock);
+    while (merge.done <= epoch)
+        ABT_cond_wait(merge.cond, merge.lock);
+    ret = merge.ret;
+    total = merge.total;
+    ABT_mutex_unlock(merge.lock);
+
+    if (ret)
         return ret;
+
+    for (i = 0; i < count; i++)
+        sums[i] = total + metasim->nranks * seeds[i];
+
+    return 0;
+}
+
+static void metasim_rpc_handle_merge_request(hg_handle_t handle)
+{
+    hg_return_t hret;
+    metasim_merge_in_t in;
+
+    metasim_inject_delay(handle);
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
     }
-#endif
 
-    in.root = metasim->rank;
-    in.seed = seed;
+    merge_request(in.epoch);
 
-    ret = sum_forward(&bcast_tree, &in, &out);
-    if (ret) {
-        __error("sum_forward failed (ret=%d)", ret);
-    } else {
-       _sum = out.sum;
-       __debug("rpc sum final result = %d", _sum);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_merge_request)
+
+static void metasim_rpc_handle_merge_reduce(hg_handle_t handle)
+{
+    int ret = 0;
+    int32_t value = 0;
+    hg_return_t hret;
+    metasim_merge_in_t in;
+    metasim_merge_out_t out;
 
-       *sum = _sum;
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
     }
 
-    //metasim_rpc_tree_free(&tree);
+    merge_close(in.epoch);
 
-    return ret;
+    ret = merge_forward(rpcset.merge_reduce, &in, &value);
+
+    out.ret = ret;
+    out.value = value + metasim->rank;
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
 }
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_merge_reduce)
 
-/*
- * rpc: sum
- */
+static void metasim_rpc_handle_merge_result(hg_handle_t handle)
+{
+    int32_t value = 0;
+    hg_return_t hret;
+    metasim_merge_result_in_t in;
+    metasim_merge_out_t out;
 
-void metasim_rpc_register(void)
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    out.ret = merge_forward(rpcset.merge_result, &in, &value);
+    out.value = 0;
+
+    merge_complete(in.epoch, in.ret, in.value);
+
+    metasim_inject_respond(handle, &out);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_merge_result)
+
+void metasim_rpc_set_merge_window(uint64_t usec)
 {
-    rpcset.ping =
-        MARGO_REGISTER(metasim->mid, "metasim_rpc_ping",
-                       metasim_ping_in_t,
-                       metasim_ping_out_t,
-                       metasim_rpc_handle_ping);
-    rpcset.sum =
-        MARGO_REGISTER(metasim->mid, "metasim_rpc_sum",
-                       metasim_sum_in_t,
-                       metasim_sum_out_t,
-                       metasim_rpc_handle_sum);
+    merge.window = usec * 1e-3;
+}
 
-    metasim_rpc_tree_init(metasim->rank, metasim->nranks, metasim->rank,
-                          2, &bcast_tree);
+void metasim_rpc_merge_stats(uint64_t *rounds, uint64_t *merged)
+{
+    ABT_mutex_lock(merge.lock);
+    *rounds = merge.rounds;
+    *merged = merge.merged;
+    ABT_mutex_unlock(merge.lock);
 }
 
+/*
+ * sum rpc (broadcasting)
+ *
+ * the request carries a vector of seeds, and each element is reduced
+ * independently, i.e., sums[i] = sum(rank + seeds[i]) over all ranks.
+ */
+
+static int sum_noreply;
+
+/* messages sent and received by this server for sums, including responses */
+static uint64_t sum_msg_sent;
+static uint64_t sum_msg_received;
+
+static inline void sum_msg_count(uint64_t *counter)
+{
+    __sync_fetch_and_add(counter, 1);
+}
+
+/* per-op deadline of rooted sums in usec, 0 to wait for all servers */
+static uint64_t sum_timeout;
+
+/* forwards @in to the servers in @ranks. the requests that could not be sent
+ * are left with a null handle. */
+static void sum_issue(metasim_sum_in_t *in, int *ranks, int n,
+                      corpc_req_t *req)
+{
+    int i;
+
+    in->sender = metasim->rank;
+
+    for (i = 0; i < n; i++) {
+        corpc_req_t *r = &req[i];
+
+        r->handle = HG_HANDLE_NULL;
+
+        if (corpc_get_handle(rpcset.sum, ranks[i], r)) {
+            r->handle = HG_HANDLE_NULL;
+            continue;
+        }
+
+        if (corpc_forward_request((void *) in, r)) {
+            margo_destroy(r->handle);
+            r->handle = HG_HANDLE_NULL;
+            continue;
+        }
+
+        metasim_trace(in->sampled, in->opid, METASIM_TRACE_FORWARD, ranks[i]);
+        sum_msg_count(&sum_msg_sent);
+    }
+}
+
+/* adds up the partial sums of the requests issued by sum_issue, waiting for
+ * each until @deadline. without a deadline, any failure aborts the sum.
+ * otherwise, the servers that failed or missed the deadline are marked in
+ * @lost, and left out. @contributors is incremented by the number of servers
+ * counted in @sums. */
+static int sum_collect(metasim_sum_in_t *in, corpc_req_t *req, int *ranks,
+                       int n, double deadline, int32_t count, int32_t *sums,
+                       int32_t *contributors, int *lost)
+{
+    int ret = 0;
+    int rc = 0;
+    int i;
+    int32_t k;
+    int32_t *partial_sums = NULL;
+
+    for (i = 0; i < n; i++) {
+        metasim_sum_out_t _out;
+        corpc_req_t *r = &req[i];
+
+        lost[i] = 1;
+
+        if (r->handle == HG_HANDLE_NULL) {
+            if (!deadline)
+                ret = EIO;
+            continue;
+        }
+
+        rc = corpc_wait_request_until(r, deadline);
+        if (rc) {
+            __error("no sum from rank %d (%s)", ranks[i],
+                    rc == ETIMEDOUT ? "timed out" : "failed");
+            if (!deadline)
+                ret = rc;
+            margo_destroy(r->handle);
+            continue;
+        }
+
+        metasim_trace(in->sampled, in->opid, METASIM_TRACE_CHILD_DONE,
+                      ranks[i]);
+
+        /* TODO: check returns */
+        margo_get_output(r->handle, &_out);
+        sum_msg_count(&sum_msg_received);
+
+        if (_out.ret || _out.sums.len != count * sizeof(int32_t)) {
+            __error("invalid sum from rank %d (ret=%d)", ranks[i], _out.ret);
+            if (!deadline)
+                ret = _out.ret ? _out.ret : EIO;
+        } else {
+            partial_sums = (int32_t *) _out.sums.data;
+            for (k = 0; k < count; k++)
+                sums[k] += partial_sums[k];
+
+            *contributors += _out.count;
+            lost[i] = 0;
+
+            __debug("sum from rank %d: %d (sum[0]=%d, count=%d)",
+                    ranks[i], partial_sums[0], sums[0], _out.count);
+        }
+
+        margo_free_output(r->handle, &_out);
+        margo_destroy(r->handle);
+    }
+
+    return ret;
+}
+
+/* reroutes around the children marked in @lost, by asking their children
+ * directly. the adopted servers only get enough budget to report their own
+ * seeds, and respond before the deadline of this server. */
+static int sum_adopt(metasim_rpc_tree_t *tree, int *lost,
+                     metasim_sum_in_t *in, double start,
+                     int32_t count, int32_t *sums, int32_t *contributors)
+{
+    int ret = 0;
+    int i;
+    int j;
+    int n = 0;
+    int lost_count = 0;
+    int *orphans = NULL;
+    int *orphans_lost = NULL;
+    int32_t adopted = 0;
+    corpc_req_t *req = NULL;
+    metasim_rpc_tree_t child_tree;
+    metasim_sum_in_t orphan_in = *in;
+    double deadline = start + (in->budget_usec - in->slice_usec / 4) * 1e-6;
+
+    for (i = 0; i < tree->child_count; i++)
+        lost_count += lost[i];
+
+    if (lost_count == 0)
+        return 0;
+
+    /* grandchildren of all lost children are fewer than the ranks */
+    orphans = calloc(2 * metasim->nranks, sizeof(*orphans));
+    req = calloc(metasim->nranks, sizeof(*req));
+    if (!orphans || !req) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    orphans_lost = &orphans[metasim->nranks];
+
+    for (i = 0; i < tree->child_count; i++) {
+        if (!lost[i])
+            continue;
+
+        /* its subtree is left out of the partial sum */
+        if (rpc_tree_init_rank(tree->child_ranks[i], in->root, 2,
+                               &child_tree)) {
+            __error("failed to find the children of lost rank %d",
+                    tree->child_ranks[i]);
+            continue;
+        }
+
+        for (j = 0; j < child_tree.child_count; j++)
+            orphans[n++] = child_tree.child_ranks[j];
+        metasim_rpc_tree_free(&child_tree);
+    }
+
+    if (n == 0)
+        goto out;
+
+    orphan_in.budget_usec = in->slice_usec / 2;
+
+    sum_issue(&orphan_in, orphans, n, req);
+    sum_collect(&orphan_in, req, orphans, n, deadline, count, sums, &adopted,
+                orphans_lost);
+
+    *contributors += adopted;
+
+out:
+    if (ret)
+        __error("failed to adopt grandchildren of %d lost children "
+                "(opid=%llu, ret=%d)", lost_count,
+                (unsigned long long) in->opid, ret);
+    else
+        __debug("%d children lost, adopted %d of %d grandchildren "
+                "(opid=%llu)", lost_count, adopted, n,
+                (unsigned long long) in->opid);
+
+    if (req)
+        free(req);
+    if (orphans)
+        free(orphans);
+
+    return ret;
+}
+
+static int sum_forward(metasim_rpc_tree_t *tree,
+                       metasim_sum_in_t *in, metasim_sum_out_t *out)
+{
+    int ret = 0;
+    int i;
+    int32_t k;
+    int32_t count = 0;
+    int32_t contributors = 1;
+    int32_t *seeds = NULL;
+    int32_t *sums = NULL;
+    int child_count = tree->child_count;
+    int *child_ranks = tree->child_ranks;
+    int *lost = NULL;
+    corpc_req_t *req = NULL;
+    metasim_sum_in_t child_in = *in;
+    double start = ABT_get_wtime();
+    double deadline = 0;
+
+    count = in->seeds.len / sizeof(int32_t);
+    seeds = (int32_t *) in->seeds.data;
+
+    sums = calloc(count, sizeof(*sums));
+    if (!sums) {
+        __error("failed to allocate memory for sums");
+        ret = ENOMEM;
+        goto out;
+    }
+
+    if (child_count == 0) {
+        __debug("i have no child (count=%d)", count);
+        goto out;
+    }
+
+    /* children get a slice less, and respond a quarter of a slice before the
+     * deadline of this server, which leaves half a slice for adopting the
+     * children of those that did not. */
+    if (in->budget_usec) {
+        if (in->budget_usec <= in->slice_usec) {
+            __debug("no budget left to forward the sum (budget=%llu usec)",
+                    (unsigned long long) in->budget_usec);
+            goto out;
+        }
+
+        child_in.budget_usec = in->budget_usec - in->slice_usec;
+        deadline = start +
+                   (in->budget_usec - in->slice_usec * 3 / 4) * 1e-6;
+    }
+
+    __debug("bcasting sum to %d children (count=%d):", child_count, count);
+
+    for (i = 0; i < child_count; i++)
+        __debug("child[%d] = rank %d", i, child_ranks[i]);
+
+    /* forward requests to children in the rpc tree */
+    req = calloc(child_count, sizeof(*req));
+    lost = calloc(child_count, sizeof(*lost));
+    if (!req || !lost) {
+        __error("failed to allocate memory for corpc");
+        ret = ENOMEM;
+        goto out;
+    }
+
+    sum_issue(&child_in, child_ranks, child_count, req);
+
+    /* collect results */
+    ret = sum_collect(&child_in, req, child_ranks, child_count, deadline,
+                      count, sums, &contributors, lost);
+    if (ret) {
+        __error("failed to collect sums from children, abort rpc");
+        goto out;
+    }
+
+    if (deadline)
+        ret = sum_adopt(tree, lost, in, start, count, sums, &contributors);
+
+out:
+    if (sums) {
+        for (k = 0; k < count; k++)
+            sums[k] += metasim->rank + seeds[k];
+    }
+
+    out->ret = ret;
+    out->count = contributors;
+    out->sums.len = sums ? count * sizeof(int32_t) : 0;
+    out->sums.data = sums;
+
+    if (lost)
+        free(lost);
+    if (req)
+        free(req);
+
+    return ret;
+}
+
+static void metasim_rpc_handle_sum(hg_handle_t handle)
+{
+    int ret = 0;
+    hg_return_t hret;
+    metasim_rpc_tree_t tree;
+    metasim_sum_in_t in;
+    metasim_sum_out_t out;
+    metasim_op_t *op = NULL;
+
+    __debug("sum rpc handler");
+    print_margo_handler_pool_info(metasim->mid);
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        return;
+    }
+
+    sum_msg_count(&sum_msg_received);
+
+    op = metasim_op_start(in.opid, METASIM_OP_SUM, in.root);
+
+    /* TODO: check returns */
+    rpc_tree_init(in.root, 2, &tree);
+
+    /* an adopted server gets the request from the adopter, not the parent */
+    metasim_trace(in.sampled, in.opid, METASIM_TRACE_RECV, in.sender);
+
+    ret = sum_forward(&tree, &in, &out);
+    if (ret)
+        __error("sum_forward failed (opid=%llu)", (unsigned long long) in.opid);
+
+    /* the injected delay counts as the service time of this server */
+    metasim_inject_delay(handle);
+    metasim_trace(in.sampled, in.opid, METASIM_TRACE_RESPOND, in.sender);
+
+    metasim_rpc_tree_free(&tree);
+
+    /* only the parent waiting with a deadline survives a dropped response */
+    if (!(in.budget_usec > 0 && metasim_inject_drop()))
+        margo_respond(handle, &out);
+    sum_msg_count(&sum_msg_sent);
+
+    metasim_op_finish(op);
+
+    if (out.sums.data)
+        free(out.sums.data);
+
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_sum)
+
+/*
+ * one-way sum
+ *
+ * instead of holding a response for each hop, the request is forwarded to
+ * children as a one-way rpc, and children report their partial sums back with
+ * another one-way rpc. the reports are matched with the waiting operation
+ * through the in-flight operation table.
+ */
+
+/* without --op-timeout, a parent gives up on the children that have not
+ * reported by then, e.g., if a child failed to decode the request */
+#define SUM_NOREPLY_WAIT_USEC   (10 * 1000000ULL)
+
+typedef struct {
+    ABT_mutex lock;
+    ABT_cond cond;
+    int pending;                /* children not reported yet */
+    int ret;
+    int32_t count;
+    int32_t *sums;
+} sum_wait_t;
+
+/* forwards @in to children over @tree, and waits for their reports. @sums
+ * should be zeroed by the caller. on return, @sums contains the sums of the
+ * subtree including this server. */
+static int sum_noreply_forward(metasim_rpc_tree_t *tree, metasim_op_t *op,
+                               metasim_sum_in_t *in, int32_t *sums)
+{
+    int ret = 0;
+    int i = 0;
+    int issued = 0;
+    int32_t k = 0;
+    int32_t count = in->seeds.len / sizeof(int32_t);
+    int32_t *seeds = (int32_t *) in->seeds.data;
+    int child_count = tree->child_count;
+    uint64_t wait_usec = sum_timeout ? sum_timeout : SUM_NOREPLY_WAIT_USEC;
+    struct timespec deadline;
+    corpc_req_t *req = NULL;
+    sum_wait_t wait;
+
+    if (child_count == 0)
+        goto out;
+
+    req = calloc(child_count, sizeof(*req));
+    if (!req) {
+        __error("failed to allocate memory for corpc");
+        ret = ENOMEM;
+        goto out;
+    }
+
+    memset(&wait, 0, sizeof(wait));
+    ABT_mutex_create(&wait.lock);
+    ABT_cond_create(&wait.cond);
+    wait.pending = child_count;
+    wait.count = count;
+    wait.sums = sums;
+
+    rpc_deadline(&deadline, wait_usec);
+
+    /* children may report as soon as the requests are sent */
+    metasim_op_set_data(op, &wait);
+
+    in->sender = metasim->rank;
+
+    for (issued = 0; issued < child_count; issued++) {
+        corpc_req_t *r = &req[issued];
+
+        ret = corpc_get_handle(rpcset.sum_down, tree->child_ranks[issued], r);
+        if (ret)
+            break;
+
+        ret = corpc_forward_request((void *) in, r);
+        if (ret) {
+            margo_destroy(r->handle);
+            break;
+        }
+    }
+
+    for (i = 0; i < issued; i++) {
+        corpc_wait_request(&req[i]);
+        margo_destroy(req[i].handle);
+        sum_msg_count(&sum_msg_sent);
+    }
+
+    ABT_mutex_lock(wait.lock);
+    if (issued < child_count) {
+        __error("failed to forward sum to %d children",
+                child_count - issued);
+        wait.pending -= child_count - issued;
+        wait.ret = EIO;
+    }
+    while (wait.pending > 0) {
+        if (ABT_cond_timedwait(wait.cond, wait.lock, &deadline) ==
+            ABT_ERR_COND_TIMEDOUT) {
+            __error("%d children did not report sum (opid=%llu)",
+                    wait.pending, (unsigned long long) in->opid);
+            wait.ret = ETIMEDOUT;
+            break;
+        }
+    }
+    ret = wait.ret;
+    ABT_mutex_unlock(wait.lock);
+
+    /* late reports find no data once this returns */
+    metasim_op_set_data(op, NULL);
+
+    ABT_cond_free(&wait.cond);
+    ABT_mutex_free(&wait.lock);
+    free(req);
+
+out:
+    for (k = 0; k < count; k++)
+        sums[k] += metasim->rank + seeds[k];
+
+    return ret;
+}
+
+static void metasim_rpc_handle_sum_down(hg_handle_t handle)
+{
+    int ret = 0;
+    int32_t count = 0;
+    int32_t *sums = NULL;
+    hg_return_t hret;
+    hg_handle_t up_handle = HG_HANDLE_NULL;
+    metasim_rpc_tree_t tree;
+    metasim_sum_in_t in;
+    metasim_sum_up_in_t up;
+    metasim_op_t *op = NULL;
+
+    metasim_inject_delay(handle);
+
+    /* without the opid, the parent cannot match a report, and gives up on
+     * this child after its deadline */
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    sum_msg_count(&sum_msg_received);
+
+    op = metasim_op_start(in.opid, METASIM_OP_SUM, in.root);
+
+    memset(&tree, 0, sizeof(tree));
+    count = in.seeds.len / sizeof(int32_t);
+    sums = calloc(count, sizeof(*sums));
+
+    if (in.root < 0 || in.root >= metasim->nranks)
+        ret = EINVAL;
+    else if (!op)
+        ret = ENOSPC;   /* reports from children cannot be matched */
+    else if (!sums)
+        ret = ENOMEM;
+    else
+        ret = rpc_tree_init(in.root, 2, &tree);
+
+    if (ret == 0)
+        ret = sum_noreply_forward(&tree, op, &in, sums);
+
+    if (ret)
+        __error("sum_noreply_forward failed (opid=%llu, ret=%d)",
+                (unsigned long long) in.opid, ret);
+
+    up.opid = in.opid;
+    up.ret = ret;
+    up.sums.len = ret ? 0 : count * sizeof(int32_t);
+    up.sums.data = sums;
+
+    /* the report goes back to the sender, which is the parent, so that the
+     * errors above are reported even without the tree */
+    hret = margo_create(margo_hg_handle_get_instance(handle),
+                        margo_get_info(handle)->addr, rpcset.sum_up,
+                        &up_handle);
+    if (hret == HG_SUCCESS) {
+        metasim_timeline_begin("forward_wait");
+        hret = margo_forward(up_handle, &up);
+        metasim_timeline_end("forward_wait");
+        margo_destroy(up_handle);
+    }
+
+    if (hret != HG_SUCCESS)
+        __error("failed to report sum to parent (opid=%llu)",
+                (unsigned long long) in.opid);
+    else
+        sum_msg_count(&sum_msg_sent);
+
+    metasim_op_finish(op);
+    metasim_rpc_tree_free(&tree);
+
+    if (sums)
+        free(sums);
+
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_sum_down)
+
+static void metasim_rpc_handle_sum_up(hg_handle_t handle)
+{
+    int32_t k = 0;
+    int32_t *partial_sums = NULL;
+    hg_return_t hret;
+    metasim_sum_up_in_t in;
+    metasim_op_t *op = NULL;
+    sum_wait_t *wait = NULL;
+
+    metasim_inject_delay(handle);
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    sum_msg_count(&sum_msg_received);
+
+    wait = (sum_wait_t *) metasim_op_get_data(in.opid, &op);
+    if (!wait) {
+        __error("no waiting sum for the report (opid=%llu)",
+                (unsigned long long) in.opid);
+        goto out;
+    }
+
+    ABT_mutex_lock(wait->lock);
+
+    if (in.ret || in.sums.len != wait->count * sizeof(int32_t)) {
+        wait->ret = in.ret ? in.ret : EIO;
+    } else {
+        partial_sums = (int32_t *) in.sums.data;
+        for (k = 0; k < wait->count; k++)
+            wait->sums[k] += partial_sums[k];
+    }
+
+    if (--wait->pending == 0)
+        ABT_cond_signal(wait->cond);
+
+    ABT_mutex_unlock(wait->lock);
+    metasim_op_put_data(op);
+
+out:
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_sum_up)
+
+void metasim_rpc_set_noreply(int noreply)
+{
+    sum_noreply = noreply;
+}
+
+void metasim_rpc_sum_msg_count(uint64_t *sent, uint64_t *received)
+{
+    *sent = sum_msg_sent;
+    *received = sum_msg_received;
+}
+
+/* estimated depth of the sum tree, for slicing the budget among levels */
+static int sum_tree_depth(void)
+{
+    int depth = 0;
+    int n = 1;
+
+    for (n = 1; n < metasim->nranks; n *= 2)
+        depth++;
+
+    return depth + tree_hier;
+}
+
+void metasim_rpc_set_op_timeout(uint64_t usec)
+{
+    sum_timeout = usec;
+}
+
+uint64_t metasim_rpc_get_op_timeout(void)
+{
+    return sum_timeout;
+}
+
+int metasim_rpc_invoke_sum_timed(int32_t count, int32_t *seeds,
+                                 int32_t *sums, uint64_t timeout_usec,
+                                 int32_t *contributors)
+{
+    int ret = 0;
+    metasim_sum_in_t in;
+    metasim_sum_out_t out;
+    metasim_op_t *op = NULL;
+
+    if (count <= 0 || !seeds || !sums || !contributors)
+        return EINVAL;
+
+    op = metasim_op_begin(METASIM_OP_SUM, &in.opid);
+
+    if (merge.window > 0) {
+        ret = merge_sum(count, seeds, sums);
+        *contributors = ret ? 0 : metasim->nranks;
+        metasim_op_end(op);
+        return ret;
+    }
+
+    in.root = metasim->rank;
+    in.sender = -1;
+    in.sampled = 0;
+    in.budget_usec = 0;
+    in.slice_usec = 0;
+    in.seeds.len = count * sizeof(int32_t);
+    in.seeds.data = seeds;
+
+    /* untracked operations cannot be matched, and take the reply path */
+    if (sum_noreply && op) {
+        memset(sums, 0, count * sizeof(int32_t));
+
+        ret = sum_noreply_forward(&bcast_tree, op, &in, sums);
+        if (ret)
+            __error("sum_noreply_forward failed (ret=%d)", ret);
+
+        *contributors = ret ? 0 : metasim->nranks;
+        metasim_op_end(op);
+        return ret;
+    }
+
+    if (!timeout_usec)
+        timeout_usec = sum_timeout;
+
+    in.sampled = metasim_trace_sample();
+    metasim_trace(in.sampled, in.opid, METASIM_TRACE_RECV, -1);
+
+    if (timeout_usec) {
+        in.budget_usec = timeout_usec;
+        in.slice_usec = timeout_usec / (sum_tree_depth() + 2);
+    }
+
+    ret = sum_forward(&bcast_tree, &in, &out);
+
+    metasim_trace(in.sampled, in.opid, METASIM_TRACE_RESPOND, -1);
+
+    if (ret) {
+        __error("sum_forward failed (ret=%d)", ret);
+        *contributors = 0;
+    } else {
+        memcpy(sums, out.sums.data, count * sizeof(int32_t));
+        *contributors = out.count;
+        __debug("rpc sum final result = %d (count=%d, opid=%llu, "
+                "contributors=%d)", sums[0], count,
+                (unsigned long long) in.opid, *contributors);
+    }
+
+    metasim_op_end(op);
+
+    if (out.sums.data)
+        free(out.sums.data);
+
+    return ret;
+}
+
+int metasim_rpc_invoke_sum_batch(int32_t count, int32_t *seeds, int32_t *sums)
+{
+    int ret = 0;
+    int32_t contributors = 0;
+
+    ret = metasim_rpc_invoke_sum_timed(count, seeds, sums, 0, &contributors);
+    if (ret == 0 && contributors < metasim->nranks)
+        ret = sum_timeout ? ETIMEDOUT : EIO;
+
+    return ret;
+}
+
+int metasim_rpc_invoke_sum(int32_t seed, int32_t *sum)
+{
+    return metasim_rpc_invoke_sum_batch(1, &seed, sum);
+}
+
+/*
+ * gather rpc (variable-length records)
+ *
+ * each server contributes a record, and every node in the tree concatenates
+ * the records of its children with its own record before responding to the
+ * parent. small buffers are carried inline in the response. larger buffers
+ * are exposed via a bulk handle, which the parent pulls directly into its
+ * own buffer, and the child holds the buffer until the parent sends a release
+ * message. this way, each intermediate node copies the records only once.
+ */
+
+/* buffers larger than this are transferred via bulk */
+static const hg_size_t gather_inline_max = 2048;
+
+static uint64_t gather_mem_current;
+static uint64_t gather_mem_peak;
+
+static void *gather_mem_alloc(hg_size_t len)
+{
+    uint64_t current = 0;
+    uint64_t peak = 0;
+    void *buf = malloc(len);
+
+    if (!buf)
+        return NULL;
+
+    current = __sync_add_and_fetch(&gather_mem_current, len);
+
+    do {
+        peak = gather_mem_peak;
+        if (current <= peak)
+            break;
+    } while (!__sync_bool_compare_and_swap(&gather_mem_peak, peak, current));
+
+    return buf;
+}
+
+static void gather_mem_free(void *buf, hg_size_t len)
+{
+    if (buf) {
+        __sync_sub_and_fetch(&gather_mem_current, len);
+        free(buf);
+    }
+}
+
+uint64_t metasim_rpc_gather_mem_peak(void)
+{
+    return gather_mem_peak;
+}
+
+/* children waiting for their parents to pull the buffer */
+struct gather_pending {
+    uint64_t opid;
+    ABT_eventual ev;
+    struct gather_pending *next;
+};
+
+typedef struct gather_pending gather_pending_t;
+
+static ABT_mutex gather_lock;
+static gather_pending_t *gather_pending_list;
+
+static int gather_pending_add(gather_pending_t *p, uint64_t opid)
+{
+    int ret = ABT_eventual_create(0, &p->ev);
+    if (ret != ABT_SUCCESS)
+        return ENOMEM;
+
+    p->opid = opid;
+
+    ABT_mutex_lock(gather_lock);
+    p->next = gather_pending_list;
+    gather_pending_list = p;
+    ABT_mutex_unlock(gather_lock);
+
+    return 0;
+}
+
+static void gather_pending_wait(gather_pending_t *p)
+{
+    gather_pending_t **pos = NULL;
+
+    ABT_eventual_wait(p->ev, NULL);
+
+    ABT_mutex_lock(gather_lock);
+    for (pos = &gather_pending_list; *pos; pos = &(*pos)->next) {
+        if (*pos == p) {
+            *pos = p->next;
+            break;
+        }
+    }
+    ABT_mutex_unlock(gather_lock);
+
+    ABT_eventual_free(&p->ev);
+}
+
+static int gather_pending_release(uint64_t opid)
+{
+    int ret = ENOENT;
+    gather_pending_t *p = NULL;
+
+    ABT_mutex_lock(gather_lock);
+    for (p = gather_pending_list; p; p = p->next) {
+        if (p->opid == opid) {
+            ABT_eventual_set(p->ev, NULL, 0);
+            ret = 0;
+            break;
+        }
+    }
+    ABT_mutex_unlock(gather_lock);
+
+    return ret;
+}
+
+/* the last allgather results delivered to this server */
+static struct {
+    void *buf;
+    hg_size_t len;
+} allgather_last[METASIM_RECORD_MAX];
+
+static void allgather_store(int32_t kind, void *buf, hg_size_t len)
+{
+    void *old = NULL;
+    hg_size_t oldlen = 0;
+
+    if (kind < 0 || kind >= METASIM_RECORD_MAX) {
+        gather_mem_free(buf, len);
+        return;
+    }
+
+    ABT_mutex_lock(gather_lock);
+    old = allgather_last[kind].buf;
+    oldlen = allgather_last[kind].len;
+    allgather_last[kind].buf = buf;
+    allgather_last[kind].len = len;
+    ABT_mutex_unlock(gather_lock);
+
+    gather_mem_free(old, oldlen);
+}
+
+int metasim_rpc_get_allgather(int32_t kind, void **buf, uint64_t *len)
+{
+    int ret = 0;
+    void *copy = NULL;
+
+    if (kind < 0 || kind >= METASIM_RECORD_MAX)
+        return EINVAL;
+
+    ABT_mutex_lock(gather_lock);
+    if (!allgather_last[kind].buf) {
+        ret = ENOENT;
+        goto out_unlock;
+    }
+
+    copy = malloc(allgather_last[kind].len);
+    if (!copy) {
+        ret = ENOMEM;
+        goto out_unlock;
+    }
+
+    memcpy(copy, allgather_last[kind].buf, allgather_last[kind].len);
+    *buf = copy;
+    *len = allgather_last[kind].len;
+
+out_unlock:
+    ABT_mutex_unlock(gather_lock);
+
+    return ret;
+}
+
+static int gather_stats_record(char *buf, size_t len)
+{
+    size_t size = 0;
+    size_t total_size = 0;
+    ABT_pool pool = NULL;
+
+    margo_get_handler_pool(metasim->mid, &pool);
+    ABT_pool_get_size(pool, &size);
+    ABT_pool_get_total_size(pool, &total_size);
+
+    return snprintf(buf, len,
+                    "rank=%d nranks=%d handler_pool=%zu/%zu "
+                    "gather_mem_peak=%llu",
+                    metasim->rank, metasim->nranks, size, total_size,
+                    (unsigned long long) gather_mem_peak);
+}
+
+/* fill the local record at @rec. if @rec is NULL, returns the length of the
+ * record (including the header) without filling it. */
+static hg_size_t gather_local_record(int32_t kind, int32_t size,
+                                     metasim_record_t *rec)
+{
+    char str[512];
+    const char *data = NULL;
+    uint32_t len = 0;
+
+    switch (kind) {
+    case METASIM_RECORD_HOSTNAME:
+        gethostname(str, sizeof(str) - 1);
+        str[sizeof(str) - 1] = '\0';
+        data = str;
+        len = strlen(str) + 1;
+        break;
+
+    case METASIM_RECORD_STATS:
+        gather_stats_record(str, sizeof(str));
+        data = str;
+        len = strlen(str) + 1;
+        break;
+
+    case METASIM_RECORD_TEST:
+    default:
+        len = size > 0 ? (uint32_t) size : 0;
+        break;
+    }
+
+    if (rec) {
+        rec->rank = metasim->rank;
+        rec->len = len;
+
+        if (data)
+            memcpy(rec->data, data, len);
+        else
+            memset(rec->data, metasim->rank & 0xff, len);
+    }
+
+    return sizeof(*rec) + len;
+}
+
+static void gather_release_child(int child, uint64_t opid)
+{
+    hg_return_t hret;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    metasim_gather_release_in_t in;
+
+    hret = rpc_create(rpcset.gather_release, child, &handle);
+    if (hret != HG_SUCCESS) {
+        __error("failed to create release request (child=%d)", child);
+        return;
+    }
+
+    in.opid = opid;
+
+    metasim_timeline_begin("forward_wait");
+    hret = margo_forward(handle, &in);
+    metasim_timeline_end("forward_wait");
+    if (hret != HG_SUCCESS)
+        __error("failed to forward release request (child=%d)", child);
+
+    margo_destroy(handle);
+}
+
+typedef struct {
+    corpc_req_t req;
+    metasim_gather_out_t out;
+    int waited;
+    int has_output;
+} gather_child_t;
+
+static int gather_collect(metasim_rpc_tree_t *tree, metasim_gather_in_t *in,
+                          void **outbuf, hg_size_t *outlen, int32_t *outcount)
+{
+    int ret = 0;
+    int i = 0;
+    int child_count = tree->child_count;
+    int *child_ranks = tree->child_ranks;
+    int32_t count = 1;
+    hg_return_t hret;
+    hg_size_t len = 0;
+    hg_size_t pos = 0;
+    hg_bulk_t bulk = HG_BULK_NULL;
+    char *buf = NULL;
+    gather_child_t *children = NULL;
+
+    if (child_count > 0) {
+        children = calloc(child_count, sizeof(*children));
+        if (!children) {
+            __error("failed to allocate memory for corpc");
+            return ENOMEM;
+        }
+    }
+
+    for (i = 0; i < child_count; i++) {
+        corpc_req_t *r = &children[i].req;
+
+        ret = corpc_get_handle(rpcset.gather, child_ranks[i], r);
+        if (ret) {
+            __error("corpc_get_handle failed, abort rpc");
+            goto out;
+        }
+
+        ret = corpc_forward_request((void *) in, r);
+        if (ret) {
+            __error("corpc_forward_request failed, abort rpc");
+            goto out;
+        }
+    }
+
+    len = gather_local_record(in->kind, in->size, NULL);
+
+    for (i = 0; i < child_count; i++) {
+        gather_child_t *c = &children[i];
+
+        c->waited = 1;
+        ret = corpc_wait_request(&c->req);
+        if (ret) {
+            __error("corpc_wait_request failed, abort rpc");
+            goto out;
+        }
+
+        hret = margo_get_output(c->req.handle, &c->out);
+        if (hret != HG_SUCCESS) {
+            __error("margo_get_output failed, abort rpc");
+            ret = EIO;
+            goto out;
+        }
+        c->has_output = 1;
+
+        if (c->out.ret) {
+            ret = c->out.ret;
+            goto out;
+        }
+
+        len += c->out.len;
+        count += c->out.count;
+    }
+
+    /* now we know the total length, place all records in a single buffer */
+    buf = gather_mem_alloc(len);
+    if (!buf) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    pos = gather_local_record(in->kind, in->size, (metasim_record_t *) buf);
+
+    if (len > pos) {
+        void *ptr = buf;
+
+        hret = margo_bulk_create(metasim->mid, 1, &ptr, &len,
+                                 HG_BULK_WRITE_ONLY, &bulk);
+        if (hret != HG_SUCCESS) {
+            __error("margo_bulk_create failed");
+            ret = EIO;
+            goto out;
+        }
+    }
+
+    for (i = 0; i < child_count; i++) {
+        gather_child_t *c = &children[i];
+
+        if (c->out.len == 0)
+            continue;
+
+        if (c->out.bulk == HG_BULK_NULL) {
+            memcpy(&buf[pos], c->out.inline_buf.data, c->out.len);
+        } else {
+            const struct hg_info *info = margo_get_info(c->req.handle);
+
+            hret = margo_bulk_transfer(metasim->mid, HG_BULK_PULL, info->addr,
+                                       c->out.bulk, 0, bulk, pos, c->out.len);
+            if (hret != HG_SUCCESS) {
+                __error("failed to pull records from child (rank=%d)",
+                        child_ranks[i]);
+                ret = EIO;
+                goto out;
+            }
+        }
+
+        __debug("gathered %d records from child[%d] (rank=%d, len=%llu)",
+                c->out.count, i, child_ranks[i],
+                (unsigned long long) c->out.len);
+
+        pos += c->out.len;
+    }
+
+    *outbuf = buf;
+    *outlen = len;
+    *outcount = count;
+    buf = NULL;
+
+out:
+    if (bulk != HG_BULK_NULL)
+        margo_bulk_free(bulk);
+
+    if (buf)
+        gather_mem_free(buf, len);
+
+    for (i = 0; i < child_count; i++) {
+        gather_child_t *c = &children[i];
+
+        if (c->req.handle == HG_HANDLE_NULL)
+            continue;
+
+        /* on errors, still collect the outstanding responses */
+        if (!c->waited && c->req.req != MARGO_REQUEST_NULL) {
+            if (corpc_wait_request(&c->req) == 0 &&
+                margo_get_output(c->req.handle, &c->out) == HG_SUCCESS)
+                c->has_output = 1;
+        }
+
+        if (c->has_output) {
+            /* children exposing bulk are waiting for us, even on errors */
+            if (c->out.bulk != HG_BULK_NULL)
+                gather_release_child(child_ranks[i], in->opid);
+
+            margo_free_output(c->req.handle, &c->out);
+        }
+
+        margo_destroy(c->req.handle);
+    }
+
+    if (children)
+        free(children);
+
+    return ret;
+}
+
+static void metasim_rpc_handle_gather(hg_handle_t handle)
+{
+    int ret = 0;
+    hg_return_t hret;
+    metasim_rpc_tree_t tree;
+    metasim_gather_in_t in;
+    metasim_gather_out_t out;
+    gather_pending_t pending;
+    void *buf = NULL;
+    hg_size_t len = 0;
+    int32_t count = 0;
+    hg_bulk_t bulk = HG_BULK_NULL;
+    metasim_op_t *op = NULL;
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    op = metasim_op_start(in.opid, METASIM_OP_GATHER, in.root);
+
+    memset(&out, 0, sizeof(out));
+    out.bulk = HG_BULK_NULL;
+
+    rpc_tree_init(in.root, 2, &tree);
+
+    ret = gather_collect(&tree, &in, &buf, &len, &count);
+    if (ret) {
+        __error("gather_collect failed (ret=%d)", ret);
+        goto respond;
+    }
+
+    out.count = count;
+    out.len = len;
+
+    if (len <= gather_inline_max) {
+        out.inline_buf.len = len;
+        out.inline_buf.data = buf;
+    } else {
+        hret = margo_bulk_create(metasim->mid, 1, &buf, &len,
+                                 HG_BULK_READ_ONLY, &bulk);
+        if (hret != HG_SUCCESS) {
+            __error("margo_bulk_create failed");
+            ret = EIO;
+            goto respond;
+        }
+
+        /* register before responding, the parent may release right away */
+        ret = gather_pending_add(&pending, in.opid);
+        if (ret) {
+            margo_bulk_free(bulk);
+            bulk = HG_BULK_NULL;
+            goto respond;
+        }
+
+        out.bulk = bulk;
+    }
+
+respond:
+    if (ret) {
+        out.count = 0;
+        out.len = 0;
+        out.bulk = HG_BULK_NULL;
+        out.inline_buf.len = 0;
+    }
+    out.ret = ret;
+
+    hret = metasim_inject_respond(handle, &out);
+    if (hret != HG_SUCCESS)
+        __error("margo_respond failed");
+
+    if (bulk != HG_BULK_NULL) {
+        /* the parent never pulls if the response didn't go through */
+        if (hret != HG_SUCCESS)
+            gather_pending_release(in.opid);
+
+        gather_pending_wait(&pending);
+        margo_bulk_free(bulk);
+    }
+
+    gather_mem_free(buf, len);
+
+    metasim_op_finish(op);
+    metasim_rpc_tree_free(&tree);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_gather)
+
+static void metasim_rpc_handle_gather_release(hg_handle_t handle)
+{
+    hg_return_t hret;
+    metasim_gather_release_in_t in;
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        goto out;
+    }
+
+    if (gather_pending_release(in.opid))
+        __error("no pending gather for opid %llu",
+                (unsigned long long) in.opid);
+
+    margo_free_input(handle, &in);
+out:
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_gather_release)
+
+/* forward the gathered buffer down the tree, each child pulls the buffer from
+ * its parent and forwards it to its own children. */
+static int gather_bcast_forward(metasim_rpc_tree_t *tree,
+                                metasim_gather_bcast_in_t *in, void *buf)
+{
+    int ret = 0;
+    int i = 0;
+    int child_count = tree->child_count;
+    int *child_ranks = tree->child_ranks;
+    hg_return_t hret;
+    hg_size_t len = in->len;
+    corpc_req_t *req = NULL;
+    metasim_gather_bcast_in_t _in = *in;
+
+    if (child_count == 0)
+        return 0;
+
+    req = calloc(child_count, sizeof(*req));
+    if (!req) {
+        __error("failed to allocate memory for corpc");
+        return ENOMEM;
+    }
+
+    hret = margo_bulk_create(metasim->mid, 1, &buf, &len,
+                             HG_BULK_READ_ONLY, &_in.bulk);
+    if (hret != HG_SUCCESS) {
+        __error("margo_bulk_create failed");
+        ret = EIO;
+        goto out;
+    }
+
+    for (i = 0; i < child_count; i++) {
+        ret = corpc_get_handle(rpcset.gather_bcast, child_ranks[i], &req[i]);
+        if (ret)
+            goto out_wait;
+
+        ret = corpc_forward_request((void *) &_in, &req[i]);
+        if (ret) {
+            margo_destroy(req[i].handle);
+            req[i].handle = HG_HANDLE_NULL;
+            goto out_wait;
+        }
+    }
+
+out_wait:
+    for (i = 0; i < child_count; i++) {
+        metasim_gather_bcast_out_t out;
+
+        if (req[i].handle == HG_HANDLE_NULL)
+            continue;
+
+        if (corpc_wait_request(&req[i]) == 0) {
+            margo_get_output(req[i].handle, &out);
+            if (out.ret)
+                ret = out.ret;
+            margo_free_output(req[i].handle, &out);
+        } else {
+            ret = EIO;
+        }
+
+        margo_destroy(req[i].handle);
+    }
+
+    margo_bulk_free(_in.bulk);
+out:
+    free(req);
+
+    return ret;
+}
+
+static void metasim_rpc_handle_gather_bcast(hg_handle_t handle)
+{
+    int ret = 0;
+    hg_return_t hret;
+    metasim_rpc_tree_t tree;
+    metasim_gather_bcast_in_t in;
+    metasim_gather_bcast_out_t out;
+    const struct hg_info *info = NULL;
+    hg_bulk_t bulk = HG_BULK_NULL;
+    hg_size_t len = 0;
+    void *buf = NULL;
+    metasim_op_t *op = NULL;
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    op = metasim_op_start(in.opid, METASIM_OP_ALLGATHER, in.root);
+
+    len = in.len;
+    info = margo_get_info(handle);
+
+    rpc_tree_init(in.root, 2, &tree);
+
+    buf = gather_mem_alloc(len);
+    if (!buf) {
+        ret = ENOMEM;
+        goto respond;
+    }
+
+    hret = margo_bulk_create(metasim->mid, 1, &buf, &len,
+                             HG_BULK_WRITE_ONLY, &bulk);
+    if (hret != HG_SUCCESS) {
+        ret = EIO;
+        goto respond;
+    }
+
+    hret = margo_bulk_transfer(metasim->mid, HG_BULK_PULL, info->addr,
+                               in.bulk, 0, bulk, 0, len);
+    margo_bulk_free(bulk);
+    if (hret != HG_SUCCESS) {
+        __error("failed to pull the gathered buffer from parent");
+        ret = EIO;
+        goto respond;
+    }
+
+    ret = gather_bcast_forward(&tree, &in, buf);
+    if (ret)
+        __error("gather_bcast_forward failed (ret=%d)", ret);
+
+    allgather_store(in.kind, buf, len);
+    buf = NULL;
+
+respond:
+    if (buf)
+        gather_mem_free(buf, len);
+
+    out.ret = ret;
+    metasim_inject_respond(handle, &out);
+
+    metasim_op_finish(op);
+    metasim_rpc_tree_free(&tree);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_gather_bcast)
+
+static int gather_invoke(int32_t kind, int32_t size, int all,
+                         void **buf, uint64_t *len)
+{
+    int ret = 0;
+    int32_t count = 0;
+    hg_size_t _len = 0;
+    void *_buf = NULL;
+    metasim_gather_in_t in;
+    metasim_op_t *op = NULL;
+
+    op = metasim_op_begin(all ? METASIM_OP_ALLGATHER : METASIM_OP_GATHER,
+                          &in.opid);
+
+    in.root = metasim->rank;
+    in.kind = kind;
+    in.size = size;
+
+    ret = gather_collect(&bcast_tree, &in, &_buf, &_len, &count);
+    if (ret) {
+        __error("gather_collect failed (ret=%d)", ret);
+        goto out;
+    }
+
+    __debug("gathered %d records (%llu bytes)",
+            count, (unsigned long long) _len);
+
+    if (all) {
+        metasim_gather_bcast_in_t bin;
+
+        bin.opid = in.opid;
+        bin.root = in.root;
+        bin.kind = kind;
+        bin.len = _len;
+        bin.bulk = HG_BULK_NULL;
+
+        ret = gather_bcast_forward(&bcast_tree, &bin, _buf);
+        if (ret) {
+            __error("gather_bcast_forward failed (ret=%d)", ret);
+            gather_mem_free(_buf, _len);
+            goto out;
+        }
+    }
+
+    /* the root keeps the result as well, like the other servers */
+    if (all) {
+        void *copy = gather_mem_alloc(_len);
+
+        if (copy) {
+            memcpy(copy, _buf, _len);
+            allgather_store(kind, copy, _len);
+        } else {
+            __error("failed to keep the allgather result (%llu bytes)",
+                    (unsigned long long) _len);
+        }
+    }
+
+    /* hand over the buffer to the caller */
+    __sync_sub_and_fetch(&gather_mem_current, _len);
+
+    *buf = _buf;
+    *len = _len;
+
+out:
+    metasim_op_end(op);
+
+    return ret;
+}
+
+int metasim_rpc_invoke_gather(int32_t kind, int32_t size,
+                              void **buf, uint64_t *len)
+{
+    return gather_invoke(kind, size, 0, buf, len);
+}
+
+int metasim_rpc_invoke_allgather(int32_t kind, int32_t size,
+                                 void **buf, uint64_t *len)
+{
+    return gather_invoke(kind, size, 1, buf, len);
+}
+
+/*
+ * pipelined broadcast
+ *
+ * the buffer is split into segments and each segment is sent as a separate
+ * rpc. a server pulls the segment from its parent and forwards it to its
+ * children right away, while the following segments are handled by other
+ * handler ults. therefore, a level in the tree doesn't need to wait for the
+ * whole buffer before forwarding.
+ *
+ * with the double tree, even segments are sent over the binary tree and odd
+ * segments over its mirror. since most leaves of one tree are interior nodes
+ * of the other, the outbound links of the leaves are also used.
+ */
+
+/* max number of segments in flight from the root */
+static const int bcast_window = 16;
+
+/* segments stop arriving if the root fails in the middle of a broadcast.
+ * the buffers of such broadcasts are reaped once idle for this long. */
+#define BCAST_STALE_SEC 10.0
+
+/* buffers being received at non-root servers */
+struct bcast_state {
+    uint64_t opid;
+    hg_size_t len;
+    void *buf;
+    hg_bulk_t bulk;
+    uint64_t nsegs;
+    uint64_t done;
+    int users;                  /* segment handlers holding the state */
+    double last;                /* last time a segment came or went */
+    metasim_op_t *op;
+    struct bcast_state *next;
+};
+
+typedef struct bcast_state bcast_state_t;
+
+static ABT_mutex bcast_lock;
+static bcast_state_t *bcast_list;
+
+static inline uint64_t bcast_nsegs(hg_size_t len, hg_size_t segsize)
+{
+    return (len + segsize - 1) / segsize;
+}
+
+static void bcast_state_free(bcast_state_t *st)
+{
+    metasim_op_finish(st->op);
+    margo_bulk_free(st->bulk);
+    gather_mem_free(st->buf, st->len);
+    free(st);
+}
+
+/* unlinks the idle broadcasts whose root has gone quiet, and returns them.
+ * should be called with bcast_lock held. */
+static bcast_state_t *bcast_state_reap(double now)
+{
+    bcast_state_t **pos = NULL;
+    bcast_state_t *st = NULL;
+    bcast_state_t *stale = NULL;
+
+    for (pos = &bcast_list; *pos; ) {
+        st = *pos;
+
+        if (st->users > 0 || now - st->last < BCAST_STALE_SEC) {
+            pos = &st->next;
+            continue;
+        }
+
+        *pos = st->next;
+        st->next = stale;
+        stale = st;
+    }
+
+    return stale;
+}
+
+static bcast_state_t *bcast_state_get(metasim_bcast_seg_in_t *in)
+{
+    hg_return_t hret;
+    double now = ABT_get_wtime();
+    bcast_state_t *st = NULL;
+    bcast_state_t *stale = NULL;
+
+    ABT_mutex_lock(bcast_lock);
+
+    for (st = bcast_list; st; st = st->next) {
+        if (st->opid == in->opid) {
+            st->users++;
+            st->last = now;
+            goto out_unlock;
+        }
+    }
+
+    stale = bcast_state_reap(now);
+
+    /* the first segment arrived */
+    st = calloc(1, sizeof(*st));
+    if (!st)
+        goto out_unlock;
+
+    st->buf = gather_mem_alloc(in->len);
+    if (!st->buf)
+        goto out_free;
+
+    hret = margo_bulk_create(metasim->mid, 1, &st->buf, &in->len,
+                             HG_BULK_READWRITE, &st->bulk);
+    if (hret != HG_SUCCESS)
+        goto out_free;
+
+    st->opid = in->opid;
+    st->len = in->len;
+    st->nsegs = bcast_nsegs(in->len, in->segsize);
+    st->users = 1;
+    st->last = now;
+    st->op = metasim_op_start(in->opid, METASIM_OP_BCAST, in->root);
+    if (st->op)
+        metasim_op_set_data(st->op, st);
+    st->next = bcast_list;
+    bcast_list = st;
+
+out_unlock:
+    ABT_mutex_unlock(bcast_lock);
+
+    while (stale) {
+        bcast_state_t *next = stale->next;
+
+        __error("reaped a stale bcast (opid=%llu, %llu of %llu segments)",
+                (unsigned long long) stale->opid,
+                (unsigned long long) stale->done,
+                (unsigned long long) stale->nsegs);
+        bcast_state_free(stale);
+        stale = next;
+    }
+
+    return st;
+
+out_free:
+    if (st->buf)
+        gather_mem_free(st->buf, in->len);
+    free(st);
+    st = NULL;
+    goto out_unlock;
+}
+
+static void bcast_state_put(bcast_state_t *st)
+{
+    bcast_state_t **pos = NULL;
+    int done = 0;
+
+    ABT_mutex_lock(bcast_lock);
+
+    st->users--;
+    st->last = ABT_get_wtime();
+    st->done++;
+    if (st->done == st->nsegs) {
+        for (pos = &bcast_list; *pos; pos = &(*pos)->next) {
+            if (*pos == st) {
+                *pos = st->next;
+                break;
+            }
+        }
+        done = 1;
+    }
+
+    ABT_mutex_unlock(bcast_lock);
+
+    if (done) {
+        __debug("bcast completed (opid=%llu, len=%llu)",
+                (unsigned long long) st->opid, (unsigned long long) st->len);
+
+        bcast_state_free(st);
+    }
+}
+
+static int bcast_tree_init(metasim_bcast_seg_in_t *in, metasim_rpc_tree_t *t)
+{
+    uint64_t seg = in->offset / in->segsize;
+
+    if (in->tree == METASIM_BCAST_TREE_DOUBLE && (seg & 1))
+        return metasim_rpc_tree_init_mirror(metasim->rank, metasim->nranks,
+                                            in->root, 2, t);
+    else
+        return metasim_rpc_tree_init(metasim->rank, metasim->nranks,
+                                     in->root, in->degree, t);
+}
+
+/* forwards a segment to children and waits for them */
+static int bcast_seg_forward(metasim_rpc_tree_t *tree,
+                             metasim_bcast_seg_in_t *in, corpc_req_t *req)
+{
+    int ret = 0;
+    int i = 0;
+
+    for (i = 0; i < tree->child_count; i++) {
+        req[i].handle = HG_HANDLE_NULL;
+
+        ret = corpc_get_handle(rpcset.bcast_seg, tree->child_ranks[i],
+                               &req[i]);
+        if (ret)
+            break;
+
+        ret = corpc_forward_request((void *) in, &req[i]);
+        if (ret) {
+            margo_destroy(req[i].handle);
+            req[i].handle = HG_HANDLE_NULL;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static int bcast_seg_wait(int count, corpc_req_t *req)
+{
+    int ret = 0;
+    int i = 0;
+    metasim_bcast_seg_out_t out;
+
+    for (i = 0; i < count; i++) {
+        if (req[i].handle == HG_HANDLE_NULL)
+            continue;
+
+        if (corpc_wait_request(&req[i]) == 0) {
+            margo_get_output(req[i].handle, &out);
+            if (!ret)
+                ret = out.ret;
+            margo_free_output(req[i].handle, &out);
+        } else if (!ret) {
+            ret = EIO;
+        }
+
+        margo_destroy(req[i].handle);
+        req[i].handle = HG_HANDLE_NULL;
+    }
+
+    return ret;
+}
+
+static void metasim_rpc_handle_bcast_seg(hg_handle_t handle)
+{
+    int ret = 0;
+    int rc = 0;
+    hg_return_t hret;
+    hg_size_t seglen = 0;
+    metasim_rpc_tree_t tree;
+    metasim_bcast_seg_in_t in;
+    metasim_bcast_seg_in_t fwd;
+    metasim_bcast_seg_out_t out;
+    const struct hg_info *info = NULL;
+    bcast_state_t *st = NULL;
+    corpc_req_t *req = NULL;
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    info = margo_get_info(handle);
+
+    bcast_tree_init(&in, &tree);
+
+    st = bcast_state_get(&in);
+    if (!st) {
+        __error("failed to allocate bcast buffer (len=%llu)",
+                (unsigned long long) in.len);
+        ret = ENOMEM;
+        goto respond;
+    }
+
+    seglen = in.len - in.offset;
+    if (seglen > in.segsize)
+        seglen = in.segsize;
+
+    hret = margo_bulk_transfer(metasim->mid, HG_BULK_PULL, info->addr,
+                               in.bulk, in.offset, st->bulk, in.offset,
+                               seglen);
+    if (hret != HG_SUCCESS) {
+        __error("failed to pull segment from parent (offset=%llu)",
+                (unsigned long long) in.offset);
+        ret = EIO;
+        goto out_put;
+    }
+
+    if (tree.child_count > 0) {
+        req = calloc(tree.child_count, sizeof(*req));
+        if (!req) {
+            ret = ENOMEM;
+            goto out_put;
+        }
+
+        /* children pull the segment from us. in keeps the bulk of the
+         * parent, which margo_free_input() releases. */
+        fwd = in;
+        fwd.bulk = st->bulk;
+
+        /* wait for the forwarded ones even if some failed */
+        ret = bcast_seg_forward(&tree, &fwd, req);
+        rc = bcast_seg_wait(tree.child_count, req);
+        if (!ret)
+            ret = rc;
+
+        free(req);
+    }
+
+out_put:
+    bcast_state_put(st);
+respond:
+    out.ret = ret;
+    metasim_inject_respond(handle, &out);
+
+    metasim_rpc_tree_free(&tree);
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_bcast_seg)
+
+int metasim_rpc_invoke_bcast(void *buf, uint64_t len, uint64_t segsize,
+                             int32_t degree, int32_t tree_type)
+{
+    int ret = 0;
+    int rc = 0;
+    int window = 0;
+    int ntrees = 1;
+    int max_children = 0;
+    uint64_t i = 0;
+    uint64_t nsegs = 0;
+    hg_return_t hret;
+    hg_size_t _len = len;
+    hg_bulk_t bulk = HG_BULK_NULL;
+    metasim_rpc_tree_t tree[2];
+    metasim_bcast_seg_in_t in;
+    corpc_req_t *req = NULL;
+    metasim_op_t *op = NULL;
+
+    if (len == 0)
+        return 0;
+
+    if (segsize == 0)
+        segsize = METASIM_BCAST_SEGSIZE_DEFAULT;
+    if (degree < 1 || tree_type == METASIM_BCAST_TREE_DOUBLE)
+        degree = 2;
+
+    ret = metasim_rpc_tree_init(metasim->rank, metasim->nranks, metasim->rank,
+                                degree, &tree[0]);
+    if (ret) {
+        __error("failed to initialize the rpc tree (ret=%d)", ret);
+        return ret;
+    }
+
+    if (tree_type == METASIM_BCAST_TREE_DOUBLE) {
+        ret = metasim_rpc_tree_init_mirror(metasim->rank, metasim->nranks,
+                                           metasim->rank, 2, &tree[1]);
+        if (ret) {
+            __error("failed to initialize the mirror tree (ret=%d)", ret);
+            metasim_rpc_tree_free(&tree[0]);
+            return ret;
+        }
+        ntrees = 2;
+    }
+
+    for (i = 0; i < ntrees; i++)
+        if (tree[i].child_count > max_children)
+            max_children = tree[i].child_count;
+
+    if (max_children == 0)
+        goto out;
+
+    nsegs = bcast_nsegs(len, segsize);
+    window = nsegs < bcast_window ? nsegs : bcast_window;
+
+    req = calloc(window * max_children, sizeof(*req));
+    if (!req) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    hret = margo_bulk_create(metasim->mid, 1, &buf, &_len,
+                             HG_BULK_READ_ONLY, &bulk);
+    if (hret != HG_SUCCESS) {
+        __error("margo_bulk_create failed");
+        ret = EIO;
+        goto out;
+    }
+
+    op = metasim_op_begin(METASIM_OP_BCAST, &in.opid);
+
+    in.root = metasim->rank;
+    in.degree = degree;
+    in.tree = tree_type;
+    in.len = len;
+    in.segsize = segsize;
+    in.bulk = bulk;
+
+    __debug("bcasting %llu bytes in %llu segments (degree=%d, trees=%d)",
+            (unsigned long long) len, (unsigned long long) nsegs, degree,
+            ntrees);
+
+    for (i = 0; i < nsegs + window; i++) {
+        corpc_req_t *r = &req[(i % window) * max_children];
+
+        /* retire the oldest segment in the window */
+        if (i >= window) {
+            rc = bcast_seg_wait(max_children, r);
+            if (!ret)
+                ret = rc;
+        }
+
+        if (i < nsegs && !ret) {
+            in.offset = i * segsize;
+            ret = bcast_seg_forward(&tree[i % ntrees], &in, r);
+        }
+    }
+
+    metasim_op_end(op);
+    margo_bulk_free(bulk);
+out:
+    if (req)
+        free(req);
+    for (i = 0; i < ntrees; i++)
+        metasim_rpc_tree_free(&tree[i]);
+
+    return ret;
+}
+
+/*
+ * barrier
+ *
+ * all barrier messages are one-way rpcs without payload. each server counts
+ * the arrivals per epoch, and only the calling ult waits on the condition
+ * variable. a peer can be ahead of us by at most one epoch, so the counters
+ * are indexed by the parity of the epoch.
+ */
+
+#define BARRIER_MAX_ROUNDS  32
+
+enum {
+    BARRIER_MSG_ARRIVE = 0,
+    BARRIER_MSG_RELEASE,
+    BARRIER_MSG_DISSEM,
+};
+
+static struct {
+    ABT_mutex lock;
+    ABT_cond cond;
+    metasim_rpc_tree_t tree;            /* tree rooted at rank 0 */
+    uint64_t tree_epoch;
+    uint64_t released;                  /* last epoch released by parent */
+    int arrived[2];                     /* children arrived */
+    uint64_t dissem_epoch;
+    int dissem[2][BARRIER_MAX_ROUNDS];  /* messages received at each round */
+} barrier;
+
+static int barrier_send(hg_id_t rpc, int target, uint64_t epoch, int round)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    metasim_barrier_in_t in;
+
+    hret = rpc_create(rpc, target, &handle);
+    if (hret != HG_SUCCESS) {
+        __error("failed to create barrier request (target=%d)", target);
+        return EIO;
+    }
+
+    in.epoch = epoch;
+    in.round = round;
+
+    metasim_timeline_begin("forward_wait");
+    hret = margo_forward(handle, &in);
+    metasim_timeline_end("forward_wait");
+    if (hret != HG_SUCCESS) {
+        __error("failed to forward barrier request (target=%d)", target);
+        ret = EIO;
+    }
+
+    margo_destroy(handle);
+
+    return ret;
+}
+
+static int barrier_tree(void)
+{
+    int ret = 0;
+    int rc = 0;
+    int i = 0;
+    metasim_rpc_tree_t *tree = &barrier.tree;
+    uint64_t epoch = ++barrier.tree_epoch;
+    int slot = epoch & 1;
+
+    /* fan-in: wait for all children */
+    ABT_mutex_lock(barrier.lock);
+    while (barrier.arrived[slot] < tree->child_count)
+        ABT_cond_wait(barrier.cond, barrier.lock);
+    barrier.arrived[slot] -= tree->child_count;
+    ABT_mutex_unlock(barrier.lock);
+
+    if (tree->parent_rank >= 0) {
+        ret = barrier_send(rpcset.barrier_arrive, tree->parent_rank, epoch, 0);
+        if (ret)
+            return ret;
+
+        ABT_mutex_lock(barrier.lock);
+        while (barrier.released < epoch)
+            ABT_cond_wait(barrier.cond, barrier.lock);
+        ABT_mutex_unlock(barrier.lock);
+    }
+
+    /* fan-out: release all children even if one of them fails */
+    for (i = 0; i < tree->child_count; i++) {
+        rc = barrier_send(rpcset.barrier_release, tree->child_ranks[i],
+                          epoch, 0);
+        if (!ret)
+            ret = rc;
+    }
+
+    return ret;
+}
+
+static int barrier_dissemination(void)
+{
+    int ret = 0;
+    int round = 0;
+    int dist = 1;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    uint64_t epoch = ++barrier.dissem_epoch;
+    int slot = epoch & 1;
+
+    for (round = 0, dist = 1; dist < nranks; round++, dist <<= 1) {
+        ret = barrier_send(rpcset.barrier_dissem, (rank + dist) % nranks,
+                           epoch, round);
+        if (ret)
+            return ret;
+
+        ABT_mutex_lock(barrier.lock);
+        while (barrier.dissem[slot][round] == 0)
+            ABT_cond_wait(barrier.cond, barrier.lock);
+        barrier.dissem[slot][round]--;
+        ABT_mutex_unlock(barrier.lock);
+    }
+
+    return ret;
+}
+
+int metasim_rpc_barrier(int type)
+{
+    if (metasim->nranks == 1)
+        return 0;
+
+    switch (type) {
+    case METASIM_BARRIER_TREE:
+        return barrier_tree();
+
+    case METASIM_BARRIER_DISSEMINATION:
+        return barrier_dissemination();
+
+    default:
+        return EINVAL;
+    }
+}
+
+static void barrier_handle(hg_handle_t handle, int type)
+{
+    hg_return_t hret;
+    metasim_barrier_in_t in;
+
+    metasim_inject_delay(handle);
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        goto out;
+    }
+
+    ABT_mutex_lock(barrier.lock);
+
+    switch (type) {
+    case BARRIER_MSG_ARRIVE:
+        barrier.arrived[in.epoch & 1]++;
+        break;
+    case BARRIER_MSG_RELEASE:
+        barrier.released = in.epoch;
+        break;
+    case BARRIER_MSG_DISSEM:
+        if (in.round >= 0 && in.round < BARRIER_MAX_ROUNDS)
+            barrier.dissem[in.epoch & 1][in.round]++;
+        break;
+    default:
+        break;
+    }
+
+    ABT_cond_broadcast(barrier.cond);
+    ABT_mutex_unlock(barrier.lock);
+
+    margo_free_input(handle, &in);
+out:
+    margo_destroy(handle);
+}
+
+static void metasim_rpc_handle_barrier_arrive(hg_handle_t handle)
+{
+    barrier_handle(handle, BARRIER_MSG_ARRIVE);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_barrier_arrive)
+
+static void metasim_rpc_handle_barrier_release(hg_handle_t handle)
+{
+    barrier_handle(handle, BARRIER_MSG_RELEASE);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_barrier_release)
+
+static void metasim_rpc_handle_barrier_dissem(hg_handle_t handle)
+{
+    barrier_handle(handle, BARRIER_MSG_DISSEM);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_barrier_dissem)
+
+/*
+ * exclusive scan (recursive doubling)
+ *
+ * at each round, a server sends its partial sum to the server at distance
+ * 2^round, and adds the partial sum received from the server at the same
+ * distance below. unlike the dissemination barrier, lower ranks do not wait
+ * for higher ranks and can run ahead by several epochs, so the messages are
+ * kept in a mailbox list until consumed.
+ *
+ * a server that fails a round keeps sending in the remaining rounds, with the
+ * error in the messages, so that the higher ranks fail the scan as well. a
+ * message that never arrives fails the scan after the op timeout, or after
+ * SCAN_WAIT_USEC without one.
+ */
+
+#define SCAN_WAIT_USEC  (10 * 1000000ULL)
+
+struct scan_msg {
+    uint64_t epoch;
+    int32_t round;
+    uint64_t value;
+    int32_t ret;
+    struct scan_msg *next;
+};
+
+typedef struct scan_msg scan_msg_t;
+
+static struct {
+    ABT_mutex lock;
+    ABT_cond cond;
+    uint64_t epoch;
+    scan_msg_t *mailbox;
+} scan;
+
+static int scan_send(int target, uint64_t epoch, int round, uint64_t value,
+                     int32_t err)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_handle_t handle = HG_HANDLE_NULL;
+    metasim_scan_in_t in;
+
+    hret = rpc_create(rpcset.scan, target, &handle);
+    if (hret != HG_SUCCESS) {
+        __error("failed to create scan request (target=%d)", target);
+        return EIO;
+    }
+
+    in.epoch = epoch;
+    in.round = round;
+    in.value = value;
+    in.ret = err;
+
+    metasim_timeline_begin("forward_wait");
+    hret = margo_forward(handle, &in);
+    metasim_timeline_end("forward_wait");
+    if (hret != HG_SUCCESS) {
+        __error("failed to forward scan request (target=%d)", target);
+        ret = EIO;
+    }
+
+    margo_destroy(handle);
+
+    return ret;
+}
+
+static int scan_recv(uint64_t epoch, int round, uint64_t *value)
+{
+    int ret = 0;
+    scan_msg_t **pos = NULL;
+    scan_msg_t *msg = NULL;
+    struct timespec deadline;
+
+    rpc_deadline(&deadline, sum_timeout ? sum_timeout : SCAN_WAIT_USEC);
+
+    ABT_mutex_lock(scan.lock);
+
+    while (1) {
+        for (pos = &scan.mailbox; *pos; pos = &(*pos)->next) {
+            if ((*pos)->epoch == epoch && (*pos)->round == round)
+                break;
+        }
+
+        if (*pos)
+            break;
+
+        if (ABT_cond_timedwait(scan.cond, scan.lock, &deadline) ==
+            ABT_ERR_COND_TIMEDOUT) {
+            ABT_mutex_unlock(scan.lock);
+            __error("scan message did not arrive (epoch=%llu, round=%d)",
+                    (unsigned long long) epoch, round);
+            *value = 0;
+            return ETIMEDOUT;
+        }
+    }
+
+    msg = *pos;
+    *pos = msg->next;
+
+    ABT_mutex_unlock(scan.lock);
+
+    *value = msg->value;
+    ret = msg->ret;
+    free(msg);
+
+    return ret;
+}
+
+int metasim_rpc_exscan(uint64_t value, uint64_t *result)
+{
+    int ret = 0;
+    int err = 0;
+    int round = 0;
+    int dist = 1;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    uint64_t epoch = 0;
+    uint64_t partial = value;
+    uint64_t exclusive = 0;
+    uint64_t recv = 0;
+
+    ABT_mutex_lock(scan.lock);
+    epoch = ++scan.epoch;
+    ABT_mutex_unlock(scan.lock);
+
+    for (round = 0, dist = 1; dist < nranks; round++, dist <<= 1) {
+        if (rank + dist < nranks) {
+            err = scan_send(rank + dist, epoch, round, partial, ret);
+            if (err && !ret)
+                ret = err;
+        }
+
+        if (rank - dist >= 0) {
+            err = scan_recv(epoch, round, &recv);
+            if (err && !ret)
+                ret = err;
+            partial += recv;
+            exclusive += recv;
+        }
+    }
+
+    if (ret) {
+        __error("exscan failed (epoch=%llu, ret=%d)",
+                (unsigned long long) epoch, ret);
+        return ret;
+    }
+
+    __debug("exscan (epoch=%llu, value=%llu) => %llu",
+            (unsigned long long) epoch, (unsigned long long) value,
+            (unsigned long long) exclusive);
+
+    *result = exclusive;
+
+    return 0;
+}
+
+static void metasim_rpc_handle_scan(hg_handle_t handle)
+{
+    hg_return_t hret;
+    metasim_scan_in_t in;
+    scan_msg_t *msg = NULL;
+
+    metasim_inject_delay(handle);
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        goto out;
+    }
+
+    msg = calloc(1, sizeof(*msg));
+    if (!msg) {
+        __error("failed to allocate memory for scan message");
+        goto out_free;
+    }
+
+    msg->epoch = in.epoch;
+    msg->round = in.round;
+    msg->value = in.value;
+    msg->ret = in.ret;
+
+    ABT_mutex_lock(scan.lock);
+    msg->next = scan.mailbox;
+    scan.mailbox = msg;
+    ABT_cond_broadcast(scan.cond);
+    ABT_mutex_unlock(scan.lock);
+
+out_free:
+    margo_free_input(handle, &in);
+out:
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_scan)
+
+/*
+ * all-to-all (personalized exchange)
+ *
+ * every server submits a buffer for each destination. payloads are framed as
+ * a sequence of records with source and destination, so that records from
+ * different sources can be bundled together. in the direct mode, each server
+ * sends a payload to every other server. with aggregation, servers send all
+ * records to the node leader, leaders exchange a bundle for each destination
+ * node, and then deliver the records to the servers on their node. this cuts
+ * the inter-node messages from N(N-1) to M(M-1) for M nodes.
+ *
+ * each server keeps at most @window payloads in flight. small payloads are
+ * carried inline, and larger ones are pulled by the receiver via bulk.
+ */
+
+typedef struct {
+    int32_t src;
+    int32_t dst;
+    uint64_t len;
+    char data[0];
+} a2a_rec_t;
+
+static inline a2a_rec_t *a2a_rec_next(a2a_rec_t *rec)
+{
+    return (a2a_rec_t *) &rec->data[rec->len];
+}
+
+#define a2a_rec_for_each(rec, buf, len)                                      \
+        for ((rec) = (a2a_rec_t *) (buf);                                    \
+             (char *) (rec) < (char *) (buf) + (len);                        \
+             (rec) = a2a_rec_next(rec))
+
+typedef struct {
+    char *buf;
+    uint64_t len;
+    uint64_t cap;
+} a2a_payload_t;
+
+enum {
+    A2A_PHASE_DIRECT = 0,
+    A2A_PHASE_GATHER,       /* to the node leader */
+    A2A_PHASE_EXCHANGE,     /* between node leaders */
+    A2A_PHASE_SCATTER,      /* from the node leader */
+    /* reduce-scatter */
+    A2A_PHASE_RS_TREE_REDUCE = 8,
+    A2A_PHASE_RS_TREE_SCATTER,
+    A2A_PHASE_RS_HALVING = 16,  /* + step */
+    A2A_PHASE_RS_RING = 64,     /* + step */
+};
+
+struct a2a_msg {
+    uint64_t epoch;
+    int32_t phase;
+    int32_t src;
+    uint64_t len;
+    void *buf;
+    struct a2a_msg *next;
+};
+
+typedef struct a2a_msg a2a_msg_t;
+
+typedef struct {
+    corpc_req_t creq;
+    hg_bulk_t bulk;
+    int posted;
+} a2a_req_t;
+
+/* messages and payload bytes sent by this server */
+typedef struct {
+    uint64_t msgs;
+    uint64_t bytes;
+} a2a_stat_t;
+
+static const hg_size_t a2a_inline_max = 2048;
+
+static struct {
+    ABT_mutex lock;
+    ABT_cond cond;
+    uint64_t epoch;
+    a2a_msg_t *mailbox;
+} a2a;
+
+static int a2a_payload_append(a2a_payload_t *p, int32_t src, int32_t dst,
+                              void *data, uint64_t len)
+{
+    uint64_t need = p->len + sizeof(a2a_rec_t) + len;
+    a2a_rec_t *rec = NULL;
+
+    if (need > p->cap) {
+        uint64_t cap = p->cap ? p->cap : 4096;
+        char *buf = NULL;
+
+        while (cap < need)
+            cap <<= 1;
+
+        buf = realloc(p->buf, cap);
+        if (!buf)
+            return ENOMEM;
+
+        p->buf = buf;
+        p->cap = cap;
+    }
+
+    rec = (a2a_rec_t *) &p->buf[p->len];
+    rec->src = src;
+    rec->dst = dst;
+    rec->len = len;
+    if (len > 0)
+        memcpy(rec->data, data, len);
+
+    p->len = need;
+
+    return 0;
+}
+
+static int a2a_payload_append_recs(a2a_payload_t *p, void *buf, uint64_t len)
+{
+    int ret = 0;
+    a2a_rec_t *rec = NULL;
+
+    a2a_rec_for_each(rec, buf, len) {
+        ret = a2a_payload_append(p, rec->src, rec->dst, rec->data, rec->len);
+        if (ret)
+            break;
+    }
+
+    return ret;
+}
+
+static void a2a_payload_free(a2a_payload_t *p)
+{
+    if (p->buf)
+        free(p->buf);
+    memset(p, 0, sizeof(*p));
+}
+
+static int a2a_post(uint64_t epoch, int32_t phase, int dest,
+                    a2a_payload_t *p, a2a_req_t *r)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_size_t len = p->len;
+    void *buf = p->buf;
+    metasim_a2a_in_t in;
+
+    in.epoch = epoch;
+    in.phase = phase;
+    in.src = metasim->rank;
+    in.len = len;
+    in.bulk = HG_BULK_NULL;
+    in.inline_buf.len = 0;
+    in.inline_buf.data = NULL;
+
+    r->bulk = HG_BULK_NULL;
+
+    if (len <= a2a_inline_max) {
+        in.inline_buf.len = len;
+        in.inline_buf.data = buf;
+    } else {
+        hret = margo_bulk_create(rpc_mid(rpcset.a2a, dest), 1, &buf, &len,
+                                 HG_BULK_READ_ONLY, &r->bulk);
+        if (hret != HG_SUCCESS) {
+            __error("margo_bulk_create failed");
+            return EIO;
+        }
+        in.bulk = r->bulk;
+    }
+
+    ret = corpc_get_handle(rpcset.a2a, dest, &r->creq);
+    if (ret)
+        goto out_free;
+
+    ret = corpc_forward_request(&in, &r->creq);
+    if (ret) {
+        margo_destroy(r->creq.handle);
+        goto out_free;
+    }
+
+    r->posted = 1;
+
+    return 0;
+
+out_free:
+    if (r->bulk != HG_BULK_NULL)
+        margo_bulk_free(r->bulk);
+
+    return EIO;
+}
+
+static int a2a_wait(a2a_req_t *r)
+{
+    int ret = 0;
+    metasim_a2a_out_t out;
+
+    if (!r->posted)
+        return 0;
+
+    ret = corpc_wait_request(&r->creq);
+    if (ret == 0) {
+        if (margo_get_output(r->creq.handle, &out) == HG_SUCCESS) {
+            ret = out.ret;
+            margo_free_output(r->creq.handle, &out);
+        } else {
+            ret = EIO;
+        }
+    }
+
+    margo_destroy(r->creq.handle);
+    if (r->bulk != HG_BULK_NULL)
+        margo_bulk_free(r->bulk);
+
+    r->posted = 0;
+
+    return ret;
+}
+
+/* sends @payloads[i] to @dests[i], keeping at most @window in flight */
+static int a2a_send(uint64_t epoch, int32_t phase, int count, int *dests,
+                    a2a_payload_t **payloads, int window, a2a_stat_t *stat)
+{
+    int ret = 0;
+    int rc = 0;
+    int i = 0;
+    int head = 0;
+    a2a_req_t *req = NULL;
+
+    if (count == 0)
+        return 0;
+
+    req = calloc(count, sizeof(*req));
+    if (!req)
+        return ENOMEM;
+
+    if (window <= 0)
+        window = count;
+
+    for (i = 0; i < count; i++) {
+        if (i - head >= window) {
+            rc = a2a_wait(&req[head++]);
+            ret = ret ? ret : rc;
+        }
+
+        rc = a2a_post(epoch, phase, dests[i], payloads[i], &req[i]);
+        if (rc) {
+            __error("failed to send all-to-all payload (dest=%d)", dests[i]);
+            ret = ret ? ret : rc;
+        } else {
+            stat->msgs++;
+            stat->bytes += payloads[i]->len;
+        }
+    }
+
+    while (head < count) {
+        rc = a2a_wait(&req[head++]);
+        ret = ret ? ret : rc;
+    }
+
+    free(req);
+
+    return ret;
+}
+
+/* waits for @count payloads of @phase, and appends their records to @p */
+static int a2a_recv(uint64_t epoch, int32_t phase, int count,
+                    a2a_payload_t *p)
+{
+    int ret = 0;
+    int received = 0;
+    a2a_msg_t **pos = NULL;
+    a2a_msg_t *msg = NULL;
+    a2a_msg_t *list = NULL;
+
+    ABT_mutex_lock(a2a.lock);
+
+    while (received < count) {
+        pos = &a2a.mailbox;
+
+        while (*pos) {
+            msg = *pos;
+            if (msg->epoch == epoch && msg->phase == phase) {
+                *pos = msg->next;
+                msg->next = list;
+                list = msg;
+                received++;
+            } else {
+                pos = &msg->next;
+            }
+        }
+
+        if (received < count)
+            ABT_cond_wait(a2a.cond, a2a.lock);
+    }
+
+    ABT_mutex_unlock(a2a.lock);
+
+    while (list) {
+        msg = list;
+        list = msg->next;
+
+        if (!ret)
+            ret = a2a_payload_append_recs(p, msg->buf, msg->len);
+
+        if (msg->buf)
+            free(msg->buf);
+        free(msg);
+    }
+
+    return ret;
+}
+
+static int a2a_direct(uint64_t epoch, void *sendbuf, uint64_t *sendlens,
+                      int window, a2a_payload_t *inbox, a2a_stat_t *stat)
+{
+    int ret = 0;
+    int i = 0;
+    int dst = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    uint64_t off = 0;
+    int *dests = NULL;
+    a2a_payload_t *out = NULL;
+    a2a_payload_t **payloads = NULL;
+
+    out = calloc(nranks, sizeof(*out));
+    dests = calloc(nranks, sizeof(*dests));
+    payloads = calloc(nranks, sizeof(*payloads));
+    if (!out || !dests || !payloads) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    for (dst = 0; dst < nranks; dst++) {
+        a2a_payload_t *p = dst == rank ? inbox : &out[dst];
+
+        ret = a2a_payload_append(p, rank, dst, (char *) sendbuf + off,
+                                 sendlens[dst]);
+        if (ret)
+            goto out;
+
+        off += sendlens[dst];
+    }
+
+    /* rotate destinations to spread the load */
+    for (i = 1; i < nranks; i++) {
+        dst = (rank + i) % nranks;
+        dests[i - 1] = dst;
+        payloads[i - 1] = &out[dst];
+    }
+
+    ret = a2a_send(epoch, A2A_PHASE_DIRECT, nranks - 1, dests, payloads,
+                   window, stat);
+
+    /* always drain the messages of this epoch */
+    i = a2a_recv(epoch, A2A_PHASE_DIRECT, nranks - 1, inbox);
+    ret = ret ? ret : i;
+
+out:
+    if (out) {
+        for (dst = 0; dst < nranks; dst++)
+            a2a_payload_free(&out[dst]);
+        free(out);
+    }
+    if (dests)
+        free(dests);
+    if (payloads)
+        free(payloads);
+
+    return ret;
+}
+
+static int a2a_aggregate(uint64_t epoch, void *sendbuf, uint64_t *sendlens,
+                         int window, a2a_payload_t *inbox, a2a_stat_t *stat)
+{
+    int ret = 0;
+    int rc = 0;
+    int r = 0;
+    int i = 0;
+    int count = 0;
+    int nlocal = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    int leader = metasim_get_node_leader(metasim, rank);
+    uint64_t off = 0;
+    int *dests = NULL;
+    a2a_rec_t *rec = NULL;
+    a2a_payload_t pool = { 0, };
+    a2a_payload_t *out = NULL;
+    a2a_payload_t **payloads = NULL;
+
+    out = calloc(nranks, sizeof(*out));
+    dests = calloc(nranks, sizeof(*dests));
+    payloads = calloc(nranks, sizeof(*payloads));
+    if (!out || !dests || !payloads) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    for (r = 0; r < nranks; r++) {
+        ret = a2a_payload_append(&pool, rank, r, (char *) sendbuf + off,
+                                 sendlens[r]);
+        if (ret)
+            goto out;
+
+        off += sendlens[r];
+    }
+
+    if (rank != leader) {
+        payloads[0] = &pool;
+        ret = a2a_send(epoch, A2A_PHASE_GATHER, 1, &leader, payloads,
+                       window, stat);
+
+        rc = a2a_recv(epoch, A2A_PHASE_SCATTER, 1, inbox);
+        ret = ret ? ret : rc;
+        goto out;
+    }
+
+    /* node leader: collect the records from the servers on this node */
+    for (r = 0; r < nranks; r++)
+        if (metasim_get_node_leader(metasim, r) == rank)
+            nlocal++;
+
+    ret = a2a_recv(epoch, A2A_PHASE_GATHER, nlocal - 1, &pool);
+
+    /* bundle the records for each destination node */
+    a2a_rec_for_each(rec, pool.buf, pool.len) {
+        rc = a2a_payload_append(
+                    &out[metasim_get_node_leader(metasim, rec->dst)],
+                    rec->src, rec->dst, rec->data, rec->len);
+        ret = ret ? ret : rc;
+    }
+    a2a_payload_free(&pool);
+
+    for (count = 0, i = 1; i < nranks; i++) {
+        r = (rank + i) % nranks;
+        if (metasim_get_node_leader(metasim, r) != r)
+            continue;
+
+        dests[count] = r;
+        payloads[count] = &out[r];
+        count++;
+    }
+
+    rc = a2a_send(epoch, A2A_PHASE_EXCHANGE, count, dests, payloads,
+                  window, stat);
+    ret = ret ? ret : rc;
+
+    /* out[rank] now holds all records destined to this node */
+    rc = a2a_recv(epoch, A2A_PHASE_EXCHANGE, count, &out[rank]);
+    ret = ret ? ret : rc;
+
+    pool = out[rank];
+    memset(&out[rank], 0, sizeof(out[rank]));
+
+    a2a_rec_for_each(rec, pool.buf, pool.len) {
+        a2a_payload_t *p = rec->dst == rank ? inbox : &out[rec->dst];
+
+        rc = a2a_payload_append(p, rec->src, rec->dst, rec->data, rec->len);
+        ret = ret ? ret : rc;
+    }
+
+    /* deliver to the servers on this node */
+    for (count = 0, r = 0; r < nranks; r++) {
+        if (r == rank || metasim_get_node_leader(metasim, r) != rank)
+            continue;
+
+        dests[count] = r;
+        payloads[count] = &out[r];
+        count++;
+    }
+
+    rc = a2a_send(epoch, A2A_PHASE_SCATTER, count, dests, payloads,
+                  window, stat);
+    ret = ret ? ret : rc;
+
+out:
+    a2a_payload_free(&pool);
+
+    if (out) {
+        for (r = 0; r < nranks; r++)
+            a2a_payload_free(&out[r]);
+        free(out);
+    }
+    if (dests)
+        free(dests);
+    if (payloads)
+        free(payloads);
+
+    return ret;
+}
+
+int metasim_rpc_alltoall(void *sendbuf, uint64_t *sendlens,
+                         int aggregate, int window,
+                         void **recvbuf, uint64_t *recvlens, uint64_t *msgs)
+{
+    int ret = 0;
+    int src = 0;
+    uint64_t epoch = 0;
+    uint64_t total = 0;
+    uint64_t *offsets = NULL;
+    char *buf = NULL;
+    a2a_rec_t *rec = NULL;
+    a2a_payload_t inbox = { 0, };
+    a2a_stat_t stat = { 0, };
+
+    ABT_mutex_lock(a2a.lock);
+    epoch = ++a2a.epoch;
+    ABT_mutex_unlock(a2a.lock);
+
+    if (aggregate)
+        ret = a2a_aggregate(epoch, sendbuf, sendlens, window, &inbox, &stat);
+    else
+        ret = a2a_direct(epoch, sendbuf, sendlens, window, &inbox, &stat);
+
+    *msgs = stat.msgs;
+
+    if (ret) {
+        __error("all-to-all failed (epoch=%llu, ret=%d)",
+                (unsigned long long) epoch, ret);
+        goto out;
+    }
+
+    /* place the received records in the order of source ranks */
+    memset(recvlens, 0, metasim->nranks * sizeof(*recvlens));
+
+    a2a_rec_for_each(rec, inbox.buf, inbox.len) {
+        recvlens[rec->src] += rec->len;
+        total += rec->len;
+    }
+
+    offsets = calloc(metasim->nranks, sizeof(*offsets));
+    buf = malloc(total > 0 ? total : 1);
+    if (!offsets || !buf) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    for (src = 1; src < metasim->nranks; src++)
+        offsets[src] = offsets[src - 1] + recvlens[src - 1];
+
+    a2a_rec_for_each(rec, inbox.buf, inbox.len) {
+        memcpy(&buf[offsets[rec->src]], rec->data, rec->len);
+        offsets[rec->src] += rec->len;
+    }
+
+    *recvbuf = buf;
+    buf = NULL;
+
+    __debug("all-to-all completed (epoch=%llu, received=%llu, msgs=%llu)",
+            (unsigned long long) epoch, (unsigned long long) total,
+            (unsigned long long) *msgs);
+
+out:
+    if (buf)
+        free(buf);
+    if (offsets)
+        free(offsets);
+    a2a_payload_free(&inbox);
+
+    return ret;
+}
+
+static void metasim_rpc_handle_a2a(hg_handle_t handle)
+{
+    int ret = 0;
+    hg_return_t hret;
+    hg_bulk_t bulk = HG_BULK_NULL;
+    hg_size_t len = 0;
+    void *buf = NULL;
+    const struct hg_info *info = NULL;
+    metasim_a2a_in_t in;
+    metasim_a2a_out_t out;
+    a2a_msg_t *msg = NULL;
+
+    hret = margo_get_input(handle, &in);
+    if (hret != HG_SUCCESS) {
+        __error("margo_get_input failed");
+        margo_destroy(handle);
+        return;
+    }
+
+    len = in.len;
+
+    if (in.inline_buf.len > 0) {
+        /* take over the decoded buffer */
+        buf = in.inline_buf.data;
+        in.inline_buf.data = NULL;
+    } else if (len > 0) {
+        buf = malloc(len);
+        if (!buf) {
+            ret = ENOMEM;
+            goto respond;
+        }
+
+        /* the request may have arrived over na+sm */
+        margo_instance_id mid = margo_hg_handle_get_instance(handle);
+
+        info = margo_get_info(handle);
+
+        hret = margo_bulk_create(mid, 1, &buf, &len,
+                                 HG_BULK_WRITE_ONLY, &bulk);
+        if (hret == HG_SUCCESS) {
+            hret = margo_bulk_transfer(mid, HG_BULK_PULL, info->addr,
+                                       in.bulk, 0, bulk, 0, len);
+            margo_bulk_free(bulk);
+        }
+
+        if (hret != HG_SUCCESS) {
+            __error("failed to pull all-to-all payload from rank %d", in.src);
+            ret = EIO;
+            goto respond;
+        }
+    }
+
+    msg = calloc(1, sizeof(*msg));
+    if (!msg) {
+        ret = ENOMEM;
+        goto respond;
+    }
+
+    msg->epoch = in.epoch;
+    msg->phase = in.phase;
+    msg->src = in.src;
+    msg->len = len;
+    msg->buf = buf;
+    buf = NULL;
+
+    ABT_mutex_lock(a2a.lock);
+    msg->next = a2a.mailbox;
+    a2a.mailbox = msg;
+    ABT_cond_broadcast(a2a.cond);
+    ABT_mutex_unlock(a2a.lock);
+
+respond:
+    if (buf)
+        free(buf);
+
+    out.ret = ret;
+    metasim_inject_respond(handle, &out);
+
+    margo_free_input(handle, &in);
+    margo_destroy(handle);
+}
+METASIM_DEFINE_RPC_HANDLER(metasim_rpc_handle_a2a)
+
+/*
+ * reduce-scatter
+ *
+ * each server contributes nranks blocks of @count elements, and server r ends
+ * up with block r reduced over all servers. recursive halving is used with a
+ * power-of-two number of servers (log N messages, (N-1)/N of the vector sent
+ * by each server), and a ring otherwise (N-1 messages of a single block). for
+ * comparison, the tree mode reduces the whole vector to rank 0 over the
+ * binary tree, and then scatters the blocks down the tree. the messages are
+ * exchanged through the all-to-all transport, with its own epochs.
+ */
+
+static uint64_t rs_epoch;
+
+static void reduce_vec(int op, int64_t *dst, const int64_t *src,
+                       uint64_t count)
+{
+    uint64_t i = 0;
+
+    switch (op) {
+    case METASIM_REDUCE_SUM:
+        for (i = 0; i < count; i++)
+            dst[i] += src[i];
+        break;
+
+    case METASIM_REDUCE_MIN:
+        for (i = 0; i < count; i++)
+            if (src[i] < dst[i])
+                dst[i] = src[i];
+        break;
+
+    case METASIM_REDUCE_MAX:
+        for (i = 0; i < count; i++)
+            if (src[i] > dst[i])
+                dst[i] = src[i];
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int rs_send(uint64_t epoch, int32_t phase, int dest,
+                   int64_t *vec, uint64_t count, a2a_stat_t *stat)
+{
+    int ret = 0;
+    a2a_payload_t p = { 0, };
+    a2a_payload_t *payloads[1] = { &p };
+
+    ret = a2a_payload_append(&p, metasim->rank, dest, vec,
+                             count * sizeof(int64_t));
+    if (ret == 0)
+        ret = a2a_send(epoch, phase, 1, &dest, payloads, 1, stat);
+
+    a2a_payload_free(&p);
+
+    return ret;
+}
+
+/* receives @nmsgs vectors of @count elements, and reduces them into @vec */
+static int rs_recv_reduce(uint64_t epoch, int32_t phase, int nmsgs, int op,
+                          int64_t *vec, uint64_t count)
+{
+    int ret = 0;
+    a2a_rec_t *rec = NULL;
+    a2a_payload_t p = { 0, };
+
+    ret = a2a_recv(epoch, phase, nmsgs, &p);
+    if (ret)
+        goto out;
+
+    a2a_rec_for_each(rec, p.buf, p.len) {
+        if (rec->len != count * sizeof(int64_t)) {
+            ret = EIO;
+            break;
+        }
+        reduce_vec(op, vec, (int64_t *) rec->data, count);
+    }
+
+out:
+    a2a_payload_free(&p);
+
+    return ret;
+}
+
+static int rs_halving(uint64_t epoch, int op, int64_t *vec, uint64_t count,
+                      a2a_stat_t *stat)
+{
+    int ret = 0;
+    int step = 0;
+    int dist = 0;
+    int rank = metasim->rank;
+    int lo = 0;
+    int hi = metasim->nranks;
+    int mid = 0;
+    int send_lo = 0;
+    int send_hi = 0;
+
+    for (dist = hi / 2; dist >= 1; dist >>= 1, step++) {
+        mid = lo + (hi - lo) / 2;
+
+        if (rank & dist) {
+            send_lo = lo;
+            send_hi = mid;
+            lo = mid;
+        } else {
+            send_lo = mid;
+            send_hi = hi;
+            hi = mid;
+        }
+
+        ret = rs_send(epoch, A2A_PHASE_RS_HALVING + step, rank ^ dist,
+                      &vec[send_lo * count], (send_hi - send_lo) * count,
+                      stat);
+        if (ret)
+            return ret;
+
+        ret = rs_recv_reduce(epoch, A2A_PHASE_RS_HALVING + step, 1, op,
+                             &vec[lo * count], (hi - lo) * count);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int rs_ring(uint64_t epoch, int op, int64_t *vec, uint64_t count,
+                   a2a_stat_t *stat)
+{
+    int ret = 0;
+    int step = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    int right = (rank + 1) % nranks;
+    int sblock = 0;
+    int rblock = 0;
+
+    /* block r ends up at rank r after visiting all other ranks */
+    for (step = 0; step < nranks - 1; step++) {
+        sblock = (rank - step - 1 + 2 * nranks) % nranks;
+        rblock = (rank - step - 2 + 2 * nranks) % nranks;
+
+        ret = rs_send(epoch, A2A_PHASE_RS_RING + step, right,
+                      &vec[sblock * count], count, stat);
+        if (ret)
+            return ret;
+
+        ret = rs_recv_reduce(epoch, A2A_PHASE_RS_RING + step, 1, op,
+                             &vec[rblock * count], count);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* appends the blocks for all ranks in the subtree of @node */
+static int rs_subtree_append(a2a_payload_t *p, int node, int k,
+                             int64_t **blocks, uint64_t count)
+{
+    int ret = 0;
+    int i = 0;
+    int child = 0;
+    int nranks = metasim->nranks;
+
+    ret = a2a_payload_append(p, metasim->rank, node, blocks[node],
+                             count * sizeof(int64_t));
+
+    for (i = 1; ret == 0 && i <= k; i++) {
+        child = node * k + i;
+        if (child >= nranks)
+            break;
+
+        ret = rs_subtree_append(p, child, k, blocks, count);
+    }
+
+    return ret;
+}
+
+static int rs_tree(uint64_t epoch, int op, int64_t *vec, uint64_t count,
+                   a2a_stat_t *stat)
+{
+    int ret = 0;
+    int i = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    int64_t **blocks = NULL;
+    a2a_rec_t *rec = NULL;
+    a2a_payload_t p = { 0, };
+    a2a_payload_t scatter = { 0, };
+    a2a_payload_t *payloads[1] = { &scatter };
+    metasim_rpc_tree_t tree;
+
+    ret = metasim_rpc_tree_init(rank, nranks, 0, 2, &tree);
+    if (ret)
+        return ret;
+
+    blocks = calloc(nranks, sizeof(*blocks));
+    if (!blocks) {
+        ret = ENOMEM;
+        goto out;
+    }
+
+    /* reduce the whole vector to rank 0 */
+    ret = rs_recv_reduce(epoch, A2A_PHASE_RS_TREE_REDUCE, tree.child_count,
+                         op, vec, nranks * count);
+    if (ret)
+        goto out;
+
+    if (tree.parent_rank >= 0) {
+        ret = rs_send(epoch, A2A_PHASE_RS_TREE_REDUCE, tree.parent_rank,
+                      vec, nranks * count, stat);
+        if (ret)
+            goto out;
+
+        /* receive the blocks for this subtree */
+        ret = a2a_recv(epoch, A2A_PHASE_RS_TREE_SCATTER, 1, &p);
+        if (ret)
+            goto out;
+
+        a2a_rec_for_each(rec, p.buf, p.len) {
+            if (rec->dst >= 0 && rec->dst < nranks &&
+                rec->len == count * sizeof(int64_t))
+                blocks[rec->dst] = (int64_t *) rec->data;
+        }
+    } else {
+        for (i = 0; i < nranks; i++)
+            blocks[i] = &vec[i * count];
+    }
+
+    for (i = 0; i < tree.child_count; i++) {
+        int child = tree.child_ranks[i];
+
+        scatter.len = 0;
+        ret = rs_subtree_append(&scatter, child, 2, blocks, count);
+        if (ret == 0)
+            ret = a2a_send(epoch, A2A_PHASE_RS_TREE_SCATTER, 1, &child,
+                           payloads, 1, stat);
+        if (ret)
+            goto out;
+    }
+
+    if (!blocks[rank]) {
+        ret = EIO;
+        goto out;
+    }
+
+    if (blocks[rank] != &vec[rank * count])
+        memcpy(&vec[rank * count], blocks[rank], count * sizeof(int64_t));
+
+out:
+    a2a_payload_free(&scatter);
+    a2a_payload_free(&p);
+    if (blocks)
+        free(blocks);
+    metasim_rpc_tree_free(&tree);
+
+    return ret;
+}
+
+int metasim_rpc_reduce_scatter(int op, int algo, int64_t *vec, uint64_t count,
+                               int64_t *result, uint64_t *bytes,
+                               uint64_t *msgs)
+{
+    int ret = 0;
+    int nranks = metasim->nranks;
+    uint64_t epoch = 0;
+    a2a_stat_t stat = { 0, };
+
+    if (op < 0 || op >= METASIM_REDUCE_MAX_OP || count == 0)
+        return EINVAL;
+
+    if (algo == METASIM_RS_AUTO)
+        algo = (nranks & (nranks - 1)) ? METASIM_RS_RING : METASIM_RS_HALVING;
+
+    if (algo == METASIM_RS_HALVING && (nranks & (nranks - 1))) {
+        __debug("recursive halving requires power-of-two servers, "
+                "falling back to ring");
+        algo = METASIM_RS_RING;
+    }
+
+    ABT_mutex_lock(a2a.lock);
+    epoch = ++rs_epoch;
+    ABT_mutex_unlock(a2a.lock);
+
+    switch (algo) {
+    case METASIM_RS_HALVING:
+        ret = rs_halving(epoch, op, vec, count, &stat);
+        break;
+
+    case METASIM_RS_RING:
+        ret = rs_ring(epoch, op, vec, count, &stat);
+        break;
+
+    case METASIM_RS_TREE:
+        ret = rs_tree(epoch, op, vec, count, &stat);
+        break;
+
+    default:
+        return EINVAL;
+    }
+
+    if (ret) {
+        __error("reduce-scatter failed (epoch=%llu, algo=%d, ret=%d)",
+                (unsigned long long) epoch, algo, ret);
+        return ret;
+    }
+
+    memcpy(result, &vec[metasim->rank * count], count * sizeof(int64_t));
+
+    *bytes = stat.bytes;
+    *msgs = stat.msgs;
+
+    __debug("reduce-scatter completed (epoch=%llu, algo=%d, bytes=%llu, "
+            "msgs=%llu)", (unsigned long long) epoch, algo,
+            (unsigned long long) stat.bytes, (unsigned long long) stat.msgs);
+
+    return 0;
+}
+
+/*
+ * rpc: sum
+ */
+
+/* registers all rpcs on @mid. rpc ids only depend on the names, so the ids
+ * are the same on the fabric and the na+sm instance. */
+static void rpc_register_instance(margo_instance_id mid)
+{
+    rpcset.ping =
+        METASIM_REGISTER(mid, METASIM_RPC_PING,
+                         metasim_rpc_ping_in_t,
+                         metasim_rpc_ping_out_t,
+                         metasim_rpc_handle_ping);
+    rpcset.sum =
+        METASIM_REGISTER(mid, "metasim_rpc_sum",
+                         metasim_sum_in_t,
+                         metasim_sum_out_t,
+                         metasim_rpc_handle_sum);
+    rpcset.gather =
+        METASIM_REGISTER(mid, "metasim_rpc_gather",
+                         metasim_gather_in_t,
+                         metasim_gather_out_t,
+                         metasim_rpc_handle_gather);
+    rpcset.gather_release =
+        METASIM_REGISTER(mid, "metasim_rpc_gather_release",
+                         metasim_gather_release_in_t,
+                         void,
+                         metasim_rpc_handle_gather_release);
+    margo_registered_disable_response(mid, rpcset.gather_release, HG_TRUE);
+    rpcset.gather_bcast =
+        METASIM_REGISTER(mid, "metasim_rpc_gather_bcast",
+                         metasim_gather_bcast_in_t,
+                         metasim_gather_bcast_out_t,
+                         metasim_rpc_handle_gather_bcast);
+
+    rpcset.barrier_arrive =
+        METASIM_REGISTER(mid, "metasim_rpc_barrier_arrive",
+                         metasim_barrier_in_t,
+                         void,
+                         metasim_rpc_handle_barrier_arrive);
+    margo_registered_disable_response(mid, rpcset.barrier_arrive, HG_TRUE);
+    rpcset.barrier_release =
+        METASIM_REGISTER(mid, "metasim_rpc_barrier_release",
+                         metasim_barrier_in_t,
+                         void,
+                         metasim_rpc_handle_barrier_release);
+    margo_registered_disable_response(mid, rpcset.barrier_release, HG_TRUE);
+    rpcset.barrier_dissem =
+        METASIM_REGISTER(mid, "metasim_rpc_barrier_dissem",
+                         metasim_barrier_in_t,
+                         void,
+                         metasim_rpc_handle_barrier_dissem);
+    margo_registered_disable_response(mid, rpcset.barrier_dissem, HG_TRUE);
+    rpcset.bcast_seg =
+        METASIM_REGISTER(mid, "metasim_rpc_bcast_seg",
+                         metasim_bcast_seg_in_t,
+                         metasim_bcast_seg_out_t,
+                         metasim_rpc_handle_bcast_seg);
+
+    rpcset.merge_request =
+        METASIM_REGISTER(mid, "metasim_rpc_merge_request",
+                         metasim_merge_in_t,
+                         void,
+                         metasim_rpc_handle_merge_request);
+    margo_registered_disable_response(mid, rpcset.merge_request, HG_TRUE);
+    rpcset.merge_reduce =
+        METASIM_REGISTER(mid, "metasim_rpc_merge_reduce",
+                         metasim_merge_in_t,
+                         metasim_merge_out_t,
+                         metasim_rpc_handle_merge_reduce);
+    rpcset.merge_result =
+        METASIM_REGISTER(mid, "metasim_rpc_merge_result",
+                         metasim_merge_result_in_t,
+                         metasim_merge_out_t,
+                         metasim_rpc_handle_merge_result);
+
+    rpcset.sum_down =
+        METASIM_REGISTER(mid, "metasim_rpc_sum_down",
+                         metasim_sum_in_t,
+                         void,
+                         metasim_rpc_handle_sum_down);
+    margo_registered_disable_response(mid, rpcset.sum_down, HG_TRUE);
+    rpcset.sum_up =
+        METASIM_REGISTER(mid, "metasim_rpc_sum_up",
+                         metasim_sum_up_in_t,
+                         void,
+                         metasim_rpc_handle_sum_up);
+    margo_registered_disable_response(mid, rpcset.sum_up, HG_TRUE);
+
+    rpcset.scan =
+        METASIM_REGISTER(mid, "metasim_rpc_scan",
+                         metasim_scan_in_t,
+                         void,
+                         metasim_rpc_handle_scan);
+    margo_registered_disable_response(mid, rpcset.scan, HG_TRUE);
+
+    rpcset.a2a =
+        METASIM_REGISTER(mid, "metasim_rpc_a2a",
+                         metasim_a2a_in_t,
+                         metasim_a2a_out_t,
+                         metasim_rpc_handle_a2a);
+}
+
+void metasim_rpc_register(void)
+{
+    ABT_mutex_create(&gather_lock);
+    ABT_mutex_create(&barrier.lock);
+    ABT_mutex_create(&bcast_lock);
+    ABT_cond_create(&barrier.cond);
+    rpc_tree_init(0, 2, &barrier.tree);
+    ABT_mutex_create(&a2a.lock);
+    ABT_cond_create(&a2a.cond);
+    ABT_mutex_create(&scan.lock);
+    ABT_cond_create(&scan.cond);
+    ABT_mutex_create(&merge.lock);
+    ABT_cond_create(&merge.cond);
+    rpc_tree_init(0, 2, &merge.tree);
+
+    rpc_register_instance(metasim->mid);
+    if (metasim->sm_mid != MARGO_INSTANCE_NULL)
+        rpc_register_instance(metasim->sm_mid);
+
+    rpc_tree_init(metasim->rank, 2, &bcast_tree);
+}
+
+void metasim_rpc_set_tree_hier(int hier)
+{
+    tree_hier = hier;
+
+    /* rebuild the trees that were computed at registration */
+    metasim_rpc_tree_free(&barrier.tree);
+    rpc_tree_init(0, 2, &barrier.tree);
+    metasim_rpc_tree_free(&merge.tree);
+    rpc_tree_init(0, 2, &merge.tree);
+    metasim_rpc_tree_free(&bcast_tree);
+    rpc_tree_init(metasim->rank, 2, &bcast_tree);
+}
+
+/*
+ * pre-warming
+ */
+
+/* peers pinged at a time while pre-warming. a local peer is pinged over both
+ * na+sm and the fabric, so up to twice as many requests are in flight. */
+#define PREWARM_WINDOW 32
+
+static void prewarm_ult(void *arg)
+{
+    (void) arg;
+}
+
+/* creates and joins @count ults in the handler pool of @mid, so that the
+ * ult descriptors and stacks are allocated before the first request */
+static void prewarm_pool(margo_instance_id mid, int count)
+{
+    int i = 0;
+    ABT_pool pool = ABT_POOL_NULL;
+    ABT_thread *ults = NULL;
+
+    if (count <= 0 || margo_get_handler_pool(mid, &pool) != 0)
+        return;
+
+    ults = calloc(count, sizeof(*ults));
+    if (!ults)
+        return;
+
+    for (i = 0; i < count; i++)
+        if (ABT_thread_create(pool, prewarm_ult, NULL, ABT_THREAD_ATTR_NULL,
+                              &ults[i]) != ABT_SUCCESS)
+            break;
+
+    while (i-- > 0)
+        ABT_thread_free(&ults[i]);
+
+    free(ults);
+}
+
+/* pings @addr on @mid, which sets up the connection as a side effect */
+static int prewarm_post(margo_instance_id mid, hg_addr_t addr,
+                        corpc_req_t *r)
+{
+    hg_return_t hret;
+    metasim_rpc_ping_in_t in;
+
+    in.ping = metasim->rank;
+    r->handle = HG_HANDLE_NULL;
+
+    hret = margo_create(mid, addr, rpcset.ping, &r->handle);
+    if (hret != HG_SUCCESS) {
+        r->handle = HG_HANDLE_NULL;
+        return EIO;
+    }
+
+    hret = margo_iforward(r->handle, &in, &r->req);
+    if (hret != HG_SUCCESS) {
+        margo_destroy(r->handle);
+        r->handle = HG_HANDLE_NULL;
+        return EIO;
+    }
+
+    return 0;
+}
+
+static void prewarm_mark_tree(char *mark, metasim_rpc_tree_t *t)
+{
+    int i = 0;
+
+    if (t->parent_rank >= 0)
+        mark[t->parent_rank] = 1;
+
+    for (i = 0; i < t->child_count; i++)
+        mark[t->child_ranks[i]] = 1;
+}
+
+int metasim_rpc_prewarm(int all, int ults)
+{
+    int ret = 0;
+    int rc = 0;
+    int i = 0;
+    int n = 0;
+    int d = 0;
+    int peers = 0;
+    int posted = 0;
+    int rank = metasim->rank;
+    int nranks = metasim->nranks;
+    char *mark = NULL;
+    corpc_req_t req[2*PREWARM_WINDOW];
+
+    mark = calloc(nranks, sizeof(*mark));
+    if (!mark)
+        return ENOMEM;
+
+    if (all) {
+        memset(mark, 1, nranks);
+    } else {
+        /* the trees rooted at rank 0 and at ourselves, and the partners in
+         * the dissemination barrier and the scan */
+        prewarm_mark_tree(mark, &barrier.tree);
+        prewarm_mark_tree(mark, &merge.tree);
+        prewarm_mark_tree(mark, &bcast_tree);
+
+        for (d = 1; d < nranks; d <<= 1) {
+            mark[(rank + d) % nranks] = 1;
+            mark[(rank - d + nranks) % nranks] = 1;
+        }
+    }
+    mark[rank] = 0;
+
+    for (i = 0; i < nranks; ) {
+        n = 0;
+        peers = 0;
+
+        for ( ; i < nranks && peers < PREWARM_WINDOW; i++) {
+            if (!mark[i])
+                continue;
+
+            peers++;
+
+            rc = prewarm_post(metasim_get_rank_mid(metasim, i),
+                              metasim_get_rank_addr(metasim, i), &req[n++]);
+            if (!ret)
+                ret = rc;
+
+            /* fabric-only rpcs still go over the fabric to local peers */
+            if (metasim_rank_use_sm(metasim, i)) {
+                rc = prewarm_post(metasim->mid, metasim->peer_addrs[i],
+                                  &req[n++]);
+                if (!ret)
+                    ret = rc;
+            }
+        }
+
+        for (d = 0; d < n; d++) {
+            if (req[d].handle == HG_HANDLE_NULL)
+                continue;
+
+            /* corpc_wait_request returns a mercury error code */
+            if (corpc_wait_request(&req[d]) && !ret)
+                ret = EIO;
+            margo_destroy(req[d].handle);
+            posted++;
+        }
+    }
+
+    prewarm_pool(metasim->mid, ults);
+    if (metasim->sm_mid != MARGO_INSTANCE_NULL)
+        prewarm_pool(metasim->sm_mid, ults);
+
+    __debug("pre-warmed %d connections (%s), %d ults", posted,
+            all ? "all peers" : "tree neighbors", ults);
+
+    free(mark);
+
+    return ret;
+}
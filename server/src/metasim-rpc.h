@@ -2,15 +2,197 @@
 #define __METASIM_RPC_H
 
 #include <stdint.h>
+#include <string.h>
 
 void metasim_rpc_register(void);
 
+/*
+ * records for gather/allgather. each server contributes one record, and the
+ * gathered buffer is a concatenation of records, each prefixed by the header
+ * below.
+ */
+enum {
+    METASIM_RECORD_TEST = 0,    /* synthetic record of the given size */
+    METASIM_RECORD_HOSTNAME,    /* hostname of the server */
+    METASIM_RECORD_STATS,       /* server statistics in text */
+    METASIM_RECORD_MAX,
+};
+
+struct metasim_record {
+    int32_t rank;               /* rank of the contributing server */
+    uint32_t len;               /* length of data */
+    char data[0];
+};
+
+typedef struct metasim_record metasim_record_t;
+
+/* records are packed back to back, so the headers are not aligned and are
+ * copied out while iterating over a gathered buffer */
+typedef struct {
+    int32_t rank;
+    uint32_t len;
+    const char *data;
+    uint64_t next;              /* offset of the next record */
+} metasim_record_iter_t;
+
+static inline int metasim_record_next(metasim_record_iter_t *it,
+                                      const void *buf, uint64_t len)
+{
+    metasim_record_t hdr;
+
+    if (it->next > len || len - it->next < sizeof(hdr))
+        return 0;
+
+    memcpy(&hdr, (const char *) buf + it->next, sizeof(hdr));
+    if (hdr.len > len - it->next - sizeof(hdr))
+        return 0;
+
+    it->rank = hdr.rank;
+    it->len = hdr.len;
+    it->data = (const char *) buf + it->next + sizeof(hdr);
+    it->next += sizeof(hdr) + hdr.len;
+
+    return 1;
+}
+
+#define metasim_record_for_each(it, buf, len)                                \
+        for ((it)->next = 0; metasim_record_next((it), (buf), (len)); )
+
+/* barrier algorithms */
+enum {
+    METASIM_BARRIER_TREE = 0,       /* fan-in then fan-out over the tree */
+    METASIM_BARRIER_DISSEMINATION,  /* dissemination barrier */
+};
+
 /*
  * rpc wrappers
  */
 int metasim_rpc_invoke_ping(int32_t targetrank, int32_t ping, int32_t *pong);
 
+/* a single ntp-style round trip to @target. @offset returns the clock of
+ * @target minus the local clock, and @rtt the round trip time excluding the
+ * time spent in the handler, both in usec. */
+int metasim_rpc_clock_probe(int32_t target, int64_t *offset, int64_t *rtt);
+
 int metasim_rpc_invoke_sum(int32_t seed, int32_t *sum);
 
-#endif /* __METASIM_RPC_H */
+/* @count independent sums in a single tree traversal. @sums should have room
+ * for @count elements. */
+int metasim_rpc_invoke_sum_batch(int32_t count, int32_t *seeds, int32_t *sums);
+
+/* same as metasim_rpc_invoke_sum_batch, but responds within @timeout_usec (0:
+ * the server default) with the partial sums of the servers that made it.
+ * children that miss their deadline are bypassed by asking their children
+ * directly. @contributors returns the number of servers in the sums. */
+int metasim_rpc_invoke_sum_timed(int32_t count, int32_t *seeds,
+                                 int32_t *sums, uint64_t timeout_usec,
+                                 int32_t *contributors);
+
+/* default deadline of rooted sums in usec (0: wait for all servers). on a
+ * partial result, metasim_rpc_invoke_sum_batch fails with ETIMEDOUT, or with
+ * EIO without a deadline. */
+void metasim_rpc_set_op_timeout(uint64_t usec);
+
+uint64_t metasim_rpc_get_op_timeout(void);
+
+/* with a non-zero window, concurrent sums from different roots are merged into
+ * a single allreduce, started by rank 0 @usec after the first request. */
+void metasim_rpc_set_merge_window(uint64_t usec);
+
+void metasim_rpc_merge_stats(uint64_t *rounds, uint64_t *merged);
 
+/* with @noreply set, sums use one-way rpcs both for requests to children and
+ * for partial sums reported to parents. */
+void metasim_rpc_set_noreply(int noreply);
+
+/* with @hier set, sum, gather, barrier and merge trees are built in two
+ * levels: the servers on a node fan in to the node leader, and the node
+ * leaders form a binary tree. must be set identically on all servers. */
+void metasim_rpc_set_tree_hier(int hier);
+
+/* number of rpc messages (including responses) sent and received for sums */
+void metasim_rpc_sum_msg_count(uint64_t *sent, uint64_t *received);
+
+/* exclusive prefix sum of @value over server ranks, i.e., rank r gets the sum
+ * of values from ranks 0..r-1 (0 at rank 0). every server should call this
+ * exactly once per scan, like MPI_Exscan. */
+int metasim_rpc_exscan(uint64_t value, uint64_t *result);
+
+#define METASIM_A2A_WINDOW_DEFAULT  16
+
+/* personalized all-to-all exchange. @sendbuf holds the buffers for all
+ * destinations in the rank order, with @sendlens[r] bytes for rank r. on
+ * success, @recvbuf holds the received buffers in the source rank order (to be
+ * freed by the caller), with @recvlens[r] bytes from rank r. at most @window
+ * transfers are in flight from each server. if @aggregate is set, records are
+ * routed through node leaders. @msgs returns the number of messages sent by
+ * this server. every server should call this, like MPI_Alltoallv. */
+int metasim_rpc_alltoall(void *sendbuf, uint64_t *sendlens,
+                         int aggregate, int window,
+                         void **recvbuf, uint64_t *recvlens, uint64_t *msgs);
+
+/* reduction operators */
+enum {
+    METASIM_REDUCE_SUM = 0,
+    METASIM_REDUCE_MIN,
+    METASIM_REDUCE_MAX,
+    METASIM_REDUCE_MAX_OP,
+};
+
+/* reduce-scatter algorithms */
+enum {
+    METASIM_RS_AUTO = 0,    /* halving for power-of-two, ring otherwise */
+    METASIM_RS_HALVING,     /* recursive halving */
+    METASIM_RS_RING,
+    METASIM_RS_TREE,        /* reduce to rank 0, then scatter over the tree */
+};
+
+/* @vec holds nranks blocks of @count elements, and is used as scratch space.
+ * @result returns block r of the reduced vector at rank r. @bytes and @msgs
+ * return the payload bytes and messages sent by this server. every server
+ * should call this, like MPI_Reduce_scatter_block. */
+int metasim_rpc_reduce_scatter(int op, int algo, int64_t *vec, uint64_t count,
+                               int64_t *result, uint64_t *bytes,
+                               uint64_t *msgs);
+
+/* gathers records of @kind from all servers. on success, @buf should be freed
+ * by the caller. */
+int metasim_rpc_invoke_gather(int32_t kind, int32_t size,
+                              void **buf, uint64_t *len);
+
+/* same as gather, but the gathered buffer is also delivered to all servers.
+ * non-root servers can access it via metasim_rpc_get_allgather(). */
+int metasim_rpc_invoke_allgather(int32_t kind, int32_t size,
+                                 void **buf, uint64_t *len);
+
+/* copies the last allgather result of @kind delivered to this server */
+int metasim_rpc_get_allgather(int32_t kind, void **buf, uint64_t *len);
+
+enum {
+    METASIM_BCAST_TREE_KARY = 0,
+    METASIM_BCAST_TREE_DOUBLE,      /* binary tree and its mirror */
+};
+
+/* broadcasts @buf to all servers over a @degree-ary tree, in segments of
+ * @segsize bytes. each server forwards a segment to its children as soon as
+ * it receives the segment, so segments are pipelined through the tree. with
+ * METASIM_BCAST_TREE_DOUBLE, segments alternate between two binary trees. */
+int metasim_rpc_invoke_bcast(void *buf, uint64_t len, uint64_t segsize,
+                             int32_t degree, int32_t tree_type);
+
+/* default segment size for bcast */
+#define METASIM_BCAST_SEGSIZE_DEFAULT   (64*1024)
+
+/* blocks the calling ult until all servers enter the barrier. all servers
+ * should call the barrier in the same order. */
+int metasim_rpc_barrier(int type);
+
+/* peak memory used for gather buffers at this server */
+uint64_t metasim_rpc_gather_mem_peak(void);
+
+/* sets up the connections to the tree neighbors (or to all servers with
+ * @all) by pinging them, and warms up the handler pools with @ults ults, so
+ * that the first collective does not pay for them. */
+int metasim_rpc_prewarm(int all, int ults);
+
+#endif /* __METASIM_RPC_H */
@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -28,14 +29,43 @@
 #include "metasim-server.h"
 #include "metasim-rpc.h"
 #include "metasim-listener.h"
+#include "metasim-op.h"
+#include "metasim-poll.h"
+#include "metasim-inject.h"
+#include "metasim-trace.h"
+#include "metasim-clock.h"
+#include "metasim-diag.h"
+#include "metasim-timeline.h"
+#include "metasim-perf.h"
 
 metasim_server_t _metasim;
 metasim_server_t *metasim = &_metasim;
 
-static int metasim_proto;
-static char *metasim_proto_prefix[] = {
-    "ofi+tcp://", "ofi+verbs", 0
-};
+/* mercury plugin string, e.g., ofi+tcp://, ofi+verbs, ofi+sockets://,
+ * ofi+shm://, bmi+tcp://, na+sm:// or ucx+all://. the optional hint (network
+ * interface, domain or host:port) is appended after "://". */
+static const char *metasim_transport = "ofi+tcp://";
+static const char *metasim_transport_hint;
+static char metasim_transport_str[512];
+
+static const char *comm_transport(void)
+{
+    const char *sep = "";
+
+    if (!metasim_transport_hint)
+        return metasim_transport;
+
+    if (!strstr(metasim_transport, "://"))
+        sep = "://";
+
+    snprintf(metasim_transport_str, sizeof(metasim_transport_str), "%s%s%s",
+             metasim_transport, sep, metasim_transport_hint);
+
+    return metasim_transport_str;
+}
+
+/* use the rpc barrier instead of mpi, once the rpcs are registered */
+static int rpc_fence;
 
 static void __fence(const char *format, ...)
 {
@@ -45,19 +75,24 @@ static void __fence(const char *format, ...)
     __debug(format, args);
     va_end(args);
 
-    metasim_fence();
+    if (rpc_fence)
+        metasim_rpc_barrier(METASIM_BARRIER_TREE);
+    else
+        metasim_fence();
 }
 
 static char hostname[NAME_MAX];
 static const char *server_addr_dir = "logs/addr";
 
-static int write_addr_file(int rank, const char *str)
+/* the fabric address of each rank is in logs/addr/<rank>, and the na+sm
+ * address, if enabled, is in logs/addr/<rank>.sm */
+static int write_addr_file(int rank, const char *suffix, const char *str)
 {
     int ret = 0;
     char path[PATH_MAX];
     FILE *fp = NULL;
 
-    sprintf(path, "%s/%d", server_addr_dir, rank);
+    sprintf(path, "%s/%d%s", server_addr_dir, rank, suffix);
 
     fp = fopen(path, "w");
     if (fp) {
@@ -72,7 +107,11 @@ static int write_addr_file(int rank, const char *str)
     return ret;
 }
 
-static int read_addr_file(margo_instance_id mid, int nranks, hg_addr_t *addrs)
+/* reads the addresses of the ranks whose node leader is @leader, or of all
+ * ranks if @leaders is NULL */
+static int read_addr_file(margo_instance_id mid, const char *suffix,
+                          int nranks, const int *leaders, int leader,
+                          hg_addr_t *addrs)
 {
     int ret = 0;
     int i = 0;
@@ -83,7 +122,12 @@ static int read_addr_file(margo_instance_id mid, int nranks, hg_addr_t *addrs)
     hg_return_t hret;
 
     for (i = 0; i < nranks; i++) {
-        sprintf(path, "%s/%d", server_addr_dir, i);
+        if (leaders && leaders[i] != leader) {
+            addrs[i] = HG_ADDR_NULL;
+            continue;
+        }
+
+        sprintf(path, "%s/%d%s", server_addr_dir, i, suffix);
         fp = fopen(path, "r");
         if (fp) {
             fgets(addrstr, 511, fp);
@@ -106,17 +150,61 @@ static int read_addr_file(margo_instance_id mid, int nranks, hg_addr_t *addrs)
     return ret;
 }
 
-static int comm_init(int mpi_rank, int mpi_nranks)
+/* servers on the same node are identified by exchanging hostnames, and the
+ * lowest rank on the node is used as the node leader. */
+static int comm_init_node_map(int rank, int nranks, int **node_leaders)
+{
+    int i = 0;
+    int leader = rank;
+    int *leaders = NULL;
+    char *names = NULL;
+
+    leaders = calloc(nranks, sizeof(*leaders));
+    names = calloc(nranks, NAME_MAX);
+    if (!leaders || !names) {
+        free(leaders);
+        free(names);
+        return ENOMEM;
+    }
+
+    MPI_Allgather(hostname, NAME_MAX, MPI_CHAR, names, NAME_MAX, MPI_CHAR,
+                  MPI_COMM_WORLD);
+
+    for (i = 0; i < nranks; i++) {
+        char *name = &names[i * NAME_MAX];
+        int j = 0;
+
+        for (j = 0; j < i; j++)
+            if (!strncmp(name, &names[j * NAME_MAX], NAME_MAX))
+                break;
+
+        leaders[i] = j < i ? leaders[j] : i;
+    }
+
+    free(names);
+
+    leader = leaders[rank];
+    __debug("node leader of rank %d: %d (%s)", rank, leader, hostname);
+
+    *node_leaders = leaders;
+
+    return 0;
+}
+
+static int comm_init(int mpi_rank, int mpi_nranks, int use_sm)
 {
     int ret = 0;
     int rank = 0;
     int nranks = 0;
     margo_instance_id mid;
+    margo_instance_id sm_mid = MARGO_INSTANCE_NULL;
     char addrstr[512];
     size_t addrstr_len = 512;
     hg_addr_t addr_self;
     hg_addr_t *peer_addrs;
-    const char *protostr = metasim_proto_prefix[metasim_proto];
+    hg_addr_t *sm_addrs = NULL;
+    int *node_leaders;
+    const char *protostr = comm_transport();
 
     __debug("initializa the communication (protocol: %s)", protostr);
 
@@ -132,41 +220,181 @@ static int comm_init(int mpi_rank, int mpi_nranks)
 
     margo_addr_self(mid, &addr_self);
     margo_addr_to_string(mid, addrstr, &addrstr_len, addr_self);
+    margo_addr_free(mid, addr_self);
 
     __debug("margo initialized: %s", addrstr);
 
-    ret = write_addr_file(rank, addrstr);
+    ret = write_addr_file(rank, "", addrstr);
     assert(0 == ret);
 
+    if (use_sm) {
+        sm_mid = margo_init("na+sm://", MARGO_SERVER_MODE, 1, 4);
+        if (sm_mid == MARGO_INSTANCE_NULL) {
+            __error("failed to initialize margo for na+sm");
+            return EIO;
+        }
+
+        addrstr_len = 512;
+        margo_addr_self(sm_mid, &addr_self);
+        margo_addr_to_string(sm_mid, addrstr, &addrstr_len, addr_self);
+        margo_addr_free(sm_mid, addr_self);
+
+        __debug("margo initialized for local peers: %s", addrstr);
+
+        ret = write_addr_file(rank, ".sm", addrstr);
+        assert(0 == ret);
+    }
+
     peer_addrs = calloc(nranks, sizeof(*peer_addrs));
     assert(peer_addrs);
 
+    ret = comm_init_node_map(rank, nranks, &node_leaders);
+    assert(0 == ret);
+
     __fence("reading peer addresses");
 
-    ret = read_addr_file(mid, nranks, peer_addrs);
+    ret = read_addr_file(mid, "", nranks, NULL, 0, peer_addrs);
     assert(0 == ret);
 
+    if (use_sm) {
+        sm_addrs = calloc(nranks, sizeof(*sm_addrs));
+        assert(sm_addrs);
+
+        ret = read_addr_file(sm_mid, ".sm", nranks, node_leaders,
+                             node_leaders[rank], sm_addrs);
+        assert(0 == ret);
+    }
+
     /* initialize the global context */
     metasim->rank = rank;
     metasim->nranks = nranks;
     metasim->mid = mid;
+    metasim->transport = protostr;
     metasim->peer_addrs = peer_addrs;
+    metasim->node_leaders = node_leaders;
+    metasim->sm_mid = sm_mid;
+    metasim->sm_addrs = sm_addrs;
 
     return 0;
 }
 
+static uint64_t merge_window;
+static int noreply;
+static uint64_t op_timeout;
+static int trace_rate;
+static uint64_t timeline_events;
+static int perf_counters;
+static int clock_samples;
+static metasim_diag_conf_t diag_conf;
+static double clock_interval;
+static int topo_tree;
+static int use_sm;
+
+/* progress modes of the server instances and the listener */
+static metasim_progress_conf_t progress_conf;
+static metasim_progress_conf_t listener_progress_conf;
+
+/* wall clock and cpu time when the server started to serve */
+static double serve_start;
+static double serve_cpu_start;
+
+/* reports the cpu utilization since the server started to serve, which
+ * mostly shows the cost of the progress mode while idle */
+static void report_cpu(void)
+{
+    double wall = MPI_Wtime() - serve_start;
+    double cpu = metasim_poll_cpu_time() - serve_cpu_start;
+
+    if (serve_start == .0f || wall <= 0)
+        return;
+
+    __debug("cpu utilization (progress=%s, listener=%s): %.3lf/%.3lf seconds "
+            "(%.1lf%%)", metasim_progress_name(progress_conf.mode),
+            metasim_progress_name(listener_progress_conf.mode), cpu, wall,
+            100.0 * cpu / wall);
+
+    /* cpu,rank,progress,listener progress,wall,cpu,utilization(%),
+     * transport,injection */
+    printf("## cpu,%d,%s,%s,%.3lf,%.3lf,%.1lf,%s,%s\n", metasim->rank,
+           metasim_progress_name(progress_conf.mode),
+           metasim_progress_name(listener_progress_conf.mode), wall, cpu,
+           100.0 * cpu / wall, metasim->transport, metasim_inject_describe());
+    fflush(stdout);
+}
+
+/* clock,rank,offset,uncertainty,min rtt (usec),samples,rounds,transport,
+ * injection */
+static void report_clock(void)
+{
+    metasim_clock_est_t est;
+
+    metasim_clock_get(&est);
+
+    printf("## clock,%d,%lld,%lld,%lld,%d,%llu,%s,%s\n", metasim->rank,
+           (long long) est.offset, (long long) est.uncertainty,
+           (long long) est.rtt, est.samples,
+           (unsigned long long) est.rounds, metasim->transport,
+           metasim_inject_describe());
+    fflush(stdout);
+}
+
 static void cleanup(void)
 {
     int i = 0;
+    uint64_t rounds = 0;
+    uint64_t merged = 0;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+
+    if (metasim)
+        report_cpu();
+
+    if (metasim && clock_samples > 0)
+        report_clock();
+
+    if (metasim)
+        metasim_perf_report(stdout);
+
+    if (metasim) {
+        if (metasim_trace_dump())
+            __error("failed to write the trace events");
+        if (metasim_timeline_dump())
+            __error("failed to write the timeline");
+
+        /* while all instances are alive */
+        metasim_diag_dump();
+    }
+
+    if (metasim) {
+        metasim_rpc_sum_msg_count(&sent, &received);
+        __debug("sum messages (%s, %s tree): sent=%llu, received=%llu",
+                noreply ? "noreply" : "reply", topo_tree ? "topo" : "flat",
+                (unsigned long long) sent, (unsigned long long) received);
+    }
+
+    if (metasim && merge_window > 0) {
+        metasim_rpc_merge_stats(&rounds, &merged);
+        __debug("merged sums: %llu local sums, %llu rounds (rank 0 only)",
+                (unsigned long long) merged, (unsigned long long) rounds);
+    }
 
     if (metasim) {
         for (i = 0; i < metasim->nranks; i++) {
             if (metasim->peer_addrs[i] != HG_ADDR_NULL)
                 margo_addr_free(metasim->mid, metasim->peer_addrs[i]);
+            if (metasim->sm_addrs && metasim->sm_addrs[i] != HG_ADDR_NULL)
+                margo_addr_free(metasim->sm_mid, metasim->sm_addrs[i]);
         }
 
+        if (metasim->sm_mid)
+            margo_finalize(metasim->sm_mid);
+        free(metasim->sm_addrs);
+
         if (metasim->mid)
             margo_finalize(metasim->mid);
+
+        if (metasim->node_leaders)
+            free(metasim->node_leaders);
     }
 
     metasim_log_close();
@@ -183,17 +411,71 @@ static int comm_probe_peers(void)
 
     for (i = 0; i < metasim->nranks; i++) {
         hg_addr_t addr = metasim_get_rank_addr(metasim, i);
-        hg_return_t hret = margo_addr_to_string(metasim->mid, str, &len, addr);
+        margo_instance_id mid = metasim_get_rank_mid(metasim, i);
+        hg_return_t hret;
+
+        len = 512;
+        hret = margo_addr_to_string(mid, str, &len, addr);
         if (hret != HG_SUCCESS)
             __error("failed to examine the address of rank %d", i);
 
-        __debug("rank[%d]: %s %s", i, str,
-                i == metasim->rank ? "(myself)" : "");
+        __debug("rank[%d]: %s %s%s", i, str,
+                i == metasim->rank ? "(myself)" : "",
+                metasim_rank_use_sm(metasim, i) ? " (sm)" : "");
     }
 
     return ret;
 }
 
+/* SIGUSR1 dumps the in-flight operations to the log. the signal is blocked in
+ * all threads and handled synchronously by a dedicated thread. */
+static pthread_t signal_thread;
+static sigset_t signal_set;
+
+static void *signal_thread_main(void *arg)
+{
+    int sig = 0;
+
+    while (1) {
+        if (sigwait(&signal_set, &sig))
+            continue;
+
+        if (sig == SIGUSR1) {
+            metasim_op_dump(metasim_log_stream ? metasim_log_stream : stderr);
+            report_cpu();
+            metasim_perf_report(stdout);
+            metasim_diag_dump();
+            metasim_timeline_dump();
+        }
+    }
+
+    return NULL;
+}
+
+static void signal_block(void)
+{
+    sigemptyset(&signal_set);
+    sigaddset(&signal_set, SIGUSR1);
+
+    /* need to be called before spawning any threads */
+    pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+}
+
+static int signal_init(void)
+{
+    int ret = 0;
+
+    ret = pthread_create(&signal_thread, NULL, signal_thread_main, NULL);
+    if (ret) {
+        __error("failed to create the signal thread (%s)", strerror(ret));
+        return ret;
+    }
+
+    pthread_detach(signal_thread);
+
+    return ret;
+}
+
 static int test_ping(int rank)
 {
     int ret = 0;
@@ -246,25 +528,235 @@ out:
     return ret;
 }
 
+static int test_gather(int rank)
+{
+    int ret = 0;
+    void *buf = NULL;
+    uint64_t len = 0;
+    metasim_record_iter_t rec;
+
+    if (rank >= 0 && rank != metasim->rank)
+        return 0;
+
+    __debug("rank %d, performing gather test", metasim->rank);
+
+    ret = metasim_rpc_invoke_allgather(METASIM_RECORD_HOSTNAME, 0, &buf, &len);
+    if (ret) {
+        __error("rpc gather failed");
+        return ret;
+    }
+
+    metasim_record_for_each(&rec, buf, len)
+        __debug("[RPC GATHER] rank[%d]: %s", rec.rank, rec.data);
+
+    free(buf);
+
+    return ret;
+}
+
+static double bench_barrier_run(int type, int repeat)
+{
+    int i = 0;
+    double start = .0f;
+    double stop = .0f;
+
+    /* start from the same point */
+    metasim_fence();
+
+    start = MPI_Wtime();
+
+    for (i = 0; i < repeat; i++) {
+        if (type < 0)
+            MPI_Barrier(MPI_COMM_WORLD);
+        else
+            metasim_rpc_barrier(type);
+    }
+
+    stop = MPI_Wtime();
+
+    return (stop - start) / repeat;
+}
+
+static void bench_barrier(int repeat)
+{
+    int i = 0;
+    double elapsed = .0f;
+    struct {
+        int type;
+        const char *name;
+    } barriers[] = {
+        { -1, "mpi" },
+        { METASIM_BARRIER_TREE, "tree" },
+        { METASIM_BARRIER_DISSEMINATION, "dissemination" },
+    };
+
+    for (i = 0; i < sizeof(barriers)/sizeof(barriers[0]); i++) {
+        elapsed = bench_barrier_run(barriers[i].type, repeat);
+
+        __debug("[BARRIER] %s: %.6lf seconds (%d runs)",
+                barriers[i].name, elapsed, repeat);
+
+        /* barrier,nranks,repeat,avg,transport,injection */
+        if (metasim->rank == 0)
+            printf("## barrier,%s,%d,%d,%.6lf,%s,%s\n",
+                   barriers[i].name, metasim->nranks, repeat, elapsed,
+                   metasim->transport, metasim_inject_describe());
+    }
+
+    fflush(stdout);
+}
+
+static const char *prewarm_str[] = { "none", "tree", "all" };
+
+/* compares the first sum from rank 0 with the following @repeat sums */
+static void bench_first_op(int prewarm, int repeat)
+{
+    int i = 0;
+    int32_t sum = 0;
+    double start = .0f;
+    double first = .0f;
+    double steady = .0f;
+
+    if (metasim->rank != 0)
+        return;
+
+    start = MPI_Wtime();
+    metasim_rpc_invoke_sum(0, &sum);
+    first = MPI_Wtime() - start;
+
+    start = MPI_Wtime();
+    for (i = 0; i < repeat; i++)
+        metasim_rpc_invoke_sum(0, &sum);
+    steady = (MPI_Wtime() - start) / repeat;
+
+    __debug("[FIRST OP] prewarm=%s: first=%.6lf, steady=%.6lf seconds",
+            prewarm_str[prewarm], first, steady);
+
+    /* firstop,prewarm,nranks,repeat,first,steady avg,ratio,transport,
+     * injection */
+    printf("## firstop,%s,%d,%d,%.6lf,%.6lf,%.2lf,%s,%s\n",
+           prewarm_str[prewarm], metasim->nranks, repeat, first, steady,
+           steady > 0 ? first / steady : .0f, metasim->transport,
+           metasim_inject_describe());
+    fflush(stdout);
+}
+
 static struct option l_opts[] = {
+    { "barrier-bench", 1, 0, 'b' },
+    { "max-collectives", 1, 0, 'c' },
+    { "clock-sync", 1, 0, 'C' },
+    { "first-op-bench", 1, 0, 'f' },
+    { "diag", 1, 0, 'g' },
+    { "perf", 0, 0, 'e' },
+    { "profile", 0, 0, 'G' },
     { "help", 0, 0, 'h' },
+    { "inject-delay", 1, 0, 'd' },
+    { "inject-drop", 1, 0, 'D' },
+    { "inject-ranks", 1, 0, 'R' },
+    { "interface", 1, 0, 'I' },
+    { "listener-hwm", 1, 0, 'l' },
+    { "listener-progress", 1, 0, 'L' },
+    { "listener-reject", 0, 0, 'r' },
+    { "merge-window", 1, 0, 'm' },
+    { "noreply", 0, 0, 'n' },
+    { "op-timeout", 1, 0, 'o' },
+    { "progress", 1, 0, 'P' },
+    { "transport", 1, 0, 'p' },
     { "verbs", 0, 0, 'i' },
     { "silent", 0, 0, 's' },
+    { "sm-peers", 0, 0, 'S' },
     { "test", 0, 0, 't' },
+    { "topo-tree", 0, 0, 'T' },
+    { "prewarm", 1, 0, 'w' },
+    { "trace", 1, 0, 'x' },
+    { "timeline", 1, 0, 'X' },
     { 0, 0, 0, 0 },
 };
 
-static char *s_opts = "hist";
+static char *s_opts = "b:c:C:d:D:ef:g:GhI:il:L:m:no:P:p:rR:sStTw:x:X:";
 
 static const char *usage_str =
 "\n"
 "Usage: metasimd [options...]\n"
 "\n"
 "Availble options:\n"
+"-b, --barrier-bench=<N>\n"
+"                  compare barriers with <N> runs each on start up\n"
+"-c, --max-collectives=<N>\n"
+"                  run at most <N> collectives rooted at each server at a\n"
+"                  time, and queue the rest (default: unlimited)\n"
+"-C, --clock-sync=<N>[:<sec>]\n"
+"                  estimate the clock offset to rank 0 with <N> pings on\n"
+"                  start up, and every <sec> seconds if given (default: 16\n"
+"                  pings on start up with --trace, otherwise disabled)\n"
+"-d, --inject-delay=<spec>\n"
+"                  delay the rpc handlers by fixed:<usec>, uniform:<min>:<max>\n"
+"                  or exp:<mean> usec (env: METASIM_INJECT_DELAY)\n"
+"-D, --inject-drop=<p>\n"
+"                  drop server-to-server sum responses with probability <p>,\n"
+"                  e.g., 0.01, if the sum has a deadline (--op-timeout or a\n"
+"                  timed client sum). other rpcs are only delayed\n"
+"                  (env: METASIM_INJECT_DROP)\n"
+"-e, --perf        count cycles, instructions, cache misses and context\n"
+"                  switches of each rpc handler call with perf_event_open,\n"
+"                  reported per handler at exit and on SIGUSR1\n"
+"-f, --first-op-bench=<N>\n"
+"                  compare the first sum with <N> following sums on start up\n"
+"-g, --diag=<sec>  collect margo diagnostics of the server and listener\n"
+"                  instances, dumped to logs/margo/diag-<rank>-<instance>\n"
+"                  every <sec> seconds (0: at exit only) and on SIGUSR1\n"
+"-G, --profile     collect margo rpc profiles as well, dumped likewise to\n"
+"                  logs/margo/profile-<rank>-<instance>\n"
 "-h, --help        print this help message\n"
-"-i, --verbs       use ibverbs transport (default: tcp)\n"
+"-I, --interface=<hint>\n"
+"                  address hint for the transport, e.g., a network interface,\n"
+"                  a domain or host:port, appended after \"://\"\n"
+"-i, --verbs       use ibverbs transport, same as --transport=ofi+verbs\n"
+"-l, --listener-hwm=<N>\n"
+"                  admit at most <N> running client requests in listener,\n"
+"                  and queue the rest without a handler ult until a slot\n"
+"                  frees up (default: unlimited)\n"
+"-L, --listener-progress=<mode>\n"
+"                  progress mode of the listener, see --progress\n"
+"-m, --merge-window=<usec>\n"
+"                  merge concurrent sums from different roots into a single\n"
+"                  allreduce, started <usec> after the first request\n"
+"                  (default: 0, disabled)\n"
+"-n, --noreply     use one-way rpcs for sum requests and partial results\n"
+"-o, --op-timeout=<usec>\n"
+"                  respond to sums within <usec>, leaving out the servers\n"
+"                  that miss their deadline (default: 0, wait for all)\n"
+"-P, --progress=<mode>\n"
+"                  progress mode of the server instances: block (default),\n"
+"                  spin (busy-polling), or hybrid[:<usec>] (spin while busy\n"
+"                  and for <usec> after, default 1000, then block)\n"
+"-p, --transport=<plugin>\n"
+"                  mercury transport for server rpcs, e.g., ofi+tcp://,\n"
+"                  ofi+verbs, ofi+sockets://, bmi+tcp://, ucx+all://\n"
+"                  (default: ofi+tcp://)\n"
+"-r, --listener-reject\n"
+"                  reject requests above the high-water mark with EBUSY,\n"
+"                  instead of delaying them\n"
+"-R, --inject-ranks=<list>\n"
+"                  inject delays and drops only on the listed ranks, e.g.,\n"
+"                  1,4-7 (env: METASIM_INJECT_RANKS, default: all)\n"
 "-s, --silent      do not print any logs\n"
+"-S, --sm-peers    use a separate na+sm instance for rpcs between the servers\n"
+"                  on the same node\n"
 "-t, --test        perform self test on server start up\n"
+"-T, --topo-tree   build the collective trees in two levels, first within\n"
+"                  each node and then across the node leaders\n"
+"-w, --prewarm=<tree|all>\n"
+"                  set up connections to the tree neighbors or to all\n"
+"                  servers, and warm up the handler pools on start up\n"
+"-x, --trace=<N>   record trace events of one in <N> sums rooted at each\n"
+"                  server, written to logs/trace/<rank>.trace at exit, in\n"
+"                  the clock of rank 0 (see --clock-sync)\n"
+"-X, --timeline=<N>\n"
+"                  record a timeline of the rpc handlers with up to <N>\n"
+"                  events per execution stream, written as chrome trace\n"
+"                  json to logs/timeline/<rank>.json at exit and on SIGUSR1\n"
+"                  (merge them with metasim-trace --timeline)\n"
 "\n";
 
 static void print_usage(int ec)
@@ -282,10 +774,19 @@ int main(int argc, char **argv)
     int mpi_nranks = 0;
     int selftest = 0;
     int silent = 0;
+    int barrier_repeat = 0;
+    int first_op_repeat = 0;
+    int prewarm = 0;
+    int max_collectives = 0;
+    metasim_listener_conf_t listener_conf = { 0, };
+    metasim_inject_conf_t inject_conf = { 0, };
     char *pos = NULL;
     char logfile[PATH_MAX];
     char loglink[PATH_MAX];
 
+    /* block signals before mpi and margo spawn threads */
+    signal_block();
+
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &mpi_nranks);
@@ -294,18 +795,127 @@ int main(int argc, char **argv)
 
     while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
         switch (ch) {
+        case 'b':
+            barrier_repeat = atoi(optarg);
+            break;
+
+        case 'd':
+            inject_conf.delay = optarg;
+            break;
+
+        case 'D':
+            inject_conf.drop = optarg;
+            break;
+
+        case 'f':
+            first_op_repeat = atoi(optarg);
+            break;
+
+        case 'g':
+            diag_conf.enabled = 1;
+            diag_conf.interval = atof(optarg);
+            break;
+
+        case 'G':
+            diag_conf.profile = 1;
+            break;
+
+        case 'w':
+            if (!strcmp(optarg, "tree"))
+                prewarm = 1;
+            else if (!strcmp(optarg, "all"))
+                prewarm = 2;
+            else
+                print_usage(1);
+            break;
+
+        case 'c':
+            max_collectives = atoi(optarg);
+            break;
+
+        case 'C':
+            clock_samples = atoi(optarg);
+            pos = strchr(optarg, ':');
+            if (clock_samples <= 0 || (pos && atof(&pos[1]) <= 0))
+                print_usage(1);
+            clock_interval = pos ? atof(&pos[1]) : 0;
+            break;
+
+        case 'I':
+            metasim_transport_hint = optarg;
+            break;
+
         case 'i':
-            metasim_proto = 1;
+            metasim_transport = "ofi+verbs";
+            break;
+
+        case 'l':
+            listener_conf.hwm = atoi(optarg);
+            break;
+
+        case 'L':
+            if (metasim_progress_parse(optarg, &listener_progress_conf))
+                print_usage(1);
+            listener_conf.progress = listener_progress_conf;
+            break;
+
+        case 'P':
+            if (metasim_progress_parse(optarg, &progress_conf))
+                print_usage(1);
+            break;
+
+        case 'm':
+            merge_window = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'n':
+            noreply = 1;
+            break;
+
+        case 'o':
+            op_timeout = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'p':
+            metasim_transport = optarg;
+            break;
+
+        case 'r':
+            listener_conf.reject = 1;
+            break;
+
+        case 'R':
+            inject_conf.ranks = optarg;
             break;
 
         case 's':
             silent = 1;
             break;
 
+        case 'S':
+            use_sm = 1;
+            break;
+
         case 't':
             selftest = 1;
             break;
 
+        case 'T':
+            topo_tree = 1;
+            break;
+
+        case 'x':
+            trace_rate = atoi(optarg);
+            break;
+
+        case 'e':
+            perf_counters = 1;
+            break;
+
+        case 'X':
+            timeline_events = strtoull(optarg, NULL, 0);
+            break;
+
         case 'h':
         default:
             print_usage(0);
@@ -317,6 +927,8 @@ int main(int argc, char **argv)
     system("mkdir -p logs/margo");
     system("mkdir -p logs/hosts");
     system("mkdir -p logs/addr");
+    system("mkdir -p logs/trace");
+    system("mkdir -p logs/timeline");
     gethostname(hostname, NAME_MAX);
 
     if (silent) {
@@ -331,12 +943,44 @@ int main(int argc, char **argv)
     }
 
     /* initialize communication */
-    ret = comm_init(mpi_rank, mpi_nranks);
+    ret = comm_init(mpi_rank, mpi_nranks, use_sm);
     if (ret) {
         __error("failed to initialize the communication with peers");
         goto out;
     }
 
+    ret = metasim_poll_init(metasim->mid, &progress_conf);
+    if (!ret && metasim->sm_mid != MARGO_INSTANCE_NULL)
+        ret = metasim_poll_init(metasim->sm_mid, &progress_conf);
+    if (ret) {
+        __error("failed to set the progress mode");
+        goto out;
+    }
+
+    ret = metasim_inject_init(&inject_conf, metasim->rank);
+    if (ret) {
+        __error("failed to set up the latency injection");
+        goto out;
+    }
+
+    metasim_trace_init(metasim->rank, trace_rate);
+    metasim_timeline_init(metasim->rank, timeline_events);
+
+    if (metasim_perf_init(metasim->rank, perf_counters))
+        __error("hardware counters are disabled");
+
+    /* before any rpcs are registered, to see them all */
+    metasim_diag_init(&diag_conf, metasim->rank);
+    ret = metasim_diag_add(metasim->mid, "server");
+    if (!ret)
+        ret = metasim_diag_add(metasim->sm_mid, "sm");
+    if (!ret)
+        ret = metasim_diag_start(metasim->mid);
+    if (ret) {
+        __error("failed to start margo diagnostics");
+        goto out;
+    }
+
     /* create a symlink log file with rank */
     pos = strchr(logfile, '/');
     sprintf(loglink, "logs/metasimd.%d", metasim->rank);
@@ -353,13 +997,57 @@ int main(int argc, char **argv)
         }
     }
 
+    ret = metasim_op_init(max_collectives);
+    if (ret) {
+        __error("failed to initialize the in-flight operation table");
+        goto out;
+    }
+
+    signal_init();
+
     /* register rpcs */
     metasim_rpc_register();
-    //margo_diag_start(metasim->mid);
+    metasim_rpc_set_merge_window(merge_window);
+    metasim_rpc_set_noreply(noreply);
+    metasim_rpc_set_op_timeout(op_timeout);
+    metasim_rpc_set_tree_hier(topo_tree);
 
     /* wait until all are initialized */
     __fence("all peers are initialized");
 
+    if (prewarm) {
+        if (metasim_rpc_prewarm(prewarm == 2, 64))
+            __error("failed to pre-warm connections");
+        __fence("pre-warmed connections");
+    }
+
+    /* before any other rpcs, which would warm up the connections. the mpi
+     * fence keeps the rpc barrier from warming them up first. */
+    if (first_op_repeat > 0) {
+        bench_first_op(prewarm, first_op_repeat);
+        __fence("## first operation benchmark completed");
+    }
+
+    rpc_fence = 1;
+
+    if (trace_rate > 0 && clock_samples == 0)
+        clock_samples = 16;
+
+    if (clock_samples > 0) {
+        if (metasim_clock_sync(clock_samples))
+            __error("failed to estimate the clock offset");
+        report_clock();
+
+        if (metasim_clock_start(metasim->mid, clock_samples, clock_interval))
+            __error("failed to start the periodic clock sync");
+        __fence("estimated clock offsets");
+    }
+
+    if (barrier_repeat > 0) {
+        bench_barrier(barrier_repeat);
+        __fence("## barrier benchmark completed");
+    }
+
     if (selftest) {
         __debug("## test[0]: ping from 0");
         test_ping(0);
@@ -376,12 +1064,18 @@ int main(int argc, char **argv)
         __debug("## test[3]: broadcast sum from all ranks");
         test_sum(-1);
         __fence("## broadcast sum test completed from all ranks");
+
+        __debug("## test[4]: allgather hostnames from rank 0");
+        test_gather(0);
+        __fence("## allgather test completed from rank 0");
     }
 
     /* init listener to accept requests from local clients */
-    metasim_listener_init();
+    metasim_listener_init(&listener_conf);
+
+    serve_start = MPI_Wtime();
+    serve_cpu_start = metasim_poll_cpu_time();
 
-    //margo_diag_dump(metasim->mid, "logs/margo/diag", 1);
     margo_wait_for_finalize(metasim->mid);
 out:
     cleanup();
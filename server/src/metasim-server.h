@@ -12,17 +12,49 @@ struct metasim_server {
     int rank;
     int nranks;
     hg_addr_t *peer_addrs;
+    int *node_leaders;      /* the lowest rank on the node of each rank */
 
     margo_instance_id mid;
+    const char *transport;  /* mercury plugin string of mid */
+
+    /* na+sm instance for servers on the same node, MARGO_INSTANCE_NULL if
+     * disabled. sm_addrs[] is only valid for the ranks on the same node. */
+    margo_instance_id sm_mid;
+    hg_addr_t *sm_addrs;
 };
 
 typedef struct metasim_server metasim_server_t;
 
+/* true if @rank runs on the same node and is reached over na+sm */
+static inline int metasim_rank_use_sm(metasim_server_t *m, int rank)
+{
+    return m->sm_mid != MARGO_INSTANCE_NULL &&
+           m->node_leaders[rank] == m->node_leaders[m->rank];
+}
+
+/* the address of @rank on the transport chosen for it. it should be used
+ * with the instance from metasim_get_rank_mid(). */
 static inline hg_addr_t metasim_get_rank_addr(metasim_server_t *m, int rank)
 {
-    return m->peer_addrs[rank];
+    if (metasim_rank_use_sm(m, rank))
+        return m->sm_addrs[rank];
+    else
+        return m->peer_addrs[rank];
+}
+
+static inline margo_instance_id
+metasim_get_rank_mid(metasim_server_t *m, int rank)
+{
+    return metasim_rank_use_sm(m, rank) ? m->sm_mid : m->mid;
+}
+
+static inline int metasim_get_node_leader(metasim_server_t *m, int rank)
+{
+    return m->node_leaders[rank];
 }
 
+/* mpi barrier, only used for bootstrapping. once the rpcs are registered,
+ * use metasim_rpc_barrier() instead. */
 static inline void metasim_fence(void)
 {
     MPI_Barrier(MPI_COMM_WORLD);
@@ -0,0 +1,208 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <abt.h>
+
+#include "metasim-log.h"
+#include "metasim-clock.h"
+#include "metasim-timeline.h"
+
+typedef struct {
+    uint64_t nsec;              /* CLOCK_REALTIME */
+    uint64_t ult;
+    const char *name;
+    int32_t value;              /* pool size */
+    int32_t type;
+} timeline_event_t;
+
+/* as with the trace buffers, the slot is taken atomically */
+typedef struct {
+    uint64_t count;
+    timeline_event_t *events;
+} timeline_buf_t;
+
+int metasim_timeline_enabled;
+
+static int timeline_rank;
+static uint64_t timeline_events;
+static uint64_t timeline_dropped;
+static timeline_buf_t timeline_bufs[METASIM_TIMELINE_MAX_ES];
+
+void metasim_timeline_init(int rank, uint64_t events)
+{
+    timeline_rank = rank;
+    timeline_events = events;
+    metasim_timeline_enabled = events > 0;
+}
+
+static timeline_buf_t *timeline_buf(int es)
+{
+    timeline_buf_t *buf = &timeline_bufs[es % METASIM_TIMELINE_MAX_ES];
+    timeline_event_t *events = NULL;
+
+    if (!buf->events) {
+        events = calloc(timeline_events, sizeof(*events));
+        if (!events)
+            return NULL;
+
+        if (!__sync_bool_compare_and_swap(&buf->events, NULL, events))
+            free(events);
+    }
+
+    return buf;
+}
+
+void metasim_timeline_record(int type, const char *name)
+{
+    int es = 0;
+    size_t size = 0;
+    uint64_t pos = 0;
+    struct timespec now;
+    ABT_thread_id ult = 0;
+    ABT_pool pool = ABT_POOL_NULL;
+    ABT_xstream xstream = ABT_XSTREAM_NULL;
+    timeline_buf_t *buf = NULL;
+    timeline_event_t *e = NULL;
+
+    ABT_xstream_self_rank(&es);
+
+    buf = timeline_buf(es);
+    if (!buf) {
+        __sync_fetch_and_add(&timeline_dropped, 1);
+        return;
+    }
+
+    pos = __sync_fetch_and_add(&buf->count, 1);
+    if (pos >= timeline_events) {
+        __sync_fetch_and_add(&timeline_dropped, 1);
+        return;
+    }
+
+    if (type == METASIM_TIMELINE_POOL) {
+        ABT_xstream_self(&xstream);
+        if (ABT_xstream_get_main_pools(xstream, 1, &pool) == ABT_SUCCESS)
+            ABT_pool_get_size(pool, &size);
+    } else {
+        ABT_thread_self_id(&ult);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    e = &buf->events[pos];
+    e->nsec = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    e->ult = ult;
+    e->name = name;
+    e->value = (int32_t) size;
+    e->type = type;
+}
+
+/* chrome trace timestamps are in usec */
+static void write_event(FILE *fp, timeline_event_t *e, int es)
+{
+    int64_t nsec = 0;
+    long long usec = 0;
+    int frac = 0;
+
+    /* the slot was taken but not filled yet (dumped on SIGUSR1) */
+    if (!e->name)
+        return;
+
+    nsec = (int64_t) e->nsec +
+           metasim_clock_offset_at((int64_t) (e->nsec / 1000)) * 1000;
+    usec = nsec / 1000;
+    frac = (int) (nsec % 1000);
+
+    switch (e->type) {
+    case METASIM_TIMELINE_BEGIN:
+    case METASIM_TIMELINE_END:
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"ult\",\"ph\":\"%c\","
+                "\"id\":\"0x%llx\",\"pid\":%d,\"tid\":%d,\"ts\":%lld.%03d,"
+                "\"args\":{\"es\":%d}}", e->name,
+                e->type == METASIM_TIMELINE_BEGIN ? 'b' : 'e',
+                (unsigned long long) e->ult, timeline_rank, es, usec, frac,
+                es);
+        fprintf(fp, ",\n{\"name\":\"%s %s\",\"ph\":\"i\",\"s\":\"t\","
+                "\"pid\":%d,\"tid\":%d,\"ts\":%lld.%03d,"
+                "\"args\":{\"ult\":\"0x%llx\"}}", e->name,
+                e->type == METASIM_TIMELINE_BEGIN ? "start" : "end",
+                timeline_rank, es, usec, frac, (unsigned long long) e->ult);
+        break;
+
+    case METASIM_TIMELINE_POOL:
+        fprintf(fp, ",\n{\"name\":\"pool es%d\",\"ph\":\"C\",\"pid\":%d,"
+                "\"tid\":%d,\"ts\":%lld.%03d,\"args\":{\"size\":%d}}",
+                es, timeline_rank, es, usec, frac, e->value);
+        break;
+
+    default:
+        break;
+    }
+}
+
+int metasim_timeline_dump(void)
+{
+    int i = 0;
+    FILE *fp = NULL;
+    uint64_t j = 0;
+    uint64_t count = 0;
+    uint64_t written = 0;
+    char path[64];
+
+    if (!metasim_timeline_enabled)
+        return 0;
+
+    sprintf(path, "logs/timeline/%d.json", timeline_rank);
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        __error("failed to open %s (%s)", path, strerror(errno));
+        return errno;
+    }
+
+    /* one event per line, so that metasim-trace can merge the files */
+    fprintf(fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"metasimd %d\"}},\n"
+            "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"sort_index\":%d}}", timeline_rank, timeline_rank,
+            timeline_rank, timeline_rank);
+
+    for (i = 0; i < METASIM_TIMELINE_MAX_ES; i++) {
+        timeline_buf_t *buf = &timeline_bufs[i];
+
+        if (!buf->events)
+            continue;
+
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"es %d\"}}", timeline_rank, i,
+                i);
+
+        count = buf->count < timeline_events ? buf->count : timeline_events;
+
+        for (j = 0; j < count; j++)
+            write_event(fp, &buf->events[j], i);
+
+        written += count;
+    }
+
+    fprintf(fp, "\n]\n");
+    fclose(fp);
+
+    if (timeline_dropped)
+        __error("%llu timeline events were dropped (buffers full)",
+                (unsigned long long) timeline_dropped);
+
+    __debug("wrote %llu timeline events to %s", (unsigned long long) written,
+            path);
+
+    return 0;
+}
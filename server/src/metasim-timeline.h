@@ -0,0 +1,55 @@
+#ifndef __METASIM_TIMELINE_H
+#define __METASIM_TIMELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* timeline of the ults in a server, exported as chrome trace json
+ * (logs/timeline/<rank>.json) to be viewed in perfetto, with one process per
+ * rank and one thread per execution stream.
+ *
+ * ults on an execution stream interleave whenever one blocks, so rpc handler
+ * calls (see metasim-handler.h) and the forward/wait spans in them are
+ * recorded as nested async slices of the ult, and their start and end also
+ * appear as instants on the thread of the execution stream they ran on. at
+ * each handler start, the size of the main pool of the execution stream is
+ * recorded as a counter.
+ *
+ * events go to bounded per-execution-stream buffers, and events that do not
+ * fit are dropped. with the timeline disabled, recording costs a branch. */
+
+#define METASIM_TIMELINE_MAX_ES     64
+
+enum {
+    METASIM_TIMELINE_BEGIN = 0,
+    METASIM_TIMELINE_END,
+    METASIM_TIMELINE_POOL,
+};
+
+extern int metasim_timeline_enabled;
+
+/* keeps up to @events per execution stream (0: disabled) */
+void metasim_timeline_init(int rank, uint64_t events);
+
+void metasim_timeline_record(int type, const char *name);
+
+/* @name must be a string literal, as only the pointer is recorded */
+static inline void metasim_timeline_begin(const char *name)
+{
+    if (metasim_timeline_enabled)
+        metasim_timeline_record(METASIM_TIMELINE_BEGIN, name);
+}
+
+static inline void metasim_timeline_end(const char *name)
+{
+    if (metasim_timeline_enabled)
+        metasim_timeline_record(METASIM_TIMELINE_END, name);
+}
+
+/* writes the events to logs/timeline/<rank>.json, with each timestamp shifted
+ * by the clock offset to rank 0 in effect at the time (see metasim-clock.h),
+ * so that the timelines of all servers line up once merged (metasim-trace
+ * --timeline). */
+int metasim_timeline_dump(void);
+
+#endif /* __METASIM_TIMELINE_H */
@@ -0,0 +1,542 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ *
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+
+/* metasim-trace: puts together the trace events written by the servers
+ * (logs/trace/<rank>.trace), and prints the per-hop latency breakdown of each
+ * sampled operation, with the critical path marked, followed by a summary per
+ * tree level.
+ *
+ * for a hop from parent p to child c:
+ *   request  = recv at c - forward at p
+ *   service  = respond at c - recv at c (including the subtree of c)
+ *   response = child_done at p - respond at c
+ *
+ * the servers write the timestamps in the clock of rank 0, so request and
+ * response latencies are only as good as the clock offset uncertainty, which
+ * is reported with the summary.
+ *
+ * with --timeline, it instead merges the chrome trace timelines of the servers
+ * (logs/timeline/<rank>.json, see metasimd --timeline) into a single file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+
+#include "metasim-trace.h"
+
+typedef struct {
+    uint64_t trace;
+    int64_t usec;
+    int32_t rank;
+    int32_t type;
+    int32_t peer;
+} event_t;
+
+typedef struct {
+    int64_t recv;
+    int64_t respond;
+    int64_t forward;            /* at the parent */
+    int64_t done;               /* at the parent */
+    int parent;
+    int level;
+    int critical;
+} node_t;
+
+typedef struct {
+    uint64_t hops;
+    double request;
+    double service;
+    double response;
+    double max_service;
+} level_stat_t;
+
+#define MAX_LEVELS  64
+
+static event_t *events;
+static uint64_t nevents;
+static uint64_t capacity;
+static int max_rank = -1;
+static long long max_uncertainty;
+static level_stat_t level_stats[MAX_LEVELS];
+
+/* as written by metasim_trace_write() */
+static const char *event_str[] = {
+    "recv", "forward", "child_done", "respond",
+};
+
+static int event_type(const char *name)
+{
+    int i = 0;
+
+    for (i = 0; i < METASIM_TRACE_EVENT_MAX; i++)
+        if (!strcmp(name, event_str[i]))
+            return i;
+
+    return -1;
+}
+
+static int add_event(event_t *e)
+{
+    event_t *tmp = NULL;
+
+    if (nevents == capacity) {
+        capacity = capacity ? capacity * 2 : 4096;
+        tmp = realloc(events, capacity * sizeof(*events));
+        if (!tmp)
+            return ENOMEM;
+        events = tmp;
+    }
+
+    events[nevents++] = *e;
+    if (e->rank > max_rank)
+        max_rank = e->rank;
+    if (e->peer > max_rank)
+        max_rank = e->peer;
+
+    return 0;
+}
+
+static int read_trace_file(const char *path)
+{
+    int ret = 0;
+    FILE *fp = NULL;
+    char line[256];
+    char name[32];
+    unsigned long long trace = 0;
+    long long usec = 0;
+    long long offset = 0;
+    long long uncertainty = 0;
+    event_t e;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s (%s)\n", path, strerror(errno));
+        return errno;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "# clock,%lld,%lld", &offset, &uncertainty) == 2 &&
+            uncertainty > max_uncertainty)
+            max_uncertainty = uncertainty;
+
+        if (line[0] == '#')
+            continue;
+
+        if (sscanf(line, "%llu,%d,%31[^,],%d,%lld", &trace, &e.rank, name,
+                   &e.peer, &usec) != 5)
+            continue;
+
+        e.trace = trace;
+        e.usec = usec;
+        e.type = event_type(name);
+        if (e.type < 0)
+            continue;
+
+        ret = add_event(&e);
+        if (ret)
+            break;
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+static int read_trace_dir(const char *dir)
+{
+    int ret = 0;
+    int files = 0;
+    DIR *dp = NULL;
+    struct dirent *de = NULL;
+    char path[4096];
+    size_t len = 0;
+
+    dp = opendir(dir);
+    if (!dp) {
+        fprintf(stderr, "failed to open %s (%s)\n", dir, strerror(errno));
+        return errno;
+    }
+
+    while ((de = readdir(dp)) != NULL) {
+        len = strlen(de->d_name);
+        if (len < 7 || strcmp(&de->d_name[len - 6], ".trace"))
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+
+        ret = read_trace_file(path);
+        if (ret)
+            break;
+
+        files++;
+    }
+
+    closedir(dp);
+
+    if (!ret && files == 0) {
+        fprintf(stderr, "no trace files in %s\n", dir);
+        ret = ENOENT;
+    }
+
+    return ret;
+}
+
+static int compare_event(const void *a, const void *b)
+{
+    const event_t *ea = (const event_t *) a;
+    const event_t *eb = (const event_t *) b;
+
+    if (ea->trace != eb->trace)
+        return ea->trace < eb->trace ? -1 : 1;
+
+    return ea->usec < eb->usec ? -1 : ea->usec > eb->usec ? 1 : 0;
+}
+
+static int64_t find_forward(event_t *e, uint64_t n, int parent, int child)
+{
+    uint64_t i = 0;
+
+    for (i = 0; i < n; i++)
+        if (e[i].type == METASIM_TRACE_FORWARD && e[i].rank == parent &&
+            e[i].peer == child)
+            return e[i].usec;
+
+    return 0;
+}
+
+static int node_level(node_t *nodes, int rank)
+{
+    int level = 0;
+    int r = rank;
+
+    while (nodes[r].parent >= 0 && level <= max_rank) {
+        if (nodes[r].level >= 0)
+            return nodes[rank].level = level + nodes[r].level;
+        r = nodes[r].parent;
+        level++;
+    }
+
+    return nodes[rank].level = level;
+}
+
+/* prints the hops of a single operation in @e, and adds them to the level
+ * summary. with @quiet set, only the summary is updated. */
+static void print_trace(event_t *e, uint64_t n, node_t *nodes, int quiet)
+{
+    int c = 0;
+    int r = 0;
+    int root = -1;
+    int next = 0;
+    int level = 0;
+    int servers = 0;
+    uint64_t i = 0;
+    int64_t request = 0;
+    int64_t service = 0;
+    int64_t response = 0;
+    int64_t latest = 0;
+
+    for (r = 0; r <= max_rank; r++) {
+        memset(&nodes[r], 0, sizeof(nodes[r]));
+        nodes[r].parent = -1;
+        nodes[r].level = -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        node_t *node = &nodes[e[i].rank];
+
+        switch (e[i].type) {
+        case METASIM_TRACE_RECV:
+            /* an adopted child receives the request again from the adopter,
+             * which also takes the place of the parent below */
+            if (e[i].usec > node->recv)
+                node->recv = e[i].usec;
+            if (e[i].peer < 0)
+                root = e[i].rank;
+            break;
+
+        case METASIM_TRACE_RESPOND:
+            node->respond = e[i].usec;
+            break;
+
+        case METASIM_TRACE_CHILD_DONE:
+            /* an adopted child has the adopting server as parent */
+            nodes[e[i].peer].parent = e[i].rank;
+            nodes[e[i].peer].done = e[i].usec;
+            nodes[e[i].peer].forward = find_forward(e, n, e[i].rank,
+                                                    e[i].peer);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (root < 0) {
+        if (!quiet)
+            printf("# trace %llu: no root events, skipped\n",
+                   (unsigned long long) e[0].trace);
+        return;
+    }
+
+    /* the critical path follows the child that completed last */
+    for (r = root; r >= 0 && !nodes[r].critical; r = next) {
+        nodes[r].critical = 1;
+        next = -1;
+        latest = 0;
+
+        for (c = 0; c <= max_rank; c++) {
+            if (nodes[c].parent == r && nodes[c].done > latest) {
+                latest = nodes[c].done;
+                next = c;
+            }
+        }
+    }
+
+    for (r = 0; r <= max_rank; r++)
+        if (nodes[r].recv)
+            servers++;
+
+    if (!quiet) {
+        /* trace,root,servers,total usec */
+        printf("## trace,%llu,%d,%d,%lld\n", (unsigned long long) e[0].trace,
+               root, servers,
+               (long long) (nodes[root].respond - nodes[root].recv));
+        printf("# level,parent,rank,request,service,response,critical\n");
+    }
+
+    for (r = 0; r <= max_rank; r++) {
+        node_t *node = &nodes[r];
+
+        if (node->parent < 0 || !node->recv || !node->forward)
+            continue;
+
+        level = node_level(nodes, r);
+        request = node->recv - node->forward;
+        service = node->respond - node->recv;
+        response = node->done - node->respond;
+
+        if (!quiet)
+            printf("%d,%d,%d,%lld,%lld,%lld,%s\n", level, node->parent, r,
+                   (long long) request, (long long) service,
+                   (long long) response, node->critical ? "*" : "");
+
+        if (level < MAX_LEVELS) {
+            level_stat_t *s = &level_stats[level];
+
+            s->hops++;
+            s->request += request;
+            s->service += service;
+            s->response += response;
+            if (service > s->max_service)
+                s->max_service = service;
+        }
+    }
+}
+
+static void print_levels(void)
+{
+    int i = 0;
+
+    printf("# level,hops,avg request,avg service,avg response,max service\n");
+
+    for (i = 0; i < MAX_LEVELS; i++) {
+        level_stat_t *s = &level_stats[i];
+
+        if (!s->hops)
+            continue;
+
+        printf("## level,%d,%llu,%.1lf,%.1lf,%.1lf,%.0lf\n", i,
+               (unsigned long long) s->hops, s->request / s->hops,
+               s->service / s->hops, s->response / s->hops, s->max_service);
+    }
+}
+
+/* the servers write one event per line, between "[" and "]" lines */
+static int merge_timeline_file(FILE *out, const char *path, uint64_t *count)
+{
+    FILE *fp = NULL;
+    size_t len = 0;
+    char line[1024];
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s (%s)\n", path, strerror(errno));
+        return errno;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        len = strcspn(line, "\n");
+        while (len > 0 && line[len - 1] == ',')
+            len--;
+        line[len] = '\0';
+
+        if (line[0] != '{')
+            continue;
+
+        fprintf(out, "%s%s", *count ? ",\n" : "", line);
+        (*count)++;
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int merge_timeline(const char *dir, const char *outfile)
+{
+    int ret = 0;
+    int files = 0;
+    uint64_t count = 0;
+    FILE *out = NULL;
+    DIR *dp = NULL;
+    struct dirent *de = NULL;
+    char path[4096];
+    size_t len = 0;
+
+    dp = opendir(dir);
+    if (!dp) {
+        fprintf(stderr, "failed to open %s (%s)\n", dir, strerror(errno));
+        return errno;
+    }
+
+    out = fopen(outfile, "w");
+    if (!out) {
+        fprintf(stderr, "failed to open %s (%s)\n", outfile, strerror(errno));
+        closedir(dp);
+        return errno;
+    }
+
+    fprintf(out, "[\n");
+
+    while ((de = readdir(dp)) != NULL) {
+        len = strlen(de->d_name);
+        if (len < 6 || strcmp(&de->d_name[len - 5], ".json"))
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+
+        ret = merge_timeline_file(out, path, &count);
+        if (ret)
+            break;
+
+        files++;
+    }
+
+    fprintf(out, "\n]\n");
+    fclose(out);
+    closedir(dp);
+
+    if (!ret && files == 0) {
+        fprintf(stderr, "no timeline files in %s\n", dir);
+        ret = ENOENT;
+    }
+
+    if (!ret)
+        printf("# merged %d timelines, %llu events, into %s\n", files,
+               (unsigned long long) count, outfile);
+
+    return ret;
+}
+
+static struct option l_opts[] = {
+    { "dir", 1, 0, 'd' },
+    { "help", 0, 0, 'h' },
+    { "summary", 0, 0, 's' },
+    { "timeline", 1, 0, 't' },
+    { 0, 0, 0, 0 },
+};
+
+static char *s_opts = "d:hst:";
+
+static const char *usage_str =
+"\n"
+"Usage: metasim-trace [options...]\n"
+"\n"
+"-d, --dir=<path>  directory of the trace files (default: logs/trace, or\n"
+"                  logs/timeline with --timeline)\n"
+"-h, --help        print this help message\n"
+"-s, --summary     print only the summary per tree level\n"
+"-t, --timeline=<path>\n"
+"                  merge the timelines of the servers into a single chrome\n"
+"                  trace <path>, to be opened in perfetto\n"
+"\n";
+
+static void print_usage(int ec)
+{
+    fputs(usage_str, stderr);
+    exit(ec);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int ch = 0;
+    int ix = 0;
+    int summary = 0;
+    int traces = 0;
+    const char *dir = NULL;
+    const char *timeline = NULL;
+    uint64_t i = 0;
+    uint64_t first = 0;
+    node_t *nodes = NULL;
+
+    while ((ch = getopt_long(argc, argv, s_opts, l_opts, &ix)) >= 0) {
+        switch (ch) {
+        case 'd':
+            dir = optarg;
+            break;
+
+        case 's':
+            summary = 1;
+            break;
+
+        case 't':
+            timeline = optarg;
+            break;
+
+        case 'h':
+        default:
+            print_usage(0);
+            break;
+        }
+    }
+
+    if (timeline)
+        return merge_timeline(dir ? dir : "logs/timeline", timeline);
+
+    ret = read_trace_dir(dir ? dir : "logs/trace");
+    if (ret)
+        return ret;
+
+    qsort(events, nevents, sizeof(*events), compare_event);
+
+    nodes = calloc(max_rank + 1, sizeof(*nodes));
+    if (!nodes)
+        return ENOMEM;
+
+    for (i = 1; i <= nevents; i++) {
+        if (i < nevents && events[i].trace == events[first].trace)
+            continue;
+
+        print_trace(&events[first], i - first, nodes, summary);
+        traces++;
+        first = i;
+    }
+
+    printf("# %d traces, %llu events, clock uncertainty up to %lld usec\n",
+           traces, (unsigned long long) nevents, max_uncertainty);
+    print_levels();
+
+    free(nodes);
+    free(events);
+
+    return 0;
+}
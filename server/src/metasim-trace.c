@@ -0,0 +1,176 @@
+/* Copyright (C) 2020 - UT-Battelle, LLC. All right reserved.
+ * 
+ * Please refer to COPYING for the license.
+ * ------------------------------------------------------------------------
+ * Written by: Hyogi Sim <simh@ornl.gov>
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <abt.h>
+
+#include "metasim-log.h"
+#include "metasim-clock.h"
+#include "metasim-trace.h"
+
+/* ults on an execution stream are not preempted, but handlers can also run
+ * on the progress stream, so the slot is taken atomically */
+typedef struct {
+    uint64_t count;
+    metasim_trace_event_t *events;
+} trace_buf_t;
+
+static int trace_rank;
+static int trace_rate;
+static uint64_t trace_seq;
+static uint64_t trace_dropped;
+static int trace_recorded;
+static trace_buf_t trace_bufs[METASIM_TRACE_MAX_ES];
+
+static const char *trace_event_str[] = {
+    "recv", "forward", "child_done", "respond",
+};
+
+const char *metasim_trace_event_name(int type)
+{
+    if (type < 0 || type >= METASIM_TRACE_EVENT_MAX)
+        return "unknown";
+
+    return trace_event_str[type];
+}
+
+void metasim_trace_init(int rank, int rate)
+{
+    trace_rank = rank;
+    trace_rate = rate > 0 ? rate : 0;
+}
+
+int metasim_trace_sample(void)
+{
+    if (!trace_rate)
+        return 0;
+
+    return __sync_fetch_and_add(&trace_seq, 1) % trace_rate == 0;
+}
+
+static trace_buf_t *trace_buf(void)
+{
+    int es = 0;
+    trace_buf_t *buf = NULL;
+    metasim_trace_event_t *events = NULL;
+
+    ABT_xstream_self_rank(&es);
+    buf = &trace_bufs[es % METASIM_TRACE_MAX_ES];
+
+    if (!buf->events) {
+        events = calloc(METASIM_TRACE_EVENTS, sizeof(*events));
+        if (!events)
+            return NULL;
+
+        if (!__sync_bool_compare_and_swap(&buf->events, NULL, events))
+            free(events);
+    }
+
+    return buf;
+}
+
+void metasim_trace_record(uint64_t trace, int type, int peer)
+{
+    uint64_t pos = 0;
+    struct timespec now;
+    trace_buf_t *buf = trace_buf();
+    metasim_trace_event_t *e = NULL;
+
+    if (!buf) {
+        __sync_fetch_and_add(&trace_dropped, 1);
+        return;
+    }
+
+    pos = __sync_fetch_and_add(&buf->count, 1);
+    if (pos >= METASIM_TRACE_EVENTS) {
+        __sync_fetch_and_add(&trace_dropped, 1);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    trace_recorded = 1;
+
+    e = &buf->events[pos];
+    e->trace = trace;
+    e->type = type;
+    e->peer = peer;
+    e->usec = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int metasim_trace_write(FILE *fp)
+{
+    int i = 0;
+    uint64_t j = 0;
+    uint64_t count = 0;
+    uint64_t written = 0;
+
+    for (i = 0; i < METASIM_TRACE_MAX_ES; i++) {
+        trace_buf_t *buf = &trace_bufs[i];
+
+        if (!buf->events)
+            continue;
+
+        count = buf->count < METASIM_TRACE_EVENTS ?
+                buf->count : METASIM_TRACE_EVENTS;
+
+        for (j = 0; j < count; j++) {
+            metasim_trace_event_t *e = &buf->events[j];
+
+            fprintf(fp, "%llu,%d,%s,%d,%lld\n",
+                    (unsigned long long) e->trace, trace_rank,
+                    trace_event_str[e->type], e->peer,
+                    (long long) e->usec +
+                    metasim_clock_offset_at((int64_t) e->usec));
+        }
+
+        written += count;
+    }
+
+    if (trace_dropped)
+        __error("%llu trace events were dropped (buffers full)",
+                (unsigned long long) trace_dropped);
+
+    __debug("wrote %llu trace events", (unsigned long long) written);
+
+    return 0;
+}
+
+int metasim_trace_dump(void)
+{
+    int ret = 0;
+    FILE *fp = NULL;
+    char path[64];
+    metasim_clock_est_t est;
+
+    /* sampled operations from other roots are recorded regardless */
+    if (!trace_rate && !trace_recorded)
+        return 0;
+
+    sprintf(path, "logs/trace/%d.trace", trace_rank);
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        __error("failed to open %s (%s)", path, strerror(errno));
+        return errno;
+    }
+
+    metasim_clock_get(&est);
+
+    fprintf(fp, "# clock,%lld,%lld\n", (long long) est.offset,
+            (long long) est.uncertainty);
+    fprintf(fp, "# trace,rank,event,peer,usec\n");
+    ret = metasim_trace_write(fp);
+
+    fclose(fp);
+
+    return ret;
+}
@@ -0,0 +1,58 @@
+#ifndef __METASIM_TRACE_H
+#define __METASIM_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* tracing of sampled collectives. the root decides whether an operation is
+ * sampled, and the flag travels with the request, so that every server on
+ * the tree records the events of the same operations. the operation id is the
+ * trace id. events go to a per-execution-stream buffer, and are written to
+ * logs/trace/<rank>.trace at exit, to be put together by metasim-trace. */
+
+#define METASIM_TRACE_MAX_ES        64
+#define METASIM_TRACE_EVENTS        16384   /* per execution stream */
+
+enum {
+    METASIM_TRACE_RECV = 0,     /* request received (peer: parent) */
+    METASIM_TRACE_FORWARD,      /* request sent to a child (peer: child) */
+    METASIM_TRACE_CHILD_DONE,   /* response from a child (peer: child) */
+    METASIM_TRACE_RESPOND,      /* response sent (peer: parent) */
+    METASIM_TRACE_EVENT_MAX,
+};
+
+typedef struct {
+    uint64_t trace;
+    uint64_t usec;              /* CLOCK_REALTIME */
+    int32_t type;
+    int32_t peer;
+} metasim_trace_event_t;
+
+/* samples one in @rate operations rooted at this server (0: disabled) */
+void metasim_trace_init(int rank, int rate);
+
+/* whether the next operation rooted at this server is sampled */
+int metasim_trace_sample(void);
+
+void metasim_trace_record(uint64_t trace, int type, int peer);
+
+/* records an event of a sampled operation, no-op otherwise */
+static inline void metasim_trace(int sampled, uint64_t trace, int type,
+                                 int peer)
+{
+    if (sampled)
+        metasim_trace_record(trace, type, peer);
+}
+
+/* writes the events as csv (trace,rank,event,peer,usec) to @fp. usec is
+ * shifted by the clock offset to rank 0 in effect at the time of each event
+ * (see metasim_clock_offset_at), to align the clock with other servers. */
+int metasim_trace_write(FILE *fp);
+
+/* writes the events to logs/trace/<rank>.trace, aligned as above. the last
+ * offset and its uncertainty are recorded in the header. */
+int metasim_trace_dump(void);
+
+const char *metasim_trace_event_name(int type);
+
+#endif /* __METASIM_TRACE_H */